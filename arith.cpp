@@ -0,0 +1,594 @@
+//
+// Arithmetic: compiler of expressions, and the stack machine which runs them.
+//
+#include <cmath>
+#include <limits>
+#include <numbers>
+
+#include "prolog.h"
+
+//
+// Return the stack of the machine, shared by all evaluations on the thread:
+// it stops growing after the first deep expression.
+//
+static std::vector<Value> &value_stack()
+{
+    static thread_local std::vector<Value> stack;
+    return stack;
+}
+
+//
+// Return the code for an instance of a goal, reused by all instances on the thread.
+//
+static std::vector<Arithmetic::Instr> &scratch_code()
+{
+    static thread_local std::vector<Arithmetic::Instr> code;
+    return code;
+}
+
+//
+// Return the value of an evaluable atom, such as pi; false when it is not one.
+//
+static bool constant(const Compound *c, Value &v)
+{
+    static const std::unordered_map<const Atom *, Value> constants = {
+        { Atom::intern("pi"), Value::from_float(std::numbers::pi) },
+        { Atom::intern("e"), Value::from_float(std::numbers::e) },
+        { Atom::intern("inf"), Value::from_float(std::numeric_limits<double>::infinity()) },
+        { Atom::intern("nan"), Value::from_float(std::numeric_limits<double>::quiet_NaN()) },
+        { Atom::intern("epsilon"), Value::from_float(std::numeric_limits<double>::epsilon()) },
+        { Atom::intern("max_integer"), Value::from_integer(INT64_MAX) },
+        { Atom::intern("min_integer"), Value::from_integer(INT64_MIN) },
+    };
+    if (c->get_arity() != 0)
+        return false;
+    auto found = constants.find(c->get_functor());
+    if (found == constants.end())
+        return false;
+    v = found->second;
+    return true;
+}
+
+//
+// Count an integer overflow on the engine, and return false: the goal fails,
+// and the count tells an overflow from an ordinary failure.
+//
+static bool overflow()
+{
+    Engine::current().counters.overflows++;
+    return false;
+}
+
+//
+// Convert a float to an integer; return false when it is out of range.
+//
+static bool to_integer(double x, Value &r)
+{
+    if (!(x >= -0x1p63 && x < 0x1p63))
+        return overflow();
+    r = Value::from_integer((int64_t)x);
+    return true;
+}
+
+//
+// Raise an integer to a non-negative integer power; return false on an overflow.
+//
+static bool integer_power(int64_t x, int64_t y, int64_t &r)
+{
+    r = 1;
+    while (y > 0) {
+        if ((y & 1) && __builtin_mul_overflow(r, x, &r))
+            return false;
+        y >>= 1;
+        if (y > 0 && __builtin_mul_overflow(x, x, &x))
+            return false;
+    }
+    return true;
+}
+
+//
+// Apply an operation of one argument; return false on an error.
+//
+static bool unary(Arithmetic::Op op, const Value &x, Value &r)
+{
+    bool i = !x.is_float();
+    switch (op) {
+    case Arithmetic::NEG:
+        if (i) {
+            if (x.integer == INT64_MIN)
+                return overflow();
+            r = Value::from_integer(-x.integer);
+        } else {
+            r = Value::from_float(-x.real);
+        }
+        return true;
+    case Arithmetic::PLUS:
+        r = x;
+        return true;
+    case Arithmetic::ABS:
+        if (i) {
+            if (x.integer == INT64_MIN)
+                return overflow();
+            r = Value::from_integer(x.integer < 0 ? -x.integer : x.integer);
+        } else {
+            r = Value::from_float(std::fabs(x.real));
+        }
+        return true;
+    case Arithmetic::SIGN:
+        if (i)
+            r = Value::from_integer((x.integer > 0) - (x.integer < 0));
+        else
+            r = Value::from_float((x.real > 0) - (x.real < 0));
+        return true;
+    case Arithmetic::NOT:
+        if (!i)
+            return false;
+        r = Value::from_integer(~x.integer);
+        return true;
+    case Arithmetic::FLOAT:
+        r = Value::from_float(x.as_float());
+        return true;
+    case Arithmetic::INTEGER:
+    case Arithmetic::ROUND:
+        if (i) {
+            r = x;
+            return true;
+        }
+        return to_integer(std::round(x.real), r);
+    case Arithmetic::TRUNCATE:
+        if (i) {
+            r = x;
+            return true;
+        }
+        return to_integer(std::trunc(x.real), r);
+    case Arithmetic::CEILING:
+        if (i) {
+            r = x;
+            return true;
+        }
+        return to_integer(std::ceil(x.real), r);
+    case Arithmetic::FLOOR:
+        if (i) {
+            r = x;
+            return true;
+        }
+        return to_integer(std::floor(x.real), r);
+    case Arithmetic::SQRT:
+        if (x.as_float() < 0)
+            return false;
+        r = Value::from_float(std::sqrt(x.as_float()));
+        return true;
+    case Arithmetic::EXP:
+        r = Value::from_float(std::exp(x.as_float()));
+        return true;
+    case Arithmetic::LOG:
+        if (x.as_float() <= 0)
+            return false;
+        r = Value::from_float(std::log(x.as_float()));
+        return true;
+    case Arithmetic::SIN:
+        r = Value::from_float(std::sin(x.as_float()));
+        return true;
+    case Arithmetic::COS:
+        r = Value::from_float(std::cos(x.as_float()));
+        return true;
+    case Arithmetic::ATAN:
+        r = Value::from_float(std::atan(x.as_float()));
+        return true;
+    default:
+        return false;
+    }
+}
+
+//
+// Apply an operation of two arguments; return false on an error.
+// Integers give integers, except for division with a remainder, and for **;
+// a float argument makes the result a float.
+//
+static bool binary(Arithmetic::Op op, const Value &x, const Value &y, Value &r)
+{
+    bool i = !x.is_float() && !y.is_float();
+    int64_t n;
+    switch (op) {
+    case Arithmetic::ADD:
+        if (!i) {
+            r = Value::from_float(x.as_float() + y.as_float());
+            return true;
+        }
+        if (__builtin_add_overflow(x.integer, y.integer, &n))
+            return overflow();
+        r = Value::from_integer(n);
+        return true;
+    case Arithmetic::SUB:
+        if (!i) {
+            r = Value::from_float(x.as_float() - y.as_float());
+            return true;
+        }
+        if (__builtin_sub_overflow(x.integer, y.integer, &n))
+            return overflow();
+        r = Value::from_integer(n);
+        return true;
+    case Arithmetic::MUL:
+        if (!i) {
+            r = Value::from_float(x.as_float() * y.as_float());
+            return true;
+        }
+        if (__builtin_mul_overflow(x.integer, y.integer, &n))
+            return overflow();
+        r = Value::from_integer(n);
+        return true;
+    case Arithmetic::DIV:
+        if (y.as_float() == 0)
+            return false;
+        if (i && y.integer != -1 && x.integer % y.integer == 0) {
+            r = Value::from_integer(x.integer / y.integer);
+            return true;
+        }
+        if (i && y.integer == -1)
+            return unary(Arithmetic::NEG, x, r);
+        r = Value::from_float(x.as_float() / y.as_float());
+        return true;
+    case Arithmetic::IDIV:
+    case Arithmetic::FDIV:
+        if (!i || y.integer == 0)
+            return false;
+        if (x.integer == INT64_MIN && y.integer == -1)
+            return overflow();
+        n = x.integer / y.integer;
+        if (op == Arithmetic::FDIV && x.integer % y.integer != 0 && (x.integer < 0) != (y.integer < 0))
+            n--;
+        r = Value::from_integer(n);
+        return true;
+    case Arithmetic::MOD:
+    case Arithmetic::REM:
+        if (!i || y.integer == 0)
+            return false;
+        n = (y.integer == -1) ? 0 : x.integer % y.integer;
+        if (op == Arithmetic::MOD && n != 0 && (n < 0) != (y.integer < 0))
+            n += y.integer;
+        r = Value::from_integer(n);
+        return true;
+    case Arithmetic::MIN:
+    case Arithmetic::MAX: {
+        bool less = i ? x.integer < y.integer : x.as_float() < y.as_float();
+        r = (less == (op == Arithmetic::MIN)) ? x : y;
+        return true;
+    }
+    case Arithmetic::SHL:
+    case Arithmetic::SHR: {
+        if (!i)
+            return false;
+        int64_t shift = (op == Arithmetic::SHL) ? y.integer : -y.integer;
+        if (shift >= 0) {
+            if (shift >= 64)
+                n = 0;
+            else
+                n = (int64_t)((uint64_t)x.integer << shift);
+            if (shift >= 64 ? x.integer != 0 : (n >> shift) != x.integer)
+                return overflow();
+        } else {
+            n = (shift <= -64) ? (x.integer < 0 ? -1 : 0) : x.integer >> -shift;
+        }
+        r = Value::from_integer(n);
+        return true;
+    }
+    case Arithmetic::AND:
+    case Arithmetic::OR:
+    case Arithmetic::XOR:
+        if (!i)
+            return false;
+        n = (op == Arithmetic::AND) ? (x.integer & y.integer)
+            : (op == Arithmetic::OR) ? (x.integer | y.integer)
+                                     : (x.integer ^ y.integer);
+        r = Value::from_integer(n);
+        return true;
+    case Arithmetic::POWER:
+        r = Value::from_float(std::pow(x.as_float(), y.as_float()));
+        return true;
+    case Arithmetic::IPOWER:
+        if (!i) {
+            r = Value::from_float(std::pow(x.as_float(), y.as_float()));
+            return true;
+        }
+        if (y.integer < 0) {
+            // Only 1 and -1 have integer powers below zero.
+            if (x.integer != 1 && x.integer != -1)
+                return false;
+            r = Value::from_integer((x.integer == -1 && (y.integer & 1)) ? -1 : 1);
+            return true;
+        }
+        if (!integer_power(x.integer, y.integer, n))
+            return overflow();
+        r = Value::from_integer(n);
+        return true;
+    default:
+        return false;
+    }
+}
+
+//
+// Return true when the goal is arithmetic, and set its relation.
+//
+bool Arithmetic::relation_of(const Compound *goal, Relation &r)
+{
+    static Atom *const relations[] = {
+        Atom::intern("is"), Atom::intern("=:="), Atom::intern("=\\="), Atom::intern("<"),
+        Atom::intern(">"),  Atom::intern("=<"),  Atom::intern(">="),
+    };
+    if (goal->get_arity() != 2)
+        return false;
+    for (unsigned i = 0; i < std::size(relations); i++) {
+        if (goal->get_functor() == relations[i]) {
+            r = Relation(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+//
+// Return the operation of an evaluable functor; false when there is none.
+//
+bool Arithmetic::operation(const Compound *c, Op &op)
+{
+    static const std::unordered_map<uint64_t, Op> operations = [] {
+        static const struct {
+            const char *name;
+            int arity;
+            Op op;
+        } table[] = {
+            { "-", 1, NEG },         { "+", 1, PLUS },          { "abs", 1, ABS },        { "sign", 1, SIGN },
+            { "+", 2, ADD },         { "-", 2, SUB },           { "*", 2, MUL },          { "/", 2, DIV },
+            { "//", 2, IDIV },       { "div", 2, FDIV },        { "mod", 2, MOD },        { "rem", 2, REM },
+            { "min", 2, MIN },       { "max", 2, MAX },         { "<<", 2, SHL },         { ">>", 2, SHR },
+            { "/\\", 2, AND },       { "\\/", 2, OR },          { "xor", 2, XOR },        { "\\", 1, NOT },
+            { "**", 2, POWER },      { "^", 2, IPOWER },        { "float", 1, FLOAT },    { "integer", 1, INTEGER },
+            { "truncate", 1, TRUNCATE }, { "round", 1, ROUND }, { "ceiling", 1, CEILING }, { "floor", 1, FLOOR },
+            { "sqrt", 1, SQRT },     { "exp", 1, EXP },         { "log", 1, LOG },        { "sin", 1, SIN },
+            { "cos", 1, COS },       { "atan", 1, ATAN },
+        };
+        std::unordered_map<uint64_t, Op> map;
+        for (const auto &entry : table)
+            map.emplace(Compound::make_key(Atom::intern(entry.name), entry.arity), entry.op);
+        return map;
+    }();
+
+    auto found = operations.find(c->key());
+    if (found == operations.end())
+        return false;
+    op = found->second;
+    return true;
+}
+
+//
+// Append the code of the expression, operands first: the arguments
+// are pushed to a work list, with the operation below them.
+// Variables of a template are taken from the frame, and other variables
+// of a template are evaluated when the code runs; in other terms,
+// variables are followed, and an unbound one is an error.
+//
+bool Arithmetic::compile(Term *t, bool in_template, std::vector<Instr> &code)
+{
+    struct Item {
+        Term *term; // Expression to compile, or nullptr for the operation
+        Op op;
+    };
+    static thread_local std::vector<Item> work;
+    work.clear();
+    work.push_back({ t, PUSH });
+
+    while (!work.empty()) {
+        Item item = work.back();
+        work.pop_back();
+        if (!item.term) {
+            code.push_back({ item.op, 0, Value(), nullptr });
+            continue;
+        }
+
+        Variable *v = item.term->as_variable();
+        if (in_template && v) {
+            if (v->get_slot() >= 0)
+                code.push_back({ LOAD, v->get_slot(), Value(), nullptr });
+            else
+                code.push_back({ EVAL, 0, Value(), v });
+            continue;
+        }
+        if (Number *n = item.term->as_number()) {
+            code.push_back({ PUSH, 0, n->get_value(), nullptr });
+            continue;
+        }
+        Compound *c = item.term->as_compound();
+        if (!c)
+            return false;
+
+        Op op;
+        Value value;
+        if (constant(c, value)) {
+            code.push_back({ PUSH, 0, value, nullptr });
+        } else if (operation(c, op)) {
+            work.push_back({ nullptr, op });
+            for (int i = c->get_arity(); i > 0; i--)
+                work.push_back({ c->arg(i - 1), PUSH });
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+//
+// Run the code, pushing the results to the stack; return false on an error.
+// A variable in the frame is usually bound to a number; a variable bound
+// to an expression has its own code compiled on the fly.
+//
+bool Arithmetic::run(const std::vector<Instr> &code, Term **frame, std::vector<Value> &stack)
+{
+    for (const Instr &i : code) {
+        switch (i.op) {
+        case PUSH:
+            stack.push_back(i.value);
+            break;
+        case LOAD:
+        case EVAL: {
+            Term *t = (i.op == LOAD) ? frame[i.slot] : i.term;
+            if (Number *n = t->as_number()) {
+                stack.push_back(n->get_value());
+                break;
+            }
+            Value v;
+            if (!evaluate(t, v))
+                return false;
+            stack.push_back(v);
+            break;
+        }
+        default:
+            if (!apply(i.op, stack))
+                return false;
+            break;
+        }
+    }
+    return true;
+}
+
+//
+// Apply the operation to the values on top of the stack: they are replaced by the result.
+//
+bool Arithmetic::apply(Op op, std::vector<Value> &stack)
+{
+    Value r;
+    if (op >= ADD && op <= IPOWER) {
+        Value y = stack.back();
+        stack.pop_back();
+        if (!binary(op, stack.back(), y, r))
+            return false;
+    } else if (!unary(op, stack.back(), r)) {
+        return false;
+    }
+    stack.back() = r;
+    return true;
+}
+
+//
+// Return true when two values are in the relation.
+// Integers are compared exactly, and are converted for a comparison with a float.
+//
+bool Arithmetic::compare(Relation r, const Value &a, const Value &b)
+{
+    int order;
+    if (!a.is_float() && !b.is_float()) {
+        order = (a.integer > b.integer) - (a.integer < b.integer);
+    } else {
+        double x = a.as_float(), y = b.as_float();
+        if (std::isnan(x) || std::isnan(y))
+            return r == NOT_EQUAL;
+        order = (x > y) - (x < y);
+    }
+    switch (r) {
+    case EQUAL:
+        return order == 0;
+    case NOT_EQUAL:
+        return order != 0;
+    case LESS:
+        return order < 0;
+    case GREATER:
+        return order > 0;
+    case LESS_EQUAL:
+        return order <= 0;
+    case GREATER_EQUAL:
+        return order >= 0;
+    default:
+        return false;
+    }
+}
+
+//
+// Finish the goal with the values of its expressions: is/2 matches
+// its left side to the number, in the frame of a template,
+// and a comparison compares the two values.
+//
+bool Arithmetic::finish(Relation r, Term *left, Term **frame, const Value *values)
+{
+    if (r != IS)
+        return compare(r, values[0], values[1]);
+    Number *n = Number::create(values[0]);
+    return frame ? left->match(n, frame) : left->unify(n);
+}
+
+//
+// Compile an arithmetic goal of a clause template; return nullptr when it is not one,
+// or when it holds no arithmetic expression: then it fails when called.
+//
+const Arithmetic *Arithmetic::compile(Compound *goal)
+{
+    Relation r;
+    if (!relation_of(goal, r))
+        return nullptr;
+
+    auto *a = new Arithmetic(r, goal->arg(0));
+    if ((r != IS && !compile(goal->arg(0), true, a->code)) || !compile(goal->arg(1), true, a->code)) {
+        delete a;
+        return nullptr;
+    }
+    return a;
+}
+
+//
+// Solve the compiled goal, with the variables in the frame.
+//
+bool Arithmetic::solve(Term **frame) const
+{
+    std::vector<Value> &stack = value_stack();
+    size_t base = stack.size();
+    bool success = run(code, frame, stack) && finish(relation, result, frame, &stack[base]);
+    stack.resize(base);
+    return success;
+}
+
+//
+// Solve an instance of an arithmetic goal.
+//
+bool Arithmetic::solve(Compound *goal)
+{
+    Relation r;
+    if (!relation_of(goal, r))
+        return false;
+
+    std::vector<Instr> &code = scratch_code();
+    code.clear();
+    if ((r != IS && !compile(goal->arg(0), false, code)) || !compile(goal->arg(1), false, code))
+        return false;
+
+    std::vector<Value> &stack = value_stack();
+    size_t base = stack.size();
+    bool success = run(code, nullptr, stack) && finish(r, goal->arg(0), nullptr, &stack[base]);
+    stack.resize(base);
+    return success;
+}
+
+//
+// Evaluate the expression; return false when it cannot be evaluated.
+//
+bool Arithmetic::evaluate(Term *t, Value &v)
+{
+    std::vector<Instr> &code = scratch_code();
+    code.clear();
+    if (!compile(t, false, code))
+        return false;
+
+    std::vector<Value> &stack = value_stack();
+    size_t base = stack.size();
+    bool success = run(code, nullptr, stack);
+    if (success)
+        v = stack[base];
+    stack.resize(base);
+    return success;
+}
+
+//
+// Compile the arithmetic goals of the body.
+//
+void Clause::compile_arithmetic()
+{
+    for (Goal *g = body; g; g = g->get_tail())
+        g->set_arithmetic(Arithmetic::compile(g->get_head()));
+}
@@ -0,0 +1,360 @@
+//
+// Benchmarks: classic Prolog programs, solved without tracing.
+// For every benchmark the logical inferences (calls of goals) per second
+// are reported, with the peak size of the heap and of the trail,
+// and the number of allocations by the C++ runtime per iteration.
+// The programs use no arithmetic: numbers are written as s(...(0)),
+// and sums of digits are taken from a table.
+//
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <sys/resource.h>
+
+#include "prolog.h"
+#include "reader.h"
+
+//
+// Allocations of the C++ runtime, counted by the replaced operator new.
+// The compiler sees free() of memory from new, and takes it for a mismatch.
+//
+static std::atomic<size_t> allocations{ 0 };
+
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+
+void *operator new(size_t size)
+{
+    allocations++;
+    if (void *p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+    std::free(p);
+}
+
+//
+// Tracer which counts the calls of goals: logical inferences.
+//
+class InferenceCounter {
+public:
+    size_t calls{ 0 };
+
+    // A goal is called.
+    void call(Compound *, int) { calls++; }
+
+    // Clauses tried, and failed matches, are not counted.
+    void attempt(Clause *, int) {}
+    void nomatch(Clause *, int) {}
+
+    // Nothing is buffered.
+    void flush() {}
+};
+
+//
+// Benchmark: the program, the goal which is solved for all solutions,
+// and how many times the goal is solved in one iteration.
+//
+struct Benchmark {
+    std::string name;
+    std::string program;
+    std::string goal;
+    int repeat;
+};
+
+//
+// Results of one benchmark, per iteration.
+//
+struct Result {
+    size_t inferences{ 0 };
+    size_t solutions{ 0 };
+    double best{ 0 };
+    double mean{ 0 };
+    size_t heap{ 0 };
+    size_t trail{ 0 };
+    size_t allocs{ 0 };
+};
+
+//
+// Return the number n written as s(...(0)).
+//
+static std::string peano(int n)
+{
+    return n ? "s(" + peano(n - 1) + ")" : "0";
+}
+
+//
+// Return the list of items produced by the function for 0 to n-1.
+//
+template <class Item>
+static std::string list(int n, Item item)
+{
+    std::string text = "[";
+    for (int i = 0; i < n; i++)
+        text += (i ? ", " : "") + item(i);
+    return text + "]";
+}
+
+//
+// Naive reverse of a list of 30 elements: 496 inferences.
+//
+static Benchmark nrev30()
+{
+    return { "nrev30",
+             "app([], L, L).\n"
+             "app([H|T], L, [H|R]) :- app(T, L, R).\n"
+             "nrev([], []).\n"
+             "nrev([H|T], R) :- nrev(T, RT), app(RT, [H], R).\n",
+             "nrev(" + list(30, [](int i) { return std::to_string(i + 1); }) + ", _).", 300 };
+}
+
+//
+// All 92 placements of eight queens.
+//
+static Benchmark queens()
+{
+    return { "queens8",
+             "queens([], Qs, Qs).\n"
+             "queens(Unplaced, Safe, Qs) :- sel(Q, Unplaced, R), safe(Q, Safe, s(0)), queens(R, [Q|Safe], Qs).\n"
+             "sel(X, [X|T], T).\n"
+             "sel(X, [H|T], [H|R]) :- sel(X, T, R).\n"
+             "safe(_, [], _).\n"
+             "safe(Q, [Q1|Qs], D) :- plus(Q1, D, S1), neq(Q, S1), plus(Q, D, S2), neq(Q1, S2), safe(Q, Qs, s(D)).\n"
+             "plus(0, Y, Y).\n"
+             "plus(s(X), Y, s(Z)) :- plus(X, Y, Z).\n"
+             "neq(0, s(_)).\n"
+             "neq(s(_), 0).\n"
+             "neq(s(X), s(Y)) :- neq(X, Y).\n",
+             "queens(" + list(8, [](int i) { return peano(i + 1); }) + ", [], Qs).", 1 };
+}
+
+//
+// Who owns the zebra, and who drinks water.
+//
+static Benchmark zebra()
+{
+    return { "zebra",
+             "right_of(R, L, [L, R | _]).\n"
+             "right_of(R, L, [_ | T]) :- right_of(R, L, T).\n"
+             "next_to(X, Y, L) :- right_of(X, Y, L).\n"
+             "next_to(X, Y, L) :- right_of(Y, X, L).\n"
+             "member(X, [X|_]).\n"
+             "member(X, [_|T]) :- member(X, T).\n"
+             "houses([house(_, norwegian, _, _, _), _, house(_, _, _, milk, _), _, _]).\n"
+             "zebra(Zebra, Water) :- houses(H),\n"
+             "    member(house(red, english, _, _, _), H),\n"
+             "    member(house(green, _, _, coffee, _), H),\n"
+             "    member(house(_, spanish, dog, _, _), H),\n"
+             "    member(house(_, ukrainian, _, tea, _), H),\n"
+             "    right_of(house(green, _, _, _, _), house(ivory, _, _, _, _), H),\n"
+             "    member(house(_, _, snails, _, winstons), H),\n"
+             "    member(house(yellow, _, _, _, kools), H),\n"
+             "    next_to(house(_, _, _, _, chesterfields), house(_, _, fox, _, _), H),\n"
+             "    next_to(house(_, _, _, _, kools), house(_, _, horse, _, _), H),\n"
+             "    member(house(_, _, _, orange_juice, lucky_strikes), H),\n"
+             "    member(house(_, japanese, _, _, parliaments), H),\n"
+             "    next_to(house(_, norwegian, _, _, _), house(blue, _, _, _, _), H),\n"
+             "    member(house(_, Zebra, zebra, _, _), H),\n"
+             "    member(house(_, Water, _, water, _), H).\n",
+             "zebra(Zebra, Water).", 5 };
+}
+
+//
+// Cryptarithmetic: SEND + MORE = MONEY, column by column, with a table of digit sums.
+//
+static Benchmark crypt()
+{
+    std::string table;
+    for (int a = 0; a < 10; a++)
+        for (int b = 0; b < 10; b++)
+            for (int c = 0; c < 2; c++)
+                table += "add(" + std::to_string(a) + ", " + std::to_string(b) + ", " + std::to_string(c) + ", " +
+                         std::to_string((a + b + c) % 10) + ", " + std::to_string((a + b + c) / 10) + ").\n";
+    return { "crypt",
+             table + "sel(X, [X|T], T).\n"
+                     "sel(X, [H|T], [H|R]) :- sel(X, T, R).\n"
+                     "nonzero(1). nonzero(2). nonzero(3). nonzero(4). nonzero(5).\n"
+                     "nonzero(6). nonzero(7). nonzero(8). nonzero(9).\n"
+                     "send([S, E, N, D, M, O, R, Y]) :-\n"
+                     "    sel(D, [0, 1, 2, 3, 4, 5, 6, 7, 8, 9], L1), sel(E, L1, L2), add(D, E, 0, Y, C1),\n"
+                     "    sel(Y, L2, L3), sel(N, L3, L4), sel(R, L4, L5), add(N, R, C1, E, C2),\n"
+                     "    sel(O, L5, L6), add(E, O, C2, N, C3),\n"
+                     "    sel(S, L6, L7), nonzero(S), sel(M, L7, _), nonzero(M), add(S, M, C3, O, M).\n",
+             "send(Digits).", 20 };
+}
+
+//
+// Symbolic differentiation, after D.H.D. Warren: ops8, divide10, log10 and times10.
+//
+static Benchmark deriv()
+{
+    return { "deriv",
+             "d(U + V, X, DU + DV) :- !, d(U, X, DU), d(V, X, DV).\n"
+             "d(U - V, X, DU - DV) :- !, d(U, X, DU), d(V, X, DV).\n"
+             "d(U * V, X, DU * V + U * DV) :- !, d(U, X, DU), d(V, X, DV).\n"
+             "d(U / V, X, (DU * V - U * DV) / V ^ 2) :- !, d(U, X, DU), d(V, X, DV).\n"
+             "d(- U, X, - DU) :- !, d(U, X, DU).\n"
+             "d(exp(U), X, exp(U) * DU) :- !, d(U, X, DU).\n"
+             "d(log(U), X, DU / U) :- !, d(U, X, DU).\n"
+             "d(x, x, 1) :- !.\n"
+             "d(_, _, 0).\n",
+             "d((x + 1) * ((x ^ 2 + 2) * (x ^ 3 + 3)), x, _),"
+             " d(((((((((x / x) / x) / x) / x) / x) / x) / x) / x) / x, x, _),"
+             " d(log(log(log(log(log(log(log(log(log(log(x)))))))))), x, _),"
+             " d(((((((((x * x) * x) * x) * x) * x) * x) * x) * x) * x, x, _).",
+             500 };
+}
+
+//
+// Takeuchi function tak(18, 12, 6) = 7.
+//
+static Benchmark tak()
+{
+    return { "tak",
+             "tak(X, Y, Z, Z) :- le(X, Y), !.\n"
+             "tak(s(X1), s(Y1), s(Z1), A) :- tak(X1, s(Y1), s(Z1), A1), tak(Y1, s(Z1), s(X1), A2),\n"
+             "    tak(Z1, s(X1), s(Y1), A3), tak(A1, A2, A3, A).\n"
+             "le(0, _).\n"
+             "le(s(X), s(Y)) :- le(X, Y).\n",
+             "tak(" + peano(18) + ", " + peano(12) + ", " + peano(6) + ", A).", 1 };
+}
+
+//
+// Integer arithmetic: a counting loop with an accumulator, and fib(20) by recursion.
+//
+static Benchmark arith()
+{
+    return { "arith",
+             "sum(N, N, S, S) :- !.\n"
+             "sum(I, N, S0, S) :- I1 is I + 1, S1 is S0 + I, sum(I1, N, S1, S).\n"
+             "fib(0, 0).\n"
+             "fib(1, 1).\n"
+             "fib(N, F) :- N > 1, N1 is N - 1, N2 is N - 2, fib(N1, F1), fib(N2, F2), F is F1 + F2.\n",
+             "sum(0, 100000, 0, S), fib(20, F).", 1 };
+}
+
+//
+// Lookups in a table of 100000 facts, by the first argument and by the second one.
+//
+static Benchmark facts()
+{
+    const int n = 100000;
+    std::string table;
+    for (int i = 0; i < n; i++)
+        table += "fact(k" + std::to_string(i) + ", v" + std::to_string(i * 7919L % n) + ").\n";
+    return { "facts",
+             table + "lookups([]).\n"
+                     "lookups([K|Ks]) :- fact(K, _), lookups(Ks).\n"
+                     "rlookups([]).\n"
+                     "rlookups([V|Vs]) :- fact(_, V), rlookups(Vs).\n",
+             "lookups(" + list(1000, [](int i) { return "k" + std::to_string(i * 37L % n); }) + "), rlookups(" +
+                 list(1000, [](int i) { return "v" + std::to_string(i * 53L % n); }) + ").",
+             10 };
+}
+
+//
+// Solve the goal for all solutions; return the number of solutions.
+//
+template <class Tracer>
+static size_t solve_all(Program *prog, Goal *goal, Tracer &tracer)
+{
+    size_t count = 0;
+    Solver<Tracer> solver(prog, goal, tracer);
+    while (solver.next())
+        count++;
+    return count;
+}
+
+//
+// Run the benchmark in an engine of its own: count the inferences,
+// warm up, and time the iterations. Return false when the program cannot be read.
+//
+static bool run(const Benchmark &b, int warmup, int iterations, Result &r)
+{
+    Engine engine;
+    Engine::Scope scope(engine);
+    Reader reader(b.program);
+    Program *prog = reader.read_program();
+    Reader query(b.goal);
+    Goal *goal = query.read_query();
+    if (!prog || !goal) {
+        std::cerr << b.name << ": " << (reader.failed() ? reader.error() : query.error()) << "\n";
+        return false;
+    }
+
+    InferenceCounter counter;
+    r.solutions = solve_all(prog, goal, counter);
+    r.inferences = counter.calls * b.repeat;
+
+    NullTracer none;
+    for (int i = 0; i < warmup; i++)
+        for (int k = 0; k < b.repeat; k++)
+            solve_all(prog, goal, none);
+
+    size_t before = allocations;
+    double total = 0;
+    for (int i = 0; i < iterations; i++) {
+        auto start = std::chrono::steady_clock::now();
+        for (int k = 0; k < b.repeat; k++)
+            solve_all(prog, goal, none);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        total += seconds;
+        r.best = (i == 0) ? seconds : std::min(r.best, seconds);
+    }
+    r.mean = total / iterations;
+    r.allocs = (allocations - before) / iterations;
+    r.heap = engine.heap.reserved();
+    r.trail = engine.history.capacity() * sizeof(Variable *);
+    return true;
+}
+
+//
+// Run the benchmarks given by name, or all of them:
+//      prolog_bench [-w warmup] [-n iterations] [name...]
+//
+int main(int argc, char **argv)
+{
+    int warmup = 3;
+    int iterations = 10;
+    std::vector<std::string> names;
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "-w") == 0 && i + 1 < argc)
+            warmup = std::atoi(argv[++i]);
+        else if (std::strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+            iterations = std::max(std::atoi(argv[++i]), 1);
+        else
+            names.push_back(argv[i]);
+    }
+
+    std::vector<Benchmark (*)()> all = { nrev30, queens, zebra, crypt, deriv, tak, arith, facts };
+    std::printf("%-10s %12s %9s %10s %10s %8s %10s %10s %8s\n", "benchmark", "inferences", "solutions", "best ms",
+                "mean ms", "MLIPS", "heap KB", "trail KB", "allocs");
+    int status = 0;
+    for (auto make : all) {
+        Benchmark b = make();
+        if (!names.empty() && std::find(names.begin(), names.end(), b.name) == names.end())
+            continue;
+
+        Result r;
+        if (!run(b, warmup, iterations, r)) {
+            status = 1;
+            continue;
+        }
+        std::printf("%-10s %12zu %9zu %10.3f %10.3f %8.2f %10zu %10zu %8zu\n", b.name.c_str(), r.inferences,
+                    r.solutions, r.best * 1e3, r.mean * 1e3, r.inferences / r.mean / 1e6, r.heap / 1024,
+                    r.trail / 1024, r.allocs);
+    }
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    std::printf("peak resident memory: %ld KB\n", usage.ru_maxrss);
+    return status;
+}
@@ -0,0 +1,555 @@
+//
+// Builtin predicates implemented in C++: type tests, unification and comparison
+// of terms, inspection of terms, arithmetic, collecting solutions, and changes
+// of the dynamic database.
+//
+#include <algorithm>
+#include <memory>
+
+#include "prolog.h"
+
+//
+// Return an integer term.
+//
+static Term *integer(int64_t n)
+{
+    return Number::create(Value::from_integer(n));
+}
+
+//
+// Return the integer value of the term, or false when it is not an integer.
+//
+static bool integer_value(Term *t, int64_t &n)
+{
+    Number *num = t->as_number();
+    if (!num || num->get_value().is_float())
+        return false;
+    n = num->get_value().integer;
+    return true;
+}
+
+//
+// Return the atom [].
+//
+static Atom *nil()
+{
+    static Atom *const atom = Atom::intern("[]");
+    return atom;
+}
+
+//
+// Return the functor of list cells.
+//
+static Atom *dot()
+{
+    static Atom *const atom = Atom::intern(".");
+    return atom;
+}
+
+//
+// Return true for an atom: a compound without arguments.
+//
+static bool is_atom(Term *t)
+{
+    Compound *c = t->as_compound();
+    return c && c->get_arity() == 0;
+}
+
+//
+// Return the elements of a proper list; return false when the term is not one.
+//
+static bool list_items(Term *list, std::vector<Term *> &items)
+{
+    for (;;) {
+        Compound *c = list->deref()->as_compound();
+        if (!c)
+            return false;
+        if (c->get_arity() == 0)
+            return c->get_functor() == nil();
+        if (c->get_functor() != dot() || c->get_arity() != 2)
+            return false;
+        items.push_back(c->arg(0)->deref());
+        list = c->arg(1);
+    }
+}
+
+//
+// Return a list of the terms.
+//
+static Term *make_list(const std::vector<Term *> &items)
+{
+    Term *list = Compound::create(nil());
+    for (size_t i = items.size(); i > 0; i--)
+        list = Compound::create(dot(), { items[i - 1], list });
+    return list;
+}
+
+//
+// Return true when the term has no unbound variables.
+//
+static bool ground(Term *t)
+{
+    std::vector<Term *> work{ t };
+    while (!work.empty()) {
+        Term *t = work.back()->deref();
+        work.pop_back();
+        if (t->as_variable())
+            return false;
+        if (Compound *c = t->as_compound())
+            for (int i = 0; i < c->get_arity(); i++)
+                work.push_back(c->arg(i));
+    }
+    return true;
+}
+
+//
+// Return the class of the term in the standard order: variables,
+// numbers, atoms, and compounds.
+//
+static int order_class(Term *t)
+{
+    if (t->as_variable())
+        return 0;
+    Compound *c = t->as_compound();
+    if (!c)
+        return 1;
+    return c->get_arity() == 0 ? 2 : 3;
+}
+
+//
+// Compare two numbers by value; a float comes before an integer of the same value.
+//
+static int compare_numbers(const Value &a, const Value &b)
+{
+    if (!a.is_float() && !b.is_float())
+        return (a.integer > b.integer) - (a.integer < b.integer);
+    double x = a.as_float();
+    double y = b.as_float();
+    if (x != y)
+        return x < y ? -1 : 1;
+    return b.is_float() - a.is_float();
+}
+
+//
+// Compare two terms in the standard order: return a negative number,
+// zero or a positive number. Variables come in the order of their creation,
+// atoms alphabetically, and compounds by arity, name, and then arguments
+// from left to right.
+//
+static int compare_terms(Term *a, Term *b)
+{
+    static thread_local std::vector<std::pair<Term *, Term *>> work;
+    work.clear();
+    work.emplace_back(a, b);
+    while (!work.empty()) {
+        auto [x, y] = work.back();
+        work.pop_back();
+        x = x->deref();
+        y = y->deref();
+        if (x == y)
+            continue;
+
+        int cx = order_class(x);
+        int cy = order_class(y);
+        if (cx != cy)
+            return cx < cy ? -1 : 1;
+
+        int order = 0;
+        switch (cx) {
+        case 0: {
+            uint64_t ix = x->as_variable()->get_index();
+            uint64_t iy = y->as_variable()->get_index();
+            order = (ix > iy) - (ix < iy);
+            break;
+        }
+        case 1:
+            order = compare_numbers(x->as_number()->get_value(), y->as_number()->get_value());
+            break;
+        default: {
+            Compound *p = x->as_compound();
+            Compound *q = y->as_compound();
+            if (p->get_arity() != q->get_arity()) {
+                order = p->get_arity() < q->get_arity() ? -1 : 1;
+                break;
+            }
+            order = p->get_functor()->name().compare(q->get_functor()->name());
+            for (int i = p->get_arity(); i > 0; i--)
+                work.emplace_back(p->arg(i - 1), q->arg(i - 1));
+            break;
+        }
+        }
+        if (order)
+            return order;
+    }
+    return 0;
+}
+
+//
+// Return true when two terms can be unified, binding nothing.
+//
+static bool unifiable(Term *a, Term *b)
+{
+    uint64_t boundary = Trace::Boundary();
+    Trace::Mark mark = Trace::Note();
+    Trace::Protect(UINT64_MAX);
+    bool success = a->unify(b);
+    Trace::Undo(mark);
+    Trace::Protect(boundary);
+    return success;
+}
+
+//
+// Return a copy of the term, with fresh variables.
+//
+static Term *fresh_copy(Term *t)
+{
+    Trace::Mark mark = Trace::Note();
+    Term *copy = t->copy();
+    Trace::Reset(mark);
+    return copy;
+}
+
+//
+// functor(Term, Name, Arity): the name and arity of a term,
+// or a term with fresh arguments made of them.
+//
+static bool functor(ForeignCall &call)
+{
+    Term *t = call.arg(0);
+    if (Compound *c = t->as_compound()) {
+        Term *name = (c->get_arity() == 0) ? c : Compound::create(c->get_functor());
+        return call.arg(1)->unify(name) && call.arg(2)->unify(integer(c->get_arity()));
+    }
+    if (t->as_number())
+        return call.arg(1)->unify(t) && call.arg(2)->unify(integer(0));
+
+    Term *name = call.arg(1);
+    int64_t arity;
+    if (name->as_variable() || !integer_value(call.arg(2), arity) || arity < 0 || arity > INT_MAX)
+        return false;
+    if (arity == 0)
+        return t->unify(name);
+    if (!is_atom(name))
+        return false;
+
+    std::vector<Term *> args(arity);
+    for (Term *&a : args)
+        a = new Variable();
+    return t->unify(Compound::create(name->as_compound()->get_functor(), args.size(), args.data()));
+}
+
+//
+// arg(N, Term, Arg): the argument of a compound at the position N, counting from 1.
+// With N unbound, every argument is given in turn.
+//
+static bool arg(ForeignCall &call)
+{
+    Compound *c = call.arg(1)->as_compound();
+    if (!c || c->get_arity() == 0) {
+        call.last = true;
+        return false;
+    }
+
+    Term *n = call.arg(0);
+    if (!n->as_variable()) {
+        call.last = true;
+        int64_t i;
+        return integer_value(n, i) && i >= 1 && i <= c->get_arity() && call.arg(2)->unify(c->arg(i - 1));
+    }
+
+    int i = call.state++;
+    call.last = (i + 1 == c->get_arity());
+    return n->unify(integer(i + 1)) && call.arg(2)->unify(c->arg(i));
+}
+
+//
+// between(Low, High, X): the integers from Low to High, or up to
+// any size when High is inf or infinite.
+//
+static bool between(ForeignCall &call)
+{
+    static Atom *const inf = Atom::intern("inf");
+    static Atom *const infinite = Atom::intern("infinite");
+
+    call.last = true;
+    int64_t low, high = INT64_MAX;
+    Term *h = call.arg(1);
+    if (!integer_value(call.arg(0), low))
+        return false;
+    if (!integer_value(h, high)) {
+        Compound *c = h->as_compound();
+        if (!is_atom(h) || (c->get_functor() != inf && c->get_functor() != infinite))
+            return false;
+    }
+
+    Term *x = call.arg(2);
+    if (!x->as_variable()) {
+        int64_t n;
+        return integer_value(x, n) && low <= n && n <= high;
+    }
+
+    auto i = (int64_t)((uint64_t)low + call.state);
+    if (i > high)
+        return false;
+    call.last = (i == high);
+    call.state++;
+    return x->unify(integer(i));
+}
+
+//
+// Sort the list of the first argument in the standard order, removing
+// duplicates when asked, and unify the result with the second argument.
+//
+static bool sort_list(ForeignCall &call, bool unique)
+{
+    std::vector<Term *> items;
+    if (!list_items(call.arg(0), items))
+        return false;
+
+    std::stable_sort(items.begin(), items.end(), [](Term *a, Term *b) { return compare_terms(a, b) < 0; });
+    if (unique)
+        items.erase(std::unique(items.begin(), items.end(), [](Term *a, Term *b) { return compare_terms(a, b) == 0; }),
+                    items.end());
+    return call.arg(1)->unify(make_list(items));
+}
+
+//
+// Engines which keep the solutions of findall/3 while its goal is solved,
+// as the heap of the solver is released afterwards. A nested findall/3
+// takes the next engine; the engines are kept for reuse on the thread.
+//
+static thread_local std::vector<std::unique_ptr<Engine>> spares;
+static thread_local size_t spares_used;
+
+//
+// Spare engine, in use while in scope.
+//
+class Spare {
+public:
+    Engine &engine;
+
+    // Take the next free engine of the thread.
+    Spare() : engine(take()) {}
+
+    // Free the memory of the engine, and give it back.
+    ~Spare()
+    {
+        engine.heap.release({ 0, nullptr });
+        engine.history.clear();
+        spares_used--;
+    }
+    Spare(const Spare &) = delete;
+    Spare &operator=(const Spare &) = delete;
+
+private:
+    // Return the next free engine, creating it when needed.
+    static Engine &take()
+    {
+        if (spares_used == spares.size())
+            spares.push_back(std::make_unique<Engine>());
+        return *spares[spares_used++];
+    }
+};
+
+//
+// Return the goals of a conjunction (A, B) as a body, followed by the tail,
+// or nullptr when one of them is an unbound variable.
+//
+static Goal *conjunction(Compound *goal, Goal *tail = nullptr)
+{
+    static Atom *const comma = Atom::intern(",");
+    std::vector<Compound *> goals;
+    std::vector<Term *> work{ goal };
+    while (!work.empty()) {
+        Compound *c = work.back()->deref()->as_compound();
+        work.pop_back();
+        if (!c)
+            return nullptr;
+        if (c->get_functor() == comma && c->get_arity() == 2) {
+            work.push_back(c->arg(1));
+            work.push_back(c->arg(0));
+        } else {
+            goals.push_back(c);
+        }
+    }
+    Goal *body = tail;
+    for (size_t i = goals.size(); i > 0; i--)
+        body = new Goal(goals[i - 1], body);
+    return body;
+}
+
+//
+// findall(Template, Goal, List): the list of instances of the template,
+// one for every solution of the goal, in the order they are found,
+// with the tables and the fork of the caller.
+// When the deadline of the engine passes meanwhile, the list is incomplete,
+// and the call fails: the caller stops at its own check of the deadline.
+//
+static bool findall(ForeignCall &call)
+{
+    Compound *goal = call.arg(1)->as_compound();
+    Goal *body = goal ? conjunction(goal) : nullptr;
+    if (!body)
+        return false;
+
+    Spare spare;
+    std::vector<Term *> solutions;
+    {
+        Solver<> solver(call.program, body);
+        solver.set_tabling(call.tabling);
+        solver.set_fork(call.fork);
+        while (solver.next()) {
+            Engine::Scope scope(spare.engine);
+            Freezer f;
+            solutions.push_back(f.copy(call.goal->arg(0)));
+        }
+    }
+    if (const Deadline *deadline = Engine::current().deadline; deadline && deadline->expired())
+        return false;
+    for (Term *&s : solutions)
+        s = fresh_copy(s);
+    return call.arg(2)->unify(make_list(solutions));
+}
+
+//
+// call(Goal): solve the goal, as if it were written in place of the call.
+// A cut in the goal prunes only the choices made by the goal.
+//
+static bool call_goal(ForeignCall &call)
+{
+    Compound *goal = call.arg(0)->as_compound();
+    call.body = goal ? conjunction(goal) : nullptr;
+    return call.body != nullptr;
+}
+
+//
+// once(Goal): the first solution of the goal, followed by a cut
+// of the choices made by the goal.
+//
+static bool once(ForeignCall &call)
+{
+    static Atom *const cut = Atom::intern("!");
+    Compound *goal = call.arg(0)->as_compound();
+    call.body = goal ? conjunction(goal, new Goal(Compound::create(cut))) : nullptr;
+    return call.body != nullptr;
+}
+
+//
+// Add the predicate to the table, replacing one of the same arity.
+//
+void Builtins::add(std::vector<Builtin *> &t, Atom *name, int arity, Foreign f, bool deterministic, bool pure)
+{
+    unsigned id = name->get_id();
+    if (id >= t.size())
+        t.resize(id + 1, nullptr);
+    for (Builtin *b = t[id]; b; b = b->next)
+        if (b->arity == arity) {
+            b->function = std::move(f);
+            b->deterministic = deterministic;
+            b->pure = pure;
+            return;
+        }
+    t[id] = new Builtin{ arity, deterministic, pure, std::move(f), t[id] };
+}
+
+//
+// Return the table, with the standard builtins on first use.
+//
+std::vector<Builtin *> &Builtins::table()
+{
+    static std::vector<Builtin *> t = [] {
+        std::vector<Builtin *> t;
+        standard(t);
+        return t;
+    }();
+    return t;
+}
+
+//
+// Add the standard builtins to the table.
+//
+void Builtins::standard(std::vector<Builtin *> &t)
+{
+    // All but the calls of goals and the changes of the database are pure.
+    auto det = [&t](const char *name, int arity, Foreign f, bool pure = true) {
+        add(t, Atom::intern(name), arity, std::move(f), true, pure);
+    };
+
+    // Control.
+    det("true", 0, [](ForeignCall &) { return true; });
+    det("fail", 0, [](ForeignCall &) { return false; });
+    det("false", 0, [](ForeignCall &) { return false; });
+    det("call", 1, call_goal, false);
+    det("once", 1, once, false);
+
+    // Type tests.
+    det("var", 1, [](ForeignCall &call) { return call.arg(0)->as_variable() != nullptr; });
+    det("nonvar", 1, [](ForeignCall &call) { return !call.arg(0)->as_variable(); });
+    det("atom", 1, [](ForeignCall &call) { return is_atom(call.arg(0)); });
+    det("number", 1, [](ForeignCall &call) { return call.arg(0)->as_number() != nullptr; });
+    det("integer", 1, [](ForeignCall &call) {
+        Number *n = call.arg(0)->as_number();
+        return n && !n->get_value().is_float();
+    });
+    det("float", 1, [](ForeignCall &call) {
+        Number *n = call.arg(0)->as_number();
+        return n && n->get_value().is_float();
+    });
+    det("atomic", 1, [](ForeignCall &call) { return is_atom(call.arg(0)) || call.arg(0)->as_number(); });
+    det("compound", 1, [](ForeignCall &call) {
+        Compound *c = call.arg(0)->as_compound();
+        return c && c->get_arity() > 0;
+    });
+    det("callable", 1, [](ForeignCall &call) { return call.arg(0)->as_compound() != nullptr; });
+    det("is_list", 1, [](ForeignCall &call) {
+        std::vector<Term *> items;
+        return list_items(call.arg(0), items);
+    });
+    det("ground", 1, [](ForeignCall &call) { return ground(call.arg(0)); });
+
+    // Unification and comparison.
+    det("=", 2, [](ForeignCall &call) { return call.arg(0)->unify(call.arg(1)); });
+    det("\\=", 2, [](ForeignCall &call) { return !unifiable(call.arg(0), call.arg(1)); });
+    det("==", 2, [](ForeignCall &call) { return compare_terms(call.arg(0), call.arg(1)) == 0; });
+    det("\\==", 2, [](ForeignCall &call) { return compare_terms(call.arg(0), call.arg(1)) != 0; });
+    det("@<", 2, [](ForeignCall &call) { return compare_terms(call.arg(0), call.arg(1)) < 0; });
+    det("@>", 2, [](ForeignCall &call) { return compare_terms(call.arg(0), call.arg(1)) > 0; });
+    det("@=<", 2, [](ForeignCall &call) { return compare_terms(call.arg(0), call.arg(1)) <= 0; });
+    det("@>=", 2, [](ForeignCall &call) { return compare_terms(call.arg(0), call.arg(1)) >= 0; });
+    det("compare", 3, [](ForeignCall &call) {
+        int order = compare_terms(call.arg(1), call.arg(2));
+        return call.arg(0)->unify(Compound::create(Atom::intern(order < 0 ? "<" : order > 0 ? ">" : "=")));
+    });
+
+    // Terms.
+    det("functor", 3, functor);
+    add(t, Atom::intern("arg"), 3, arg, false, true);
+    det("copy_term", 2, [](ForeignCall &call) { return call.arg(1)->unify(fresh_copy(call.arg(0))); });
+
+    // Arithmetic: goals of clause bodies run compiled code instead (see Arithmetic).
+    for (const char *name : { "is", "=:=", "=\\=", "<", ">", "=<", ">=" })
+        det(name, 2, [](ForeignCall &call) { return Arithmetic::solve(call.goal); });
+    add(t, Atom::intern("between"), 3, between, false, true);
+
+    // Solutions and lists.
+    det("findall", 3, findall, false);
+    det("sort", 2, [](ForeignCall &call) { return sort_list(call, true); });
+    det("msort", 2, [](ForeignCall &call) { return sort_list(call, false); });
+
+    // Dynamic database.
+    for (const char *name : { "assert", "assertz" })
+        det(name, 1, [](ForeignCall &call) {
+            return call.program && call.program->database().add(call.arg(0), true);
+        }, false);
+    det("asserta", 1, [](ForeignCall &call) {
+        return call.program && call.program->database().add(call.arg(0), false);
+    }, false);
+    add(t, Atom::intern("retract"), 1, [](ForeignCall &call) {
+        return call.program && call.program->database().retract(call.arg(0), call.state, call.last);
+    }, false, false);
+    det("retractall", 1, [](ForeignCall &call) {
+        if (call.program)
+            call.program->database().retract_all(call.arg(0));
+        return call.program != nullptr;
+    }, false);
+}
@@ -0,0 +1,229 @@
+//
+// Tagged-word term representation: heap operations.
+//
+#include "cell.h"
+
+#include <sstream>
+
+//
+// Create the cell of an atom or a number.
+//
+Cell Cell::constant(Term *t)
+{
+    Number *n = t->as_number();
+    if (!n)
+        return con(t->as_compound()->get_functor());
+
+    const Value &v = n->get_value();
+    static constexpr int64_t bound = INT64_C(1) << (63 - tag_bits);
+    if (!v.is_float() && v.integer >= -bound && v.integer < bound)
+        return integer(v.integer);
+    std::ostringstream name;
+    n->print_value(name);
+    return con(Atom::intern(name.str()));
+}
+
+//
+// Unify two terms, using the push-down list instead of recursion.
+//
+bool Store::unify(Cell a, Cell b)
+{
+    pdl.clear();
+    pdl.push_back(a);
+    pdl.push_back(b);
+    while (!pdl.empty()) {
+        Cell d2 = deref(pdl.back());
+        pdl.pop_back();
+        Cell d1 = deref(pdl.back());
+        pdl.pop_back();
+        if (d1 == d2)
+            continue;
+
+        switch (d1.tag()) {
+        case Cell::REF:
+            // Bind the younger variable to the older one.
+            if (d2.tag() == Cell::REF && d2.addr() < d1.addr())
+                bind(d1.addr(), d2);
+            else if (d2.tag() == Cell::REF)
+                bind(d2.addr(), d1);
+            else
+                bind(d1.addr(), d2);
+            continue;
+        case Cell::STR:
+            if (d2.tag() == Cell::REF) {
+                bind(d2.addr(), d1);
+                continue;
+            }
+            if (d2.tag() != Cell::STR || heap[d1.addr()] != heap[d2.addr()])
+                return false;
+            for (unsigned i = heap[d1.addr()].arity(); i > 0; i--) {
+                pdl.push_back(heap[d1.addr() + i]);
+                pdl.push_back(heap[d2.addr() + i]);
+            }
+            continue;
+        default:
+            // Constants are equal only when their words are equal.
+            if (d2.tag() != Cell::REF)
+                return false;
+            bind(d2.addr(), d1);
+            continue;
+        }
+    }
+    return true;
+}
+
+//
+// Undo the bindings trailed after the given position.
+//
+void Store::unwind_trail(size_t whereto)
+{
+    while (trail.size() > whereto) {
+        size_t addr = trail.back();
+        heap[addr] = Cell::ref(addr);
+        trail.pop_back();
+    }
+}
+
+//
+// Copy a term to the top of the heap, with fresh variables.
+// Every argument slot is filled from a work list of (slot, source) pairs.
+//
+Cell Store::copy(Cell c)
+{
+    static constexpr size_t root = SIZE_MAX;
+    std::unordered_map<size_t, Cell> renamed;
+    std::vector<std::pair<size_t, Cell>> work{ { root, c } };
+    Cell result;
+
+    while (!work.empty()) {
+        auto [slot, source] = work.back();
+        work.pop_back();
+
+        Cell d = deref(source);
+        Cell value = d;
+        switch (d.tag()) {
+        case Cell::REF: {
+            auto found = renamed.find(d.addr());
+            if (found != renamed.end()) {
+                value = found->second;
+            } else {
+                // An unbound argument becomes a variable in its own slot.
+                value = (slot == root) ? new_variable() : Cell::ref(slot);
+                renamed.emplace(d.addr(), value);
+            }
+            break;
+        }
+        case Cell::STR: {
+            size_t from = d.addr();
+            unsigned n = heap[from].arity();
+            size_t to = heap.size();
+            heap.push_back(heap[from]);
+            heap.resize(to + 1 + n);
+            for (unsigned i = n; i > 0; i--)
+                work.emplace_back(to + i, heap[from + i]);
+            value = Cell::str(to);
+            break;
+        }
+        default:
+            break;
+        }
+        if (slot == root)
+            result = value;
+        else
+            heap[slot] = value;
+    }
+    return result;
+}
+
+//
+// Store a term given as objects.
+// Variables are identified by their object, and get one heap cell each.
+//
+Cell Store::load(Term *t)
+{
+    static constexpr size_t root = SIZE_MAX;
+    std::unordered_map<Term *, Cell> vars;
+    std::vector<std::pair<size_t, Term *>> work{ { root, t } };
+    Cell result;
+
+    while (!work.empty()) {
+        auto [slot, source] = work.back();
+        work.pop_back();
+
+        Term *d = source->deref();
+        Compound *c = d->as_compound();
+        Cell value;
+        if (d->as_variable()) {
+            auto found = vars.find(d);
+            if (found != vars.end()) {
+                value = found->second;
+            } else {
+                value = (slot == root) ? new_variable() : Cell::ref(slot);
+                vars.emplace(d, value);
+            }
+        } else if (!c || c->get_arity() == 0) {
+            value = Cell::constant(d);
+        } else {
+            size_t to = heap.size();
+            heap.push_back(Cell::fun(c->get_functor(), c->get_arity()));
+            heap.resize(to + 1 + c->get_arity());
+            for (int i = c->get_arity(); i > 0; i--)
+                work.emplace_back(to + i, c->arg(i - 1));
+            value = Cell::str(to);
+        }
+        if (slot == root)
+            result = value;
+        else
+            heap[slot] = value;
+    }
+    return result;
+}
+
+//
+// Print a term.
+// The explicit stack holds the terms still to print, and the punctuation between them.
+//
+void Store::print(Cell c, std::ostream &out) const
+{
+    struct Item {
+        Cell cell;
+        char text; // Punctuation to print instead of the cell
+    };
+    std::vector<Item> work{ { c, 0 } };
+
+    while (!work.empty()) {
+        Item item = work.back();
+        work.pop_back();
+        if (item.text) {
+            out << item.text;
+            continue;
+        }
+
+        Cell d = deref(item.cell);
+        switch (d.tag()) {
+        case Cell::REF:
+            out << "_G" << d.addr();
+            break;
+        case Cell::CON:
+            d.atom()->print(out);
+            break;
+        case Cell::INT:
+            out << d.integer();
+            break;
+        case Cell::STR: {
+            Cell f = heap[d.addr()];
+            f.atom()->print(out);
+            out << "(";
+            work.push_back({ Cell(), ')' });
+            for (unsigned i = f.arity(); i > 0; i--) {
+                work.push_back({ heap[d.addr() + i], 0 });
+                if (i > 1)
+                    work.push_back({ Cell(), ',' });
+            }
+            break;
+        }
+        case Cell::FUN:
+            break;
+        }
+    }
+}
@@ -0,0 +1,131 @@
+//
+// Tagged-word term representation.
+// Every cell of a term is a single machine word, with a tag in the low
+// three bits, and all cells live in one contiguous heap.
+// Functor cells hold the atom ID and the arity inline, so comparing
+// two functors is a single word compare.
+//
+#ifndef CELL_H
+#define CELL_H
+
+#include "prolog.h"
+
+//
+// Cell is a tagged machine word.
+//
+class Cell {
+    uint64_t word;
+
+    explicit constexpr Cell(uint64_t w) : word(w) {}
+
+public:
+    enum Tag : unsigned {
+        REF, // Reference to a heap cell; an unbound variable refers to itself
+        STR, // Reference to the functor cell of a structure
+        FUN, // Functor of a structure: atom ID and arity, followed by the arguments
+        CON, // Constant: atom ID
+        INT, // Small integer
+    };
+    static constexpr unsigned tag_bits = 3;
+    static constexpr unsigned arity_bits = 24;
+
+    constexpr Cell() : word(0) {}
+
+    // Create cells of every kind.
+    static Cell ref(size_t addr) { return Cell(addr << tag_bits | REF); }
+    static Cell str(size_t addr) { return Cell(addr << tag_bits | STR); }
+    static Cell fun(const Atom *a, unsigned arity)
+    {
+        return Cell((uint64_t)a->get_id() << 32 | (uint64_t)arity << tag_bits | FUN);
+    }
+    static Cell con(const Atom *a) { return Cell((uint64_t)a->get_id() << 32 | CON); }
+    static Cell integer(int64_t n) { return Cell((uint64_t)n << tag_bits | INT); }
+
+    // Create the cell of an atom or a number: a small integer is a tagged word,
+    // and another number is a constant named by its value.
+    static Cell constant(Term *t);
+
+    // Store a plain number, such as a saved register in a stack frame.
+    static Cell raw(uint64_t n) { return Cell(n); }
+
+    Tag tag() const { return Tag(word & ((1 << tag_bits) - 1)); }
+
+    // Heap address of REF and STR.
+    size_t addr() const { return word >> tag_bits; }
+
+    // Atom of FUN and CON.
+    Atom *atom() const { return Atom::by_id(word >> 32); }
+
+    // Arity of FUN.
+    unsigned arity() const { return (word >> tag_bits) & ((1 << arity_bits) - 1); }
+
+    // Value of INT.
+    int64_t integer() const { return (int64_t)word >> tag_bits; }
+
+    // Value of a plain number.
+    uint64_t raw() const { return word; }
+
+    bool operator==(const Cell &c) const { return word == c.word; }
+    bool operator!=(const Cell &c) const { return word != c.word; }
+};
+
+//
+// Heap of cells, with a trail of bindings to undo on backtracking.
+// Unification, copying and printing run as loops over an explicit stack.
+//
+class Store {
+protected:
+    std::vector<Cell> heap;
+    std::vector<size_t> trail;
+    std::vector<Cell> pdl;
+    size_t HB{ 0 }; // Variables below this address get trailed
+
+public:
+    // Create a new unbound variable on the heap.
+    Cell new_variable()
+    {
+        size_t addr = heap.size();
+        heap.push_back(Cell::ref(addr));
+        return heap.back();
+    }
+
+    // Follow references until an unbound variable or a non-reference cell.
+    Cell deref(Cell c) const
+    {
+        while (c.tag() == Cell::REF) {
+            Cell target = heap[c.addr()];
+            if (target == c)
+                break;
+            c = target;
+        }
+        return c;
+    }
+
+    // Bind a variable at the given address, and trail it when needed.
+    void bind(size_t addr, Cell c)
+    {
+        heap[addr] = c;
+        if (addr < HB)
+            trail.push_back(addr);
+    }
+
+    // Unify two terms.
+    bool unify(Cell a, Cell b);
+
+    // Undo the bindings trailed after the given position.
+    void unwind_trail(size_t whereto);
+
+    // Copy a term to the top of the heap, with fresh variables.
+    Cell copy(Cell c);
+
+    // Store a term given as objects.
+    Cell load(Term *t);
+
+    // Print a term.
+    void print(Cell c, std::ostream &out = std::cout) const;
+
+    // Return the number of cells in use.
+    size_t size() const { return heap.size(); }
+};
+
+#endif // CELL_H
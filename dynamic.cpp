@@ -0,0 +1,727 @@
+//
+// Dynamic database: clauses asserted and retracted while queries run,
+// and the epochs which tell when the clauses and lists replaced can be freed.
+//
+#include "prolog.h"
+
+std::atomic<uint64_t> Epochs::clock{ 1 };
+
+//
+// Engines, and the objects retired and not deleted yet.
+// The registry is never destroyed: engines of other threads can outlive static objects.
+//
+struct Registry {
+    std::mutex lock;
+    std::unordered_set<Engine *> engines;
+    std::vector<Retired *> retired;
+    size_t scan_at{ 64 }; // Number of retired objects which triggers the next scan of the engines
+};
+
+static Registry &registry()
+{
+    static Registry *const r = new Registry;
+    return *r;
+}
+
+//
+// Add the engine to the engines with readers.
+//
+void Epochs::attach(Engine *e)
+{
+    Registry &r = registry();
+    std::lock_guard<std::mutex> guard(r.lock);
+    r.engines.insert(e);
+}
+
+//
+// Remove the engine from the engines with readers.
+//
+void Epochs::detach(Engine *e)
+{
+    Registry &r = registry();
+    std::lock_guard<std::mutex> guard(r.lock);
+    r.engines.erase(e);
+}
+
+//
+// Stamp the object with a new epoch, and delete the retired objects
+// once enough of them are waiting. The fence orders the stores which
+// made the object unreachable before the epochs of the readers are read:
+// a reader which shows no epoch yet will not find the object.
+//
+void Epochs::retire(Retired *obj)
+{
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    Registry &r = registry();
+    std::lock_guard<std::mutex> guard(r.lock);
+    obj->stamp = clock.fetch_add(1) + 1;
+    r.retired.push_back(obj);
+    if (r.retired.size() >= r.scan_at) {
+        reclaim();
+        r.scan_at = std::max<size_t>(64, 2 * r.retired.size());
+    }
+}
+
+//
+// Delete the retired objects which no reader can see: those retired
+// no later than the start of the oldest reader. The lock is held.
+//
+void Epochs::reclaim()
+{
+    Registry &r = registry();
+    uint64_t oldest = UINT64_MAX;
+    for (Engine *e : r.engines) {
+        uint64_t since = e->reading.load();
+        if (since && since < oldest)
+            oldest = since;
+    }
+    auto done = std::partition(r.retired.begin(), r.retired.end(), [&](Retired *obj) { return obj->stamp > oldest; });
+    for (auto i = done; i != r.retired.end(); ++i)
+        delete *i;
+    r.retired.erase(done, r.retired.end());
+}
+
+//
+// Return the number of retired objects not deleted yet.
+//
+size_t Epochs::pending()
+{
+    Registry &r = registry();
+    std::lock_guard<std::mutex> guard(r.lock);
+    return r.retired.size();
+}
+
+//
+// Map of keys to objects, read without locks: a table with linear probing,
+// which only grows. The key of a slot is set before its value is published
+// with a release store; a table which is full is replaced by a larger copy.
+// Values are owned by whoever put them in the table.
+//
+template <class T>
+class KeyTable : public Retired {
+    struct Slot {
+        uint64_t key{ 0 };
+        std::atomic<T *> value{ nullptr };
+    };
+
+    size_t mask;
+    size_t used{ 0 };
+    std::unique_ptr<Slot[]> slots;
+
+    // Return the position where the search for the key starts.
+    size_t home(uint64_t key) const
+    {
+        uint64_t h = key * 0x9e3779b97f4a7c15;
+        return (h ^ h >> 32) & mask;
+    }
+
+public:
+    // Make a table with room for the given number of slots, a power of two.
+    explicit KeyTable(size_t capacity = 16) : mask(capacity - 1), slots(new Slot[capacity]) {}
+
+    // Return the value of the key, or nullptr when there is none.
+    T *find(uint64_t key) const
+    {
+        for (size_t i = home(key);; i = (i + 1) & mask) {
+            T *v = slots[i].value.load(std::memory_order_acquire);
+            if (!v || slots[i].key == key)
+                return v;
+        }
+    }
+
+    // Return the slot of the value of a key which is in the table; for writers.
+    std::atomic<T *> &at(uint64_t key)
+    {
+        for (size_t i = home(key);; i = (i + 1) & mask)
+            if (slots[i].key == key && slots[i].value.load(std::memory_order_relaxed))
+                return slots[i].value;
+    }
+
+    // Add the value of a key which is not in the table yet; for writers.
+    void insert(uint64_t key, T *value)
+    {
+        size_t i = home(key);
+        while (slots[i].value.load(std::memory_order_relaxed))
+            i = (i + 1) & mask;
+        slots[i].key = key;
+        slots[i].value.store(value, std::memory_order_release);
+        used++;
+    }
+
+    // Call the function with every key and value.
+    template <class F>
+    void each(F f) const
+    {
+        for (size_t i = 0; i <= mask; i++)
+            if (T *v = slots[i].value.load(std::memory_order_relaxed))
+                f(slots[i].key, v);
+    }
+
+    // Add the value of a key which is not in the published table: in place,
+    // or in a copy with twice the room, which replaces the table. For writers.
+    template <class Table>
+    static void add(std::atomic<Table *> &table, uint64_t key, T *value)
+    {
+        Table *t = table.load(std::memory_order_relaxed);
+        if (t && 2 * (t->used + 1) <= t->mask + 1) {
+            t->insert(key, value);
+            return;
+        }
+        auto *copy = new Table(t ? 2 * (t->mask + 1) : 16);
+        if (t)
+            t->each([copy](uint64_t k, T *v) { copy->insert(k, v); });
+        copy->insert(key, value);
+        table.store(copy, std::memory_order_release);
+        if (t)
+            Epochs::retire(t);
+    }
+};
+
+//
+// Clauses in the order of a predicate, in an array which has room at both ends.
+// The position of the first clause and their number are published together
+// in one word, after the clause added, so that a reader sees a consistent range.
+//
+struct Database::ClauseList : public Retired {
+    size_t capacity;
+    std::atomic<uint64_t> extent; // Position of the first clause in the high half, number of clauses in the low one
+    std::unique_ptr<Clause *[]> items;
+
+    // Make a list of the clauses, with room for more before and after them.
+    ClauseList(Clause *const *clauses, size_t n, size_t before, size_t after)
+        : capacity(before + n + after), extent((uint64_t)before << 32 | n), items(new Clause *[capacity])
+    {
+        std::copy(clauses, clauses + n, items.get() + before);
+    }
+
+    // Return the clauses as published, and the number of them.
+    Clause *const *view(size_t &n) const
+    {
+        uint64_t e = extent.load(std::memory_order_acquire);
+        n = (uint32_t)e;
+        return items.get() + (e >> 32);
+    }
+
+    // Add the clause at the start or at the end of the list, when there is room for it.
+    // For writers.
+    bool put(Clause *cl, bool at_end)
+    {
+        uint64_t e = extent.load(std::memory_order_relaxed);
+        size_t first = e >> 32, n = (uint32_t)e;
+        if (at_end ? first + n == capacity : first == 0)
+            return false;
+        if (!at_end)
+            first--;
+        items[at_end ? first + n : first] = cl;
+        extent.store((uint64_t)first << 32 | (n + 1), std::memory_order_release);
+        return true;
+    }
+
+    // Add the clause at the start or at the end of the list in the slot:
+    // in place when there is room, or else in a copy with twice the room
+    // on the side which grows, which replaces the list. For writers.
+    static void push(std::atomic<ClauseList *> &slot, Clause *cl, bool at_end)
+    {
+        ClauseList *list = slot.load(std::memory_order_relaxed);
+        if (list->put(cl, at_end))
+            return;
+        size_t n;
+        Clause *const *clauses = list->view(n);
+        auto *copy = new ClauseList(clauses, n, at_end ? n / 4 : n + 4, at_end ? n + 4 : n / 4);
+        copy->put(cl, at_end);
+        slot.store(copy, std::memory_order_release);
+        Epochs::retire(list);
+    }
+};
+
+//
+// Clauses of a dynamic predicate by the key of one argument, as Index::ArgIndex.
+// A clause with a variable in this position is in every bucket, and in the list
+// of unbound ones, which a new bucket starts with. There are no buckets until
+// a clause has a bound argument: then the index is not selective.
+//
+struct Database::ArgTable : public Retired {
+    int position;
+    std::atomic<KeyTable<ClauseList> *> buckets{ nullptr };
+    std::atomic<ClauseList *> unbound;
+
+    // Make an empty index of the argument at the given position.
+    explicit ArgTable(int p) : position(p), unbound(new ClauseList(nullptr, 0, 4, 4)) {}
+
+    // Delete the lists, which belong to the index.
+    ~ArgTable() override
+    {
+        if (KeyTable<ClauseList> *b = buckets.load(std::memory_order_relaxed)) {
+            b->each([](uint64_t, ClauseList *list) { delete list; });
+            delete b;
+        }
+        delete unbound.load(std::memory_order_relaxed);
+    }
+
+    // Add the clause at the start or at the end of its bucket, or of all buckets
+    // for a variable. A retracted clause can have its terms freed already:
+    // it goes to all buckets too. For writers.
+    void add(Clause *cl, bool at_end)
+    {
+        Term *a = nullptr;
+        if (cl->erased.load(std::memory_order_relaxed) == UINT64_MAX && !cl->head->arg(position)->as_variable())
+            a = cl->head->arg(position);
+        KeyTable<ClauseList> *b = buckets.load(std::memory_order_relaxed);
+        if (!a) {
+            ClauseList::push(unbound, cl, at_end);
+            if (b)
+                b->each([&](uint64_t key, ClauseList *) { ClauseList::push(b->at(key), cl, at_end); });
+            return;
+        }
+
+        uint64_t key = Index::arg_key(a);
+        if (b && b->find(key)) {
+            ClauseList::push(b->at(key), cl, at_end);
+            return;
+        }
+
+        // A new bucket: the unbound clauses, and this one.
+        size_t n;
+        Clause *const *clauses = unbound.load(std::memory_order_relaxed)->view(n);
+        auto *bucket = new ClauseList(clauses, n, 4, 4);
+        bucket->put(cl, at_end);
+        KeyTable<ClauseList>::add(buckets, key, bucket);
+    }
+
+    // Return the clauses for the bound argument of a call, or nullptr when the index is not selective.
+    ClauseList *select(Term *arg) const
+    {
+        KeyTable<ClauseList> *b = buckets.load(std::memory_order_acquire);
+        if (!b)
+            return nullptr;
+        ClauseList *bucket = b->find(Index::arg_key(arg));
+        return bucket ? bucket : unbound.load(std::memory_order_acquire);
+    }
+};
+
+//
+// Dynamic predicate: all its clauses, and the indexes of its arguments built so far.
+// Predicates are never deleted.
+//
+struct Database::Predicate {
+    int arity;
+    std::atomic<ClauseList *> clauses;
+    std::unique_ptr<std::atomic<ArgTable *>[]> by_arg;
+    size_t erased{ 0 }; // Clauses retracted, and still in the lists
+
+    // Make a predicate with the clauses.
+    Predicate(int n, const std::vector<Clause *> &loaded)
+        : arity(n), clauses(new ClauseList(loaded.data(), loaded.size(), 4, loaded.size() / 4 + 4)),
+          by_arg(std::make_unique<std::atomic<ArgTable *>[]>(n))
+    {
+    }
+};
+
+//
+// Dynamic predicates by their keys.
+//
+struct Database::Predicates : public KeyTable<Predicate> {
+    using KeyTable<Predicate>::KeyTable;
+};
+
+//
+// Terms of an asserted clause, in the heap they were copied into. They are
+// retired as soon as the clause is retracted, while calls made before can
+// still use them. The clause itself is allocated apart: it stays in the lists
+// of its predicate until they are compacted, and later calls only look
+// at its generations.
+//
+struct Database::Record : public Retired {
+    Heap heap{ 512 };
+    Goal *body{ nullptr };
+
+    // Free the compiled arithmetic of the body; the heap frees the rest.
+    ~Record() override
+    {
+        for (Goal *g = body; g; g = g->get_tail())
+            delete g->get_arithmetic();
+    }
+};
+
+//
+// Asserted clauses dropped from the lists of a predicate.
+//
+struct Database::Dropped : public Retired {
+    std::vector<Clause *> clauses;
+
+    ~Dropped() override
+    {
+        for (Clause *cl : clauses)
+            ::delete cl;
+    }
+};
+
+//
+// Return the predicate of the key, or nullptr when it is static.
+//
+Database::Predicate *Database::find(uint64_t key) const
+{
+    Predicates *t = predicates.load(std::memory_order_acquire);
+    return t ? t->find(key) : nullptr;
+}
+
+//
+// Return the predicate of the key, taking the static clauses when it has any.
+//
+Database::Predicate &Database::take(uint64_t key, int arity)
+{
+    if (Predicate *pred = find(key))
+        return *pred;
+
+    static const std::vector<Clause *> none;
+    const std::vector<Clause *> *loaded = index.loaded(key);
+    auto *pred = new Predicate(arity, loaded ? *loaded : none);
+    Predicates::add(predicates, key, pred);
+    index.changed();
+    return *pred;
+}
+
+//
+// Build the index of the predicate on the argument at the given position,
+// unless another thread has already done it.
+//
+Database::ArgTable *Database::build(Predicate &pred, int position)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    ArgTable *t = pred.by_arg[position].load(std::memory_order_relaxed);
+    if (!t) {
+        t = new ArgTable(position);
+        size_t n;
+        Clause *const *clauses = pred.clauses.load(std::memory_order_relaxed)->view(n);
+        for (size_t i = 0; i < n; i++)
+            t->add(clauses[i], true);
+        pred.by_arg[position].store(t, std::memory_order_release);
+    }
+    return t;
+}
+
+//
+// Find the clauses of a changed predicate which can match the goal, by the first
+// argument which is bound in the call, and not a variable in all clauses.
+// The generation is read before the lists, so that they have every clause
+// asserted up to it; when it changes meanwhile, a list without the clauses
+// retracted since might have been taken, and the lookup is repeated.
+//
+bool Database::lookup(Compound *goal, Candidates &result)
+{
+    Predicate *pred = find(goal->key());
+    if (!pred)
+        return false;
+
+    do {
+        result.generation = generation.load(std::memory_order_acquire);
+        ClauseList *list = pred->clauses.load(std::memory_order_acquire);
+        for (int i = 0; i < goal->get_arity(); i++) {
+            Term *a = goal->arg(i)->deref();
+            if (a->as_variable())
+                continue;
+            ArgTable *t = pred->by_arg[i].load(std::memory_order_acquire);
+            if (!t)
+                t = build(*pred, i);
+            if (ClauseList *selected = t->select(a)) {
+                list = selected;
+                break;
+            }
+        }
+        result.clauses = list->view(result.count);
+    } while (generation.load(std::memory_order_acquire) != result.generation);
+    return true;
+}
+
+//
+// Add the clause to the lists of the predicate, and then start a new generation,
+// where the clause is visible.
+//
+void Database::insert(Predicate &pred, Clause *cl, bool at_end)
+{
+    cl->born = generation.load(std::memory_order_relaxed) + 1;
+    ClauseList::push(pred.clauses, cl, at_end);
+    for (int i = 0; i < pred.arity; i++)
+        if (ArgTable *t = pred.by_arg[i].load(std::memory_order_relaxed))
+            t->add(cl, at_end);
+    generation.store(cl->born, std::memory_order_release);
+}
+
+//
+// Return true when the term can be a goal: an atom or a compound.
+//
+static bool callable(Term *t)
+{
+    return t->as_compound() != nullptr;
+}
+
+//
+// Split a clause term into its head, and the body as a term: true for a fact.
+// Return false when the head is not callable.
+//
+static bool split_clause(Term *clause, Compound *&head, Term *&body)
+{
+    static Atom *const neck = Atom::intern(":-");
+    static Atom *const truth = Atom::intern("true");
+    Compound *c = clause->deref()->as_compound();
+    if (c && c->get_functor() == neck && c->get_arity() == 2) {
+        head = c->arg(0)->deref()->as_compound();
+        body = c->arg(1)->deref();
+    } else {
+        head = c;
+        body = Compound::create(truth);
+    }
+    return head && callable(head);
+}
+
+//
+// Append the goals of a conjunction (A, B) to the list; return false
+// when one of them is not callable. The body true has no goals.
+//
+static bool body_goals(Term *body, std::vector<Compound *> &goals)
+{
+    static Atom *const comma = Atom::intern(",");
+    static Atom *const truth = Atom::intern("true");
+    Compound *c = body->deref()->as_compound();
+    if (c && c->get_functor() == truth && c->get_arity() == 0)
+        return true;
+
+    std::vector<Term *> work{ body };
+    while (!work.empty()) {
+        Term *t = work.back()->deref();
+        work.pop_back();
+        if (!callable(t))
+            return false;
+        c = t->as_compound();
+        if (c->get_functor() == comma && c->get_arity() == 2) {
+            work.push_back(c->arg(1));
+            work.push_back(c->arg(0));
+        } else {
+            goals.push_back(c);
+        }
+    }
+    return true;
+}
+
+//
+// Copy the clause into a heap of its own, as a template, and add it to its predicate.
+// Ground subterms stay in the clause, rather than in the pool of constants,
+// so that they are freed with it.
+//
+bool Database::add(Term *clause, bool at_end)
+{
+    Compound *head;
+    Term *body;
+    std::vector<Compound *> goals;
+    if (!split_clause(clause, head, body) || !body_goals(body, goals))
+        return false;
+
+    std::lock_guard<std::mutex> guard(lock);
+    Predicate &pred = take(head->key(), head->get_arity());
+    auto *r = new Record;
+    Clause *cl;
+    builder.heap.swap(r->heap);
+    {
+        Engine::Scope scope(builder);
+        Freezer f;
+        Compound *h = f.copy_compound(head);
+        r->body = f.copy_goals(goals);
+        cl = ::new Clause(h, r->body, f.size(), false);
+    }
+    builder.heap.swap(r->heap);
+    records.emplace(cl, r);
+
+    insert(pred, cl, at_end);
+    return true;
+}
+
+//
+// Return an instance of the body of the clause, as a term: a conjunction of the goals, or true.
+//
+static Term *body_instance(const Clause *cl, Term **frame)
+{
+    static Atom *const comma = Atom::intern(",");
+    static Atom *const truth = Atom::intern("true");
+    std::vector<Term *> goals;
+    for (Goal *g = cl->body; g; g = g->get_tail())
+        goals.push_back(g->get_head()->instantiate(frame));
+    if (goals.empty())
+        return Compound::create(truth);
+
+    Term *body = goals.back();
+    for (size_t i = goals.size() - 1; i > 0; i--)
+        body = Compound::create(comma, { goals[i - 1], body });
+    return body;
+}
+
+//
+// Unify the head, and the body unless it is nullptr, with an instance of the clause.
+// Every variable is trailed meanwhile; on failure the bindings are undone.
+//
+static bool unify_clause(Clause *cl, Compound *head, Term *body)
+{
+    uint64_t boundary = Trace::Boundary();
+    Trace::Mark mark = Trace::Note();
+    Trace::Protect(UINT64_MAX);
+    Term **frame = cl->new_frame();
+    bool success = cl->head->match(head, frame) && (!body || body_instance(cl, frame)->unify(body));
+    if (!success)
+        Trace::Undo(mark);
+    Trace::Protect(boundary);
+    return success;
+}
+
+//
+// Remove the first clause visible at the generation of the first call, and not
+// retracted yet, which unifies with the term. Another thread can retract it first:
+// then the next one is tried.
+//
+bool Database::retract(Term *clause, uint64_t &state, bool &last)
+{
+    last = true;
+    Compound *head;
+    Term *body;
+    if (!split_clause(clause, head, body))
+        return false;
+
+    Epochs::Reader reader;
+    if (!find(head->key())) {
+        std::lock_guard<std::mutex> guard(lock);
+        take(head->key(), head->get_arity());
+    }
+    if (state == 0)
+        state = current() + 1;
+    uint64_t seen = state - 1;
+
+    Candidates found;
+    lookup(head, found);
+    auto available = [seen](const Clause *cl) {
+        return cl->visible(seen) && cl->erased.load(std::memory_order_relaxed) == UINT64_MAX;
+    };
+    for (size_t i = 0; i < found.count; i++) {
+        Clause *cl = found.clauses[i];
+        Trace::Mark mark = Trace::Note();
+        if (!available(cl) || !unify_clause(cl, head, body))
+            continue;
+        if (erase({ cl }) == 0) {
+            // Retracted meanwhile by another thread.
+            Trace::Undo(mark);
+            continue;
+        }
+        last = std::none_of(found.clauses + i + 1, found.clauses + found.count, available);
+        return true;
+    }
+    return false;
+}
+
+//
+// Remove all clauses, visible now, whose head unifies with the term.
+// The predicate becomes dynamic even when it has no clauses.
+//
+size_t Database::retract_all(Term *term)
+{
+    Compound *head = term->deref()->as_compound();
+    if (!head || !callable(head))
+        return 0;
+
+    Epochs::Reader reader;
+    if (!find(head->key())) {
+        std::lock_guard<std::mutex> guard(lock);
+        take(head->key(), head->get_arity());
+    }
+
+    Candidates found;
+    lookup(head, found);
+    std::vector<Clause *> matching;
+    for (size_t i = 0; i < found.count; i++) {
+        Clause *cl = found.clauses[i];
+        if (!cl->visible(found.generation))
+            continue;
+        Trace::Mark mark = Trace::Note();
+        if (unify_clause(cl, head, nullptr))
+            matching.push_back(cl);
+        Trace::Undo(mark);
+    }
+    return erase(matching);
+}
+
+//
+// Mark the clauses retracted in a new generation, retire the terms of those
+// which were asserted, and rebuild the lists of the predicates where most
+// clauses are retracted.
+//
+size_t Database::erase(const std::vector<Clause *> &clauses)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    uint64_t next = generation.load(std::memory_order_relaxed) + 1;
+    std::vector<Predicate *> changed;
+    for (Clause *cl : clauses) {
+        if (cl->erased.load(std::memory_order_relaxed) != UINT64_MAX)
+            continue;
+        cl->erased.store(next, std::memory_order_relaxed);
+        Predicate *pred = find(cl->head->key());
+        if (pred->erased++ == 0 || std::find(changed.begin(), changed.end(), pred) == changed.end())
+            changed.push_back(pred);
+    }
+    if (changed.empty())
+        return 0;
+    generation.store(next, std::memory_order_release);
+
+    // Calls made from now on do not see the clauses.
+    for (Clause *cl : clauses) {
+        if (cl->erased.load(std::memory_order_relaxed) != next)
+            continue;
+        auto r = records.find(cl);
+        if (r != records.end() && r->second) {
+            Epochs::retire(r->second);
+            r->second = nullptr;
+        }
+    }
+
+    size_t count = 0;
+    for (Predicate *pred : changed) {
+        size_t n;
+        pred->clauses.load(std::memory_order_relaxed)->view(n);
+        if (pred->erased >= 16 && 2 * pred->erased > n)
+            compact(*pred);
+    }
+    for (Clause *cl : clauses)
+        if (cl->erased.load(std::memory_order_relaxed) == next)
+            count++;
+    return count;
+}
+
+//
+// Replace the lists of the predicate with new ones, without the retracted clauses;
+// the indexes of arguments are built again on demand. The old lists, and the
+// retracted clauses which were asserted, are retired after they are replaced.
+//
+void Database::compact(Predicate &pred)
+{
+    ClauseList *old = pred.clauses.load(std::memory_order_relaxed);
+    size_t n;
+    Clause *const *clauses = old->view(n);
+    std::vector<Clause *> live, dropped;
+    for (size_t i = 0; i < n; i++)
+        (clauses[i]->erased.load(std::memory_order_relaxed) == UINT64_MAX ? live : dropped).push_back(clauses[i]);
+
+    pred.clauses.store(new ClauseList(live.data(), live.size(), 4, live.size() / 4 + 4), std::memory_order_release);
+    std::vector<ArgTable *> tables;
+    for (int i = 0; i < pred.arity; i++)
+        if (ArgTable *t = pred.by_arg[i].exchange(nullptr))
+            tables.push_back(t);
+    pred.erased = 0;
+
+    Epochs::retire(old);
+    for (ArgTable *t : tables)
+        Epochs::retire(t);
+    auto *gone = new Dropped;
+    for (Clause *cl : dropped) {
+        auto r = records.find(cl);
+        if (r != records.end()) {
+            gone->clauses.push_back(cl);
+            records.erase(r);
+        }
+    }
+    Epochs::retire(gone);
+}
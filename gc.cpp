@@ -0,0 +1,314 @@
+//
+// Garbage collection of the heap: marking, and sliding compaction.
+//
+#include <bit>
+#include <cstring>
+
+#include "prolog.h"
+
+//
+// Prepare to collect the heap above the given position:
+// the rest of its block, and all the blocks after it, up to the top.
+//
+Collector::Collector(Heap &h, const Heap::Mark &m) : heap(h), from(m), started(std::chrono::steady_clock::now())
+{
+    if (!heap.top)
+        return;
+    for (size_t b = from.block; b <= heap.current; b++) {
+        char *base = (b == from.block && from.top) ? from.top : heap.blocks[b].base;
+        char *top = (b == heap.current) ? heap.top : heap.blocks[b].base + heap.blocks[b].size;
+        size_t words = (top - base) / sizeof(void *) / 64 + 1;
+        ranges.push_back({ base, top, b, std::vector<uint64_t>(words), std::vector<uint32_t>(words) });
+        used += top - base;
+    }
+    std::sort(ranges.begin(), ranges.end(), [](const Range &a, const Range &b) { return a.base < b.base; });
+}
+
+//
+// Return the range which holds the address, or nullptr when it is not collected.
+// Neighbouring objects usually refer to each other: the last range found is tried first.
+//
+Collector::Range *Collector::range(const void *p)
+{
+    auto *address = static_cast<const char *>(p);
+    if (last && address >= last->base && address < last->end)
+        return last;
+    auto r = std::upper_bound(ranges.begin(), ranges.end(), address,
+                              [](const char *a, const Range &range) { return a < range.base; });
+    if (r == ranges.begin() || address >= (r - 1)->end)
+        return nullptr;
+    last = &*(r - 1);
+    return last;
+}
+
+//
+// Return the place of the marked object at the address among the live objects:
+// the objects of lower blocks, and the marks below it in its range.
+//
+size_t Collector::rank(const Range &r, const char *address)
+{
+    size_t word = (address - r.base) / sizeof(void *);
+    uint64_t below = r.marks[word / 64] & ((uint64_t{ 1 } << (word % 64)) - 1);
+    return r.first + r.ranks[word / 64] + std::popcount(below);
+}
+
+//
+// Mark the object at the address of the range, once, and queue it for scanning.
+//
+void Collector::mark(Range &r, char *address, Kind kind, size_t size)
+{
+    size_t word = (address - r.base) / sizeof(void *);
+    uint64_t bit = uint64_t{ 1 } << (word % 64);
+    if (r.marks[word / 64] & bit)
+        return;
+    r.marks[word / 64] |= bit;
+
+    pending.push_back(live.size());
+    live.push_back({ address, Heap::align(size), r.block, kind, nullptr, 0 });
+}
+
+//
+// Return the address where the object at the given one of the range moves.
+// An empty array of clauses is not an object: its address stays.
+//
+void *Collector::forward(const Range &r, void *p) const
+{
+    auto *address = static_cast<char *>(p);
+    size_t word = (address - r.base) / sizeof(void *);
+    if (!(r.marks[word / 64] & (uint64_t{ 1 } << (word % 64))))
+        return p;
+    return live[rank(r, address)].target;
+}
+
+//
+// Mark the term, or update the reference to it.
+//
+void Collector::visit(Term *&t)
+{
+    Range *r = t ? range(t) : nullptr;
+    if (!r)
+        return;
+    if (forwarding) {
+        t = static_cast<Term *>(forward(*r, t));
+        return;
+    }
+    size_t size = sizeof(Variable);
+    if (!t->as_variable()) {
+        Compound *c = t->as_compound();
+        size = c ? sizeof(Compound) + c->arity * sizeof(Term *) : sizeof(Number);
+    }
+    mark(*r, reinterpret_cast<char *>(t), TERM, size);
+}
+
+//
+// Mark the compound, or update the reference to it.
+//
+void Collector::visit(Compound *&c)
+{
+    Term *t = c;
+    visit(t);
+    c = static_cast<Compound *>(t);
+}
+
+//
+// Mark the variable, or update the reference to it.
+//
+void Collector::visit(Variable *&v)
+{
+    Term *t = v;
+    visit(t);
+    v = static_cast<Variable *>(t);
+}
+
+//
+// Mark the frame, or update the reference to it.
+// The object starts at the word with the size of the frame.
+//
+void Collector::visit(Term **&frame)
+{
+    if (!frame)
+        return;
+    auto *base = reinterpret_cast<char *>(frame) - sizeof(Term *);
+    Range *r = range(base);
+    if (!r)
+        return;
+    if (forwarding)
+        frame = reinterpret_cast<Term **>(static_cast<char *>(forward(*r, base)) + sizeof(Term *));
+    else
+        mark(*r, base, FRAME, (Clause::frame_size(frame) + 1) * sizeof(Term *));
+}
+
+//
+// Mark the array of clauses, or update the reference to it.
+//
+void Collector::visit(Clause *const *&clauses, size_t count)
+{
+    if (count == 0)
+        return;
+    auto *array = const_cast<Clause **>(clauses);
+    reference(array, CLAUSES, count * sizeof(Clause *));
+    clauses = array;
+}
+
+//
+// Visit a variable on the trail. A variable older than the collected part
+// is not moved, but its binding is visited, once per pass.
+//
+void Collector::trailed(Variable *&v)
+{
+    if (inside(v)) {
+        visit(v);
+        return;
+    }
+    bool &seen = older[v];
+    if (seen == forwarding) {
+        seen = !forwarding;
+        visit(v->instance);
+    }
+}
+
+//
+// Update a position of the heap: it moves to where the first object
+// above it moves, or to the new top when there is none.
+//
+void Collector::visit(Heap::Mark &m)
+{
+    if (!forwarding || ranges.empty())
+        return;
+    if (m.block < from.block || (m.block == from.block && from.top && m.top < from.top))
+        return;
+
+    char *top = m.top ? m.top : heap.blocks[m.block].base;
+    auto first = std::lower_bound(live.begin(), live.end(), std::make_pair(m.block, top),
+                                  [](const Object &o, const std::pair<size_t, char *> &key) {
+                                      return o.block < key.first || (o.block == key.first && o.address < key.second);
+                                  });
+    if (first == live.end())
+        m = end;
+    else
+        m = { first->target_block, first->target };
+}
+
+//
+// Visit the references in the object, to mark or to update them.
+//
+void Collector::fields(const Object &o)
+{
+    switch (o.kind) {
+    case TERM: {
+        auto *t = reinterpret_cast<Term *>(o.address);
+        if (Variable *v = t->as_variable()) {
+            visit(v->instance);
+        } else if (Compound *c = t->as_compound()) {
+            for (int i = 0; i < c->arity; i++)
+                visit(c->args()[i]);
+        }
+        break;
+    }
+    case GOAL: {
+        auto *g = reinterpret_cast<Goal *>(o.address);
+        visit(g->head);
+        visit(g->tail);
+        break;
+    }
+    case CONTINUATION: {
+        auto *k = reinterpret_cast<Continuation *>(o.address);
+        visit(k->body);
+        visit(k->frame);
+        visit(k->parent);
+        break;
+    }
+    case FRAME: {
+        auto **slots = reinterpret_cast<Term **>(o.address) + 1;
+        for (size_t i = 0; i < Clause::frame_size(slots); i++)
+            visit(slots[i]);
+        break;
+    }
+    case CLAUSE: {
+        auto *cl = reinterpret_cast<Clause *>(o.address);
+        visit(cl->head);
+        visit(cl->body);
+        break;
+    }
+    case CLAUSES: {
+        auto **clauses = reinterpret_cast<Clause **>(o.address);
+        for (size_t i = 0; i < o.size / sizeof(Clause *); i++)
+            visit(clauses[i]);
+        break;
+    }
+    }
+}
+
+//
+// Mark everything reachable from the roots visited so far, assign every
+// object its place in the order of allocation, update the references
+// between objects, and move them. An object which does not fit
+// in the rest of a block goes to the next one; as every object goes
+// no higher than it was, the blocks it passed are large enough.
+//
+void Collector::compact()
+{
+    while (!pending.empty()) {
+        Object o = live[pending.back()];
+        pending.pop_back();
+        fields(o);
+    }
+    if (ranges.empty())
+        return;
+
+    // Count the marks, in the order of blocks, and put every object
+    // at its place in the order of allocation.
+    std::vector<Range *> order;
+    for (Range &r : ranges)
+        order.push_back(&r);
+    std::sort(order.begin(), order.end(), [](const Range *a, const Range *b) { return a->block < b->block; });
+    size_t total = 0;
+    for (Range *r : order) {
+        r->first = total;
+        uint32_t count = 0;
+        for (size_t i = 0; i < r->marks.size(); i++) {
+            r->ranks[i] = count;
+            count += std::popcount(r->marks[i]);
+        }
+        total += count;
+    }
+    std::vector<Object> sorted(live.size());
+    for (const Object &o : live)
+        sorted[rank(*range(o.address), o.address)] = o;
+    live.swap(sorted);
+
+    size_t block = from.block;
+    char *top = from.top ? from.top : heap.blocks[block].base;
+    for (Object &o : live) {
+        while (o.size > (size_t)(heap.blocks[block].base + heap.blocks[block].size - top)) {
+            block++;
+            top = heap.blocks[block].base;
+        }
+        o.target = top;
+        o.target_block = block;
+        top += o.size;
+        kept += o.size;
+    }
+    end = { block, top };
+
+    forwarding = true;
+    for (const Object &o : live)
+        fields(o);
+    for (const Object &o : live)
+        if (o.target != o.address)
+            std::memmove(o.target, o.address, o.size);
+    heap.release(end);
+}
+
+//
+// Add the statistics of this collection to the counters.
+//
+void Collector::finish(Counters &counters) const
+{
+    uint64_t pause = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - started)
+                         .count();
+    counters.collections++;
+    counters.gc_time += pause;
+    counters.gc_pause = std::max(counters.gc_pause, pause);
+    counters.reclaimed += used - std::min(used, kept);
+}
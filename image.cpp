@@ -0,0 +1,267 @@
+//
+// Compiled image of a program: encoder and decoder.
+//
+#include "image.h"
+
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+//
+// Signature at the start of an image.
+//
+static const char image_magic[] = { 'P', 'L', 'I', '2' };
+
+//
+// Arity word which marks a number: two words of its value follow.
+//
+static const uint32_t number_arity = UINT32_MAX;
+
+//
+// Encoder collects the atoms and the words of clauses.
+//
+class Encoder {
+    std::unordered_map<const Atom *, uint32_t> index;
+    std::vector<const Atom *> atoms;
+    std::vector<uint32_t> words;
+
+    // Return the number of the atom in the image.
+    uint32_t atom(const Atom *a)
+    {
+        auto found = index.emplace(a, atoms.size());
+        if (found.second)
+            atoms.push_back(a);
+        return found.first->second;
+    }
+
+    // Append a term of a template.
+    void term(Term *t)
+    {
+        static Atom *const integer_type = Atom::intern("$integer");
+        static Atom *const float_type = Atom::intern("$float");
+        if (Number *n = t->as_number()) {
+            uint64_t bits = n->get_value().bits();
+            words.push_back(atom(n->get_value().is_float() ? float_type : integer_type) << 1);
+            words.push_back(number_arity);
+            words.push_back((uint32_t)bits);
+            words.push_back((uint32_t)(bits >> 32));
+            return;
+        }
+        Compound *c = t->as_compound();
+        if (!c) {
+            words.push_back((uint32_t)static_cast<Variable *>(t)->get_slot() << 1 | 1);
+            return;
+        }
+        words.push_back(atom(c->get_functor()) << 1);
+        words.push_back(c->get_arity());
+        for (int i = 0; i < c->get_arity(); i++)
+            term(c->arg(i));
+    }
+
+public:
+    // Append a clause.
+    void clause(const Clause *cl)
+    {
+        uint32_t ngoals = 0;
+        for (Goal *g = cl->body; g; g = g->get_tail())
+            ngoals++;
+        words.push_back(cl->nvars);
+        words.push_back(ngoals);
+        term(cl->head);
+        for (Goal *g = cl->body; g; g = g->get_tail())
+            term(g->get_head());
+    }
+
+    // Write the image to the stream.
+    void write(std::ostream &out, uint32_t nclauses) const
+    {
+        uint32_t header[] = { (uint32_t)atoms.size(), nclauses, (uint32_t)words.size() };
+        out.write(image_magic, sizeof(image_magic));
+        out.write(reinterpret_cast<const char *>(header), sizeof(header));
+        for (const Atom *a : atoms) {
+            uint32_t length = a->name().size();
+            static const char padding[sizeof(uint32_t)] = {};
+            out.write(reinterpret_cast<const char *>(&length), sizeof(length));
+            out.write(a->name().data(), length);
+            out.write(padding, -length % sizeof(uint32_t));
+        }
+        out.write(reinterpret_cast<const char *>(words.data()), words.size() * sizeof(uint32_t));
+    }
+};
+
+//
+// Decoder builds the clauses from the words of an image.
+// Arguments of compounds are collected on a stack, which is reused for all terms.
+//
+class Decoder {
+    const uint32_t *word;
+    const uint32_t *limit;
+    std::vector<Atom *> atoms;
+    std::vector<Variable *> slots;
+    std::vector<Term *> args;
+
+    // Take the next word; return false at the end.
+    bool next(uint32_t &w)
+    {
+        if (word == limit)
+            return false;
+        w = *word++;
+        return true;
+    }
+
+    // Decode a term of a template; return nullptr when malformed.
+    Term *term()
+    {
+        uint32_t w, arity;
+        if (!next(w))
+            return nullptr;
+        if (w & 1)
+            return (w >> 1 < slots.size()) ? slots[w >> 1] : nullptr;
+        if (w >> 1 >= atoms.size() || !next(arity))
+            return nullptr;
+        if (arity == number_arity)
+            return number(atoms[w >> 1]);
+        if (arity > (size_t)(limit - word))
+            return nullptr;
+
+        size_t base = args.size();
+        for (uint32_t i = 0; i < arity; i++) {
+            Term *arg = term();
+            if (!arg)
+                return nullptr;
+            args.push_back(arg);
+        }
+        Compound *c = Compound::create(atoms[w >> 1], arity, args.data() + base);
+        args.resize(base);
+        return c;
+    }
+
+    // Decode a number of the given type, from the two words of its value; return nullptr when malformed.
+    Term *number(const Atom *type)
+    {
+        uint32_t low, high;
+        if (!next(low) || !next(high))
+            return nullptr;
+        uint64_t bits = (uint64_t)high << 32 | low;
+        if (type->name() == "$float")
+            return Number::create(Value::from_float(std::bit_cast<double>(bits)));
+        if (type->name() == "$integer")
+            return Number::create(Value::from_integer((int64_t)bits));
+        return nullptr;
+    }
+
+public:
+    // Decode the image; return nullptr when malformed.
+    Program *decode(const char *data, size_t size)
+    {
+        const char *end = data + size;
+        uint32_t header[3];
+        if (size < sizeof(image_magic) + sizeof(header) || std::memcmp(data, image_magic, sizeof(image_magic)) != 0)
+            return nullptr;
+        std::memcpy(header, data + sizeof(image_magic), sizeof(header));
+        data += sizeof(image_magic) + sizeof(header);
+
+        for (uint32_t i = 0; i < header[0]; i++) {
+            uint32_t length;
+            if (end - data < (ptrdiff_t)sizeof(length))
+                return nullptr;
+            std::memcpy(&length, data, sizeof(length));
+            data += sizeof(length);
+            size_t padded = (length + sizeof(uint32_t) - 1) & ~(sizeof(uint32_t) - 1);
+            if ((size_t)(end - data) < padded)
+                return nullptr;
+            atoms.push_back(Atom::intern(std::string(data, length)));
+            data += padded;
+        }
+
+        // The atoms are padded, so the clause words are aligned as the mapping is.
+        if ((size_t)(end - data) != header[2] * sizeof(uint32_t))
+            return nullptr;
+        word = reinterpret_cast<const uint32_t *>(data);
+        limit = word + header[2];
+
+        Program *first = nullptr;
+        Program **last = &first;
+        for (uint32_t n = 0; n < header[1]; n++) {
+            uint32_t nvars, ngoals;
+            if (!next(nvars) || !next(ngoals) || nvars > (size_t)(limit - word) || ngoals > (size_t)(limit - word))
+                return nullptr;
+            slots.resize(nvars);
+            for (uint32_t i = 0; i < nvars; i++) {
+                slots[i] = new Variable();
+                slots[i]->set_slot(i);
+            }
+
+            Term *head = term();
+            if (!head || !head->as_compound())
+                return nullptr;
+            std::vector<Compound *> goals;
+            for (uint32_t i = 0; i < ngoals; i++) {
+                Term *goal = term();
+                if (!goal || !goal->as_compound())
+                    return nullptr;
+                goals.push_back(goal->as_compound());
+            }
+            Goal *body = nullptr;
+            for (size_t i = goals.size(); i > 0; i--)
+                body = new Goal(goals[i - 1], body);
+
+            *last = new Program(new Clause(head->as_compound(), body, nvars));
+            last = &(*last)->tail;
+        }
+        return (word == limit) ? first : nullptr;
+    }
+};
+
+//
+// Write the clauses of the program to the file; return false when it cannot be written.
+//
+bool Image::save(Program *prog, const std::string &path)
+{
+    Encoder encoder;
+    uint32_t nclauses = 0;
+    for (Program *p = prog; p; p = p->tail, nclauses++)
+        encoder.clause(p->head);
+
+    std::ofstream out(path, std::ios::binary);
+    encoder.write(out, nclauses);
+    return bool(out);
+}
+
+//
+// Return true when the file starts with the signature of an image.
+//
+bool Image::detect(const std::string &path)
+{
+    char magic[sizeof(image_magic)];
+    std::ifstream in(path, std::ios::binary);
+    return in.read(magic, sizeof(magic)) && std::memcmp(magic, image_magic, sizeof(magic)) == 0;
+}
+
+//
+// Map the file into memory, and load the clauses of the image into the current engine.
+// Return nullptr when the file cannot be mapped, or is malformed.
+//
+Program *Image::load(const std::string &path)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return nullptr;
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size == 0) {
+        close(fd);
+        return nullptr;
+    }
+    void *data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return nullptr;
+
+    madvise(data, st.st_size, MADV_SEQUENTIAL);
+    Program *prog = Decoder().decode(static_cast<const char *>(data), st.st_size);
+    munmap(data, st.st_size);
+    return prog;
+}
@@ -0,0 +1,36 @@
+//
+// Compiled image of a program: a binary file which loads without parsing.
+//
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include <string>
+
+#include "prolog.h"
+
+//
+// Image holds the atom table and the clause templates of a program,
+// as arrays of 32-bit words in the byte order of the machine:
+//      "PLI2", number of atoms, number of clauses, number of clause words,
+//      atoms: length and bytes, padded to a word,
+//      clauses: number of variables, number of goals, head, goals.
+// A compound is written as (atom << 1) followed by the arity and the arguments,
+// a variable as (slot << 1 | 1). A number is written as the atom of its type
+// ($integer or $float), a word of all ones instead of the arity, and two words of its
+// value, the low one first. The file is mapped into memory, and the
+// clauses are built from it in a single pass. The index of the program
+// is built on first use, as for any other program.
+//
+class Image {
+public:
+    // Write the clauses of the program to the file; return false when it cannot be written.
+    static bool save(Program *prog, const std::string &path);
+
+    // Return true when the file starts with the signature of an image.
+    static bool detect(const std::string &path);
+
+    // Load the clauses of the image into the current engine; return nullptr when the file is malformed.
+    static Program *load(const std::string &path);
+};
+
+#endif // IMAGE_H
@@ -0,0 +1,18 @@
+//
+// Public interface of the Prolog library: terms and solvers, reading
+// programs and images, streaming queries, writing answers as text or
+// in binary, and serving queries from many threads: a pool of engines,
+// and a scheduler of queries.
+//
+#ifndef LIBPROLOG_H
+#define LIBPROLOG_H
+
+#include "prolog.h"
+#include "image.h"
+#include "pool.h"
+#include "query.h"
+#include "reader.h"
+#include "scheduler.h"
+#include "writer.h"
+
+#endif // LIBPROLOG_H
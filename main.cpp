@@ -0,0 +1,225 @@
+//
+// A simple Prolog interpreter written in C++:
+// an example test run, and the command line.
+//
+// Copyright (c) Alan Mycroft, University of Cambridge, 2000.
+//
+// Source: https://www.cl.cam.ac.uk/~am21/research/funnel/prolog.c
+//
+#include "prolog.h"
+#include "image.h"
+#include "parallel.h"
+#include "profile.h"
+#include "query.h"
+#include "reader.h"
+#include "trace.h"
+#include "wam.h"
+
+#include <cstring>
+
+//
+// Load the files, source text or images, into one program, in order.
+// Return nullptr on error.
+//
+static Program *load(const std::vector<std::string> &files)
+{
+    Program *first = nullptr;
+    Program **last = &first;
+    for (const std::string &path : files) {
+        std::string error;
+        Program *prog = Image::detect(path) ? Image::load(path) : Reader::consult(path, error);
+        if (!prog) {
+            std::cerr << (error.empty() ? path + ": malformed image" : error) << "\n";
+            return nullptr;
+        }
+        *last = prog;
+        while (*last)
+            last = &(*last)->tail;
+    }
+    return first;
+}
+
+//
+// Run from the command line:
+//      prolog file... -g 'goal.'   Print all answers of the goal
+//      prolog -p file... -g 'goal.' Also print a profile of the predicates
+//      prolog -o image file...     Compile the files into an image
+//
+static int run(int argc, char **argv)
+{
+    std::vector<std::string> files;
+    const char *goal_text = nullptr;
+    const char *image = nullptr;
+    bool profile = false;
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "-g") == 0 && i + 1 < argc)
+            goal_text = argv[++i];
+        else if (std::strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+            image = argv[++i];
+        else if (std::strcmp(argv[i], "-p") == 0)
+            profile = true;
+        else
+            files.push_back(argv[i]);
+    }
+    if (files.empty() || !(goal_text || image)) {
+        std::cerr << "Usage:\n"
+                  << "    prolog [-p] file... -g 'goal.'\n"
+                  << "    prolog -o image file...\n";
+        return 2;
+    }
+
+    Program *prog = load(files);
+    if (!prog)
+        return 1;
+    if (image && !Image::save(prog, image)) {
+        std::cerr << image << ": cannot write\n";
+        return 1;
+    }
+    if (goal_text) {
+        Reader reader(goal_text);
+        Goal *goal = reader.read_query();
+        if (!goal) {
+            std::cerr << "goal: " << (reader.failed() ? reader.error() : "empty") << "\n";
+            return 1;
+        }
+        VarMapping vars = reader.variables();
+        Profiler profiler;
+        if (profile)
+            goal->solve(prog, 0, &vars, profiler);
+        else
+            goal->solve(prog, 0, &vars);
+        if (uint64_t n = Engine::current().counters.overflows)
+            std::cerr << "warning: " << n << " integer overflows in arithmetic\n";
+        if (!profile)
+            return 0;
+        profiler.print(std::cerr);
+        if (Counters::enabled)
+            Engine::current().counters.print(std::cerr);
+    }
+    return 0;
+}
+
+//
+// A sample test program, or the command line when given arguments.
+//
+int main(int argc, char **argv)
+{
+    if (argc > 1)
+        return run(argc, argv);
+
+    auto *atom_app = Atom::intern("app");
+    auto *atom_cons = Atom::intern("cons");
+    auto *nil = Compound::create(Atom::intern("nil"));
+    auto *i_1 = Number::create(Value::from_integer(1));
+    auto *i_2 = Number::create(Value::from_integer(2));
+    auto *i_3 = Number::create(Value::from_integer(3));
+
+    //
+    // Clause 1:
+    //      app(nil, x, x)
+    //
+    auto *var_x = new Variable();
+    auto *app_nil_x_x = Compound::create(atom_app, { nil, var_x, var_x });
+    auto *clause_1 = new Clause(app_nil_x_x);
+
+    //
+    // Clause 2:
+    //      app([x|l], m, [x|n]); app(l, m, n)
+    //
+    auto *var_l = new Variable();
+    auto *var_m = new Variable();
+    auto *var_n = new Variable();
+    auto *app_l_m_n = Compound::create(atom_app, { var_l, var_m, var_n });
+    auto *app_xl_m_xn = Compound::create(atom_app, { Compound::create(atom_cons, { var_x, var_l }), var_m,
+                                                    Compound::create(atom_cons, { var_x, var_n }) });
+    auto *clause_2 = new Clause(app_xl_m_xn, new Goal(app_l_m_n));
+
+    //
+    // Goal:
+    //      app(i, j, [1, 2, 3])
+    auto *var_i = new Variable();
+    auto *var_j = new Variable();
+    auto *list_123 = Compound::create(
+        atom_cons, { i_1, Compound::create(atom_cons, { i_2, Compound::create(atom_cons, { i_3, nil }) }) });
+    auto *app_i_j_123 = Compound::create(atom_app, { var_i, var_j, list_123 });
+    auto *goal = new Goal(app_i_j_123);
+
+    //
+    // Two test programs.
+    //
+    auto *prog_1 = new Program(clause_1, new Program(clause_2));
+    auto *prog_2 = new Program(clause_2, new Program(clause_1));
+
+    //
+    // Two variables in the goal: I and J.
+    //
+    Variable *vars[] = { var_i, var_j };
+    std::string names[] = { "I", "J" };
+    auto *var_name_map = new VarMapping(vars, names, 2);
+
+    //
+    // Run program 1.
+    //
+    TextTracer tracer(std::cout);
+    std::cout << "=== Normal clause order:\n";
+    goal->solve(prog_1, 0, var_name_map, tracer);
+
+    //
+    // Run program 2.
+    //
+    std::cout << "\n=== Reversed clause order:\n";
+    goal->solve(prog_2, 0, var_name_map, tracer);
+
+    //
+    // Run both programs on the abstract machine, to compare the answers.
+    //
+    std::cout << "\n=== Abstract machine, normal clause order:\n";
+    Machine(prog_1).solve(goal, var_name_map);
+
+    std::cout << "\n=== Abstract machine, reversed clause order:\n";
+    Machine(prog_2).solve(goal, var_name_map);
+
+    //
+    // Run program 2 on four threads, with the answers in sequential order.
+    //
+    std::cout << "\n=== Parallel search, reversed clause order:\n";
+    OrParallel(prog_2, 4, true).solve(goal, var_name_map);
+
+    //
+    // Take only the first answer: the rest of the search is never done.
+    //
+    std::cout << "\n=== First answer only:\n";
+    for (const Solution &answer : query(prog_1, goal, var_name_map, 1))
+        answer.print();
+
+    //
+    // Clause 3 commits to the first split of the list:
+    //      first(x, m) :- app(x, m, [1, 2, 3]), !
+    //
+    auto *atom_first = Atom::intern("first");
+    auto *clause_3 = new Clause(Compound::create(atom_first, { var_x, var_m }),
+                                new Goal(Compound::create(atom_app, { var_x, var_m, list_123 }),
+                                         new Goal(Compound::create(Atom::intern("!")))));
+    auto *prog_3 = new Program(clause_3, prog_2);
+    auto *first_i_j = new Goal(Compound::create(atom_first, { var_i, var_j }));
+
+    std::cout << "\n=== Cut, reversed clause order:\n";
+    first_i_j->solve(prog_3, 0, var_name_map);
+
+    std::cout << "\n=== Abstract machine, cut, reversed clause order:\n";
+    Machine(prog_3).solve(first_i_j, var_name_map);
+
+    //
+    // Read program 1 and the goal from text.
+    //
+    Reader text("app(nil, X, X).\n"
+                "app(cons(X, L), M, cons(X, N)) :- app(L, M, N).\n"
+                "?- app(I, J, cons(1, cons(2, cons(3, nil)))).\n");
+    auto *prog_4 = new Program(text.read_clause(), new Program(text.read_clause()));
+    auto *goal_4 = text.read_query();
+    VarMapping vars_4 = text.variables();
+
+    std::cout << "\n=== Program read from text:\n";
+    goal_4->solve(prog_4, 0, &vars_4);
+    return 0;
+}
@@ -0,0 +1,449 @@
+//
+// OR-parallel solver: workers, tasks and work stealing.
+//
+#include "parallel.h"
+#include "writer.h"
+
+//
+// Append instances of the goals of a body to the list.
+// Without a frame, the goals are not templates, and are taken as is.
+//
+static void instantiate_goals(std::vector<Compound *> &list, Goal *body, Term **frame)
+{
+    for (Goal *g = body; g; g = g->get_tail())
+        list.push_back(frame ? static_cast<Compound *>(g->get_head()->instantiate(frame)) : g->get_head());
+}
+
+//
+// Return the path extended by two more choices.
+//
+static std::vector<unsigned> extend(const std::vector<unsigned> &path, unsigned a, unsigned b)
+{
+    std::vector<unsigned> key(path);
+    key.push_back(a);
+    key.push_back(b);
+    return key;
+}
+
+//
+// Solve the goal, and print all the answers to the output of the current engine.
+//
+void OrParallel::solve(Goal *goal, VarMapping *v)
+{
+    vars = v;
+    out = &Engine::current().output();
+    workers.clear();
+    for (unsigned i = 0; i < nworkers; i++)
+        workers.push_back(std::make_unique<Worker>());
+
+    // The query is the first task: its answer holds the variables of the query.
+    {
+        Engine::Scope scope(workers[0]->templates);
+        std::vector<Term *> args;
+        for (int i = 0; i < vars->size(); i++)
+            args.push_back(vars->variable(i));
+        std::vector<Compound *> goals;
+        instantiate_goals(goals, goal, nullptr);
+
+        Freezer f;
+        Compound *answer = f.copy_compound(Compound::create(Atom::intern("answer"), args.size(), args.data()));
+        Goal *body = f.copy_goals(goals);
+        give(*workers[0], { answer, body, f.size(), {} });
+    }
+
+    std::vector<std::thread> threads;
+    for (unsigned i = 0; i < nworkers; i++)
+        threads.emplace_back(&OrParallel::work, this, i);
+    for (std::thread &t : threads)
+        t.join();
+
+    if (ordered) {
+        // Print the answers in the order of the sequential solver.
+        std::vector<Answer> answers;
+        for (auto &w : workers)
+            std::move(w->answers.begin(), w->answers.end(), std::back_inserter(answers));
+        std::sort(answers.begin(), answers.end(),
+                  [](const Answer &a, const Answer &b) { return a.key < b.key; });
+        for (const Answer &a : answers)
+            *out << a.text;
+    }
+    workers.clear();
+}
+
+//
+// Run a worker until all tasks are finished.
+// A task adds the tasks it gives away to the pending count
+// before it is finished itself, so the count drops to zero only at the end.
+// An idle worker sleeps until a task is given: the count of signals,
+// read before looking, tells whether one came meanwhile.
+//
+void OrParallel::work(unsigned id)
+{
+    Worker &w = *workers[id];
+    Engine::Scope scope(w.engine);
+    Task task;
+
+    while (pending > 0) {
+        if (!take(id, task)) {
+            idle++;
+            bool found = false;
+            for (;;) {
+                std::unique_lock<std::mutex> guard(wait_lock);
+                uint64_t seen = posted;
+                guard.unlock();
+                if (pending == 0 || (found = take(id, task)))
+                    break;
+                guard.lock();
+                available.wait(guard, [&] { return posted != seen || pending == 0; });
+            }
+            idle--;
+            if (!found)
+                break;
+        }
+        execute(w, task);
+        if (--pending == 0)
+            signal(true);
+    }
+}
+
+//
+// Take the newest task of the worker, or steal the oldest one from another worker.
+//
+bool OrParallel::take(unsigned id, Task &task)
+{
+    for (unsigned k = 0; k < nworkers; k++) {
+        Worker &w = *workers[(id + k) % nworkers];
+        std::lock_guard<std::mutex> guard(w.lock);
+        if (w.tasks.empty())
+            continue;
+
+        if (k == 0) {
+            task = std::move(w.tasks.back());
+            w.tasks.pop_back();
+        } else {
+            task = std::move(w.tasks.front());
+            w.tasks.pop_front();
+        }
+        return true;
+    }
+    return false;
+}
+
+//
+// Add a task to the deque of the worker, and wake up an idle worker.
+//
+void OrParallel::give(Worker &w, Task &&task)
+{
+    pending++;
+    {
+        std::lock_guard<std::mutex> guard(w.lock);
+        w.tasks.push_back(std::move(task));
+    }
+    signal(false);
+}
+
+//
+// Count a signal, and wake up one idle worker, or all of them.
+//
+void OrParallel::signal(bool all)
+{
+    {
+        std::lock_guard<std::mutex> guard(wait_lock);
+        posted++;
+    }
+    if (all)
+        available.notify_all();
+    else
+        available.notify_one();
+}
+
+//
+// Solve a task in the engine of the worker.
+// Every few goals the worker checks whether others are idle, and if it has
+// no tasks of its own to offer, gives away its oldest choice point.
+// Answers of the task come first in the sequential order, then the tasks
+// given away, the latest one first: it was younger in the search tree.
+//
+void OrParallel::execute(Worker &w, const Task &task)
+{
+    Trace::Mark mark = Trace::Note();
+
+    // Variables of the task are created beforehand, as for a clause body.
+    auto **frame = static_cast<Term **>(Engine::current().heap.allocate(task.nvars * sizeof(Term *)));
+    for (int i = 0; i < task.nvars; i++)
+        frame[i] = new Variable();
+    auto *answer = static_cast<Compound *>(task.answer->instantiate(frame));
+
+    unsigned count = 0;
+    unsigned donations = 0;
+    {
+        Solver<> solver(prog, task.goals, frame);
+        for (;;) {
+            auto status = solver.run(slice);
+            if (status == Solver<>::FAILED)
+                break;
+            if (status == Solver<>::SOLVED)
+                report(w, extend(task.path, 0, count++), answer);
+            if (idle == 0)
+                continue;
+            {
+                std::lock_guard<std::mutex> guard(w.lock);
+                if (!w.tasks.empty())
+                    continue;
+            }
+
+            unsigned branch = UINT_MAX - donations++;
+            solver.donate([&](Compound *goal, const Continuation &rest, Clause *const *first, Clause *const *last) {
+                std::vector<Compound *> after;
+                for (const Continuation *k = &rest; k; k = k->parent)
+                    instantiate_goals(after, k->body, k->frame);
+
+                for (unsigned j = 0; first + j != last; j++) {
+                    Clause *cl = first[j];
+                    Trace::Mark m = Trace::Note();
+                    Term **clause_frame = cl->new_frame();
+                    if (cl->head->match(goal, clause_frame)) {
+                        std::vector<Compound *> goals;
+                        instantiate_goals(goals, cl->body, clause_frame);
+                        goals.insert(goals.end(), after.begin(), after.end());
+
+                        Engine::Scope scope(w.templates);
+                        Freezer f;
+                        Compound *a = f.copy_compound(answer);
+                        Goal *body = f.copy_goals(goals);
+                        give(w, { a, body, f.size(), extend(task.path, branch, j) });
+                    }
+                    Trace::Undo(m);
+                }
+            });
+        }
+    }
+    Trace::Undo(mark);
+}
+
+//
+// Report an answer: print it now, or keep it for sorting.
+//
+void OrParallel::report(Worker &w, std::vector<unsigned> key, Compound *answer)
+{
+    std::string text;
+    {
+        StringSink sink(text);
+        Writer writer(sink);
+        if (vars->size() == 0)
+            writer.put("yes\n");
+        for (int i = 0; i < vars->size(); i++) {
+            writer.put(vars->name(i));
+            writer.put(" = ");
+            writer.term(answer->arg(i));
+            writer.put('\n');
+        }
+    }
+
+    if (ordered) {
+        w.answers.push_back({ std::move(key), std::move(text) });
+    } else {
+        std::lock_guard<std::mutex> guard(output_lock);
+        *out << text;
+    }
+}
+
+//
+// Start the given number of threads.
+//
+AndParallel::AndParallel(unsigned n)
+{
+    for (unsigned i = 0; i < n; i++)
+        threads.emplace_back(&AndParallel::serve, this);
+}
+
+//
+// Stop the threads, after the queued jobs are done.
+//
+AndParallel::~AndParallel()
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    wakeup.notify_all();
+    for (std::thread &t : threads)
+        t.join();
+}
+
+//
+// Run the jobs from the queue, until the pool is stopped.
+//
+void AndParallel::serve()
+{
+    for (;;) {
+        std::function<void()> job;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            wakeup.wait(guard, [this] { return stopping || !queue.empty(); });
+            if (queue.empty())
+                return;
+            job = std::move(queue.front());
+            queue.pop_front();
+        }
+        job();
+    }
+}
+
+//
+// Run queued jobs in the calling thread, while there are any.
+//
+void AndParallel::help()
+{
+    for (;;) {
+        std::function<void()> job;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            if (queue.empty())
+                return;
+            job = std::move(queue.front());
+            queue.pop_front();
+        }
+        job();
+    }
+}
+
+//
+// Find all solutions of the goal of the job, and stop the group when it has
+// none, or when it goes past a limit. The goal is copied into the engine
+// of the job, and every solution is copied again into the engine for results,
+// which outlives the solver.
+//
+void AndParallel::run(Group &group, Job &job)
+{
+    Engine::Scope scope(job.engine);
+    Freezer f;
+    Compound *pattern = f.copy_compound(job.goal);
+    auto **frame = static_cast<Term **>(Engine::current().heap.allocate(f.size() * sizeof(Term *)));
+    for (int i = 0; i < f.size(); i++)
+        frame[i] = new Variable();
+    auto *goal = static_cast<Compound *>(pattern->instantiate(frame));
+
+    Solver<> solver(group.prog, new Goal(goal));
+    solver.set_tabling(group.tabling);
+    size_t slices = 0;
+    while (!group.stop.load(std::memory_order_relaxed)) {
+        if (group.deadline && group.deadline->expired())
+            break;
+        switch (solver.run(Deadline::slice)) {
+        case Solver<>::SOLVED:
+            if (job.solutions.size() == max_solutions) {
+                group.stop = true;
+                return;
+            }
+            {
+                Engine::Scope keep(job.results);
+                job.solutions.push_back(Freezer().copy_compound(goal));
+            }
+            break;
+        case Solver<>::SUSPENDED:
+            if (++slices == max_slices)
+                group.stop = true;
+            break;
+        case Solver<>::FAILED:
+            job.complete = true;
+            if (job.solutions.empty()) {
+                group.empty = true;
+                group.stop = true;
+            }
+            return;
+        }
+    }
+    group.stop = true;
+}
+
+//
+// Solve the goals, and return the facts of their joined goal, or nullptr
+// when the group is declined. The first goal is solved by the calling thread,
+// the others are queued. The facts are listed with the last goal varying fastest,
+// as the sequential solver would find the solutions.
+// Every solution is copied once into the current engine; a fact refers to
+// the copies, unless two of them have variables, which the fact must number apart.
+//
+Clause *const *AndParallel::join(Program *prog, Tabling *tabling, Compound *const *goals, int n, size_t &count)
+{
+    Group group;
+    group.prog = prog;
+    group.tabling = tabling;
+    group.deadline = Engine::current().deadline;
+    std::vector<std::unique_ptr<Job>> jobs;
+    for (int i = 0; i < n; i++) {
+        jobs.push_back(std::make_unique<Job>());
+        jobs[i]->goal = goals[i];
+    }
+
+    int remaining = n - 1;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        for (int i = 1; i < n; i++) {
+            queue.push_back([this, &group, &job = *jobs[i], &remaining] {
+                run(group, job);
+                std::lock_guard<std::mutex> guard(lock);
+                if (--remaining == 0)
+                    finished.notify_all();
+            });
+        }
+    }
+    wakeup.notify_all();
+    run(group, *jobs[0]);
+    help();
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        finished.wait(guard, [&remaining] { return remaining == 0; });
+    }
+
+    static Clause *const none[1] = { nullptr };
+    count = 0;
+    if (group.empty)
+        return none;
+    count = 1;
+    for (auto &job : jobs) {
+        if (!job->complete || job->solutions.size() > max_facts / count)
+            return nullptr;
+        count *= job->solutions.size();
+    }
+
+    // Copy the solutions into the current engine, as templates.
+    std::vector<std::vector<Compound *>> solutions(n);
+    std::vector<std::vector<int>> sizes(n);
+    for (int i = 0; i < n; i++) {
+        for (Compound *s : jobs[i]->solutions) {
+            Freezer f;
+            solutions[i].push_back(f.copy_compound(s));
+            sizes[i].push_back(f.size());
+        }
+    }
+
+    // Build a fact for every combination of the solutions.
+    static Atom *const join = Atom::intern("$join");
+    auto **facts = static_cast<Clause **>(Engine::current().heap.allocate(count * sizeof(Clause *)));
+    std::vector<size_t> index(n, 0);
+    std::vector<Term *> args(n);
+    for (size_t k = 0; k < count; k++) {
+        int nvars = 0;
+        bool apart = false;
+        for (int i = 0; i < n; i++) {
+            args[i] = solutions[i][index[i]];
+            if (int size = sizes[i][index[i]]) {
+                apart = apart || nvars > 0;
+                nvars += size;
+            }
+        }
+        Compound *head = Compound::create(join, n, args.data());
+        if (apart) {
+            Freezer f;
+            head = f.copy_compound(head);
+            nvars = f.size();
+        }
+        facts[k] = new Clause(head, nullptr, nvars, false);
+
+        for (int i = n - 1; i >= 0 && ++index[i] == solutions[i].size(); i--)
+            index[i] = 0;
+    }
+    return facts;
+}
@@ -0,0 +1,179 @@
+//
+// Parallel solvers: the alternative clauses of a search are explored
+// by several worker threads at once (OR-parallelism), and independent
+// goals of a body are solved at the same time (AND-parallelism).
+// Every thread works in its own engine.
+//
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "prolog.h"
+
+//
+// Workers share the program, and exchange tasks: a task is a copy of the
+// goals which remain to be solved, as a template with its own frame.
+// While other workers are idle, a busy worker gives away the untried
+// clauses of its oldest choice point, one task per matching clause.
+// Every worker keeps its tasks in a deque: the owner takes the newest task,
+// and idle workers steal the oldest ones, which have the largest subtrees.
+// Answers get a key from the choices which led to them, so that they
+// can be printed in the order of the sequential solver on request.
+//
+class OrParallel {
+    //
+    // Goals which remain to be solved, and the answer to report when they succeed.
+    // Both are templates, with nvars variables in the frame.
+    //
+    struct Task {
+        Compound *answer;
+        Goal *goals;
+        int nvars;
+        std::vector<unsigned> path; // Position of the task in the sequential order
+    };
+
+    //
+    // Answer of the query, printed as text.
+    //
+    struct Answer {
+        std::vector<unsigned> key;
+        std::string text;
+    };
+
+    //
+    // Worker thread, with its deque of tasks.
+    // Templates of tasks built by the worker are kept in a separate engine,
+    // which lives until the end of the query.
+    //
+    struct Worker {
+        std::mutex lock;
+        std::deque<Task> tasks;
+        Engine engine;
+        Engine templates;
+        std::vector<Answer> answers;
+    };
+
+    Program *prog;
+    unsigned nworkers;
+    bool ordered;
+
+    // State of the current query.
+    VarMapping *vars{ nullptr };
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::atomic<size_t> pending{ 0 };  // Tasks not finished yet
+    std::atomic<unsigned> idle{ 0 };   // Workers which look for a task
+    std::mutex wait_lock;              // Guards the count of signals
+    std::condition_variable available; // Signalled when a task is given, and at the end
+    uint64_t posted{ 0 };              // Number of signals
+    std::mutex output_lock;
+    std::ostream *out{ nullptr };
+
+    // Number of goals a worker calls between checks for idle workers.
+    static constexpr size_t slice = 256;
+
+    // Run a worker until all tasks are finished.
+    void work(unsigned id);
+
+    // Take the newest task of the worker, or steal the oldest one from another worker.
+    bool take(unsigned id, Task &task);
+
+    // Add a task to the deque of the worker, and wake up an idle worker.
+    void give(Worker &w, Task &&task);
+
+    // Wake up the idle workers, which look for a task or for the end.
+    void signal(bool all);
+
+    // Solve a task, giving away alternatives while other workers are idle.
+    void execute(Worker &w, const Task &task);
+
+    // Report an answer: print it now, or keep it for sorting.
+    void report(Worker &w, std::vector<unsigned> key, Compound *answer);
+
+public:
+    // Solve with the given number of workers; keep the sequential order of answers when asked.
+    OrParallel(Program *p, unsigned n, bool sequential_order = false)
+        : prog(p), nworkers(std::max(n, 1u)), ordered(sequential_order)
+    {
+    }
+
+    // Solve the goal, and print all the answers to the output of the current engine.
+    void solve(Goal *goal, VarMapping *vars);
+};
+
+//
+// AND-parallel fork: independent goals are solved on a pool of threads,
+// and their solutions are joined into a cross product.
+// Every goal is copied into an engine of its own, and solved there
+// for all solutions; the calling thread takes part in the work.
+// The work is bounded: when a goal has more than max_solutions, runs
+// for more than max_slices slices of calls, or the product of solutions
+// is larger than max_facts, the group is declined, and the solver calls
+// the goals one by one, as it would without a fork. When a goal fails,
+// the others are stopped: the group has no solutions.
+// A goal with one solution needs no choice point, so a group
+// of deterministic goals is joined into a single fact.
+// Goals solved on the pool do not fork again.
+//
+class AndParallel : public Fork {
+    //
+    // State shared by the goals of a group.
+    //
+    struct Group {
+        Program *prog;
+        Tabling *tabling;
+        const Deadline *deadline;         // Deadline of the caller, if any
+        std::atomic<bool> stop{ false };  // Some goal has failed, or gone past a limit
+        std::atomic<bool> empty{ false }; // Some goal has no solutions
+    };
+
+    //
+    // One goal of a group, with its own engines for solving and for the solutions.
+    //
+    struct Job {
+        Compound *goal;
+        Engine engine;
+        Engine results;
+        std::vector<Compound *> solutions;
+        bool complete{ false }; // All solutions are found
+    };
+
+    static constexpr size_t max_solutions = 1024;
+    static constexpr size_t max_slices = 256; // Of Deadline::slice calls each
+    static constexpr size_t max_facts = 64 * 1024;
+
+    std::vector<std::thread> threads;
+    std::deque<std::function<void()>> queue;
+    std::mutex lock;
+    std::condition_variable wakeup;
+    std::condition_variable finished;
+    bool stopping{ false };
+
+    // Run the jobs from the queue, until the pool is stopped.
+    void serve();
+
+    // Run queued jobs in the calling thread, while there are any.
+    void help();
+
+    // Find all solutions of the goal of the job, within the limits.
+    void run(Group &group, Job &job);
+
+public:
+    // Start the given number of threads.
+    explicit AndParallel(unsigned n);
+    AndParallel(const AndParallel &) = delete;
+    AndParallel &operator=(const AndParallel &) = delete;
+
+    // Stop the threads.
+    ~AndParallel() override;
+
+    // Solve the goals, and return the facts of their joined goal, or nullptr when they are declined.
+    Clause *const *join(Program *prog, Tabling *tabling, Compound *const *goals, int n, size_t &count) override;
+};
+
+#endif // PARALLEL_H
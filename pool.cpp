@@ -0,0 +1,65 @@
+//
+// Pool of engines, for serving queries over one program from many threads.
+//
+#include "pool.h"
+
+//
+// Create the engines ahead, and build the index of the program,
+// so that the first queries pay for neither.
+//
+EnginePool::EnginePool(Program *p, unsigned size, size_t heap_bytes, size_t trail) : prog(p)
+{
+    if (prog)
+        prog->database();
+    for (unsigned i = 0; i < size; i++) {
+        auto e = std::make_unique<Engine>();
+        e->heap.reserve(heap_bytes);
+        e->history.reserve(trail);
+        idle.push_back(e.get());
+        engines.push_back(std::move(e));
+    }
+}
+
+//
+// Take an idle engine, waiting until one is given back.
+//
+Engine *EnginePool::take()
+{
+    std::unique_lock<std::mutex> guard(lock);
+    released.wait(guard, [this] { return !idle.empty(); });
+    Engine *e = idle.back();
+    idle.pop_back();
+    return e;
+}
+
+//
+// Make the engine available again.
+//
+void EnginePool::give_back(Engine *e)
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        idle.push_back(e);
+    }
+    released.notify_one();
+}
+
+//
+// Take an engine, and make it current.
+//
+EnginePool::Lease::Lease(EnginePool &p, const Deadline *deadline) : pool(p), e(p.take()), scope(*e)
+{
+    e->deadline = deadline;
+}
+
+//
+// Reset the variables bound in the engine, release its heap
+// but keep the blocks, and give it back.
+//
+EnginePool::Lease::~Lease()
+{
+    Trace::Undo({ 0, 0, { 0, nullptr } });
+    e->boundary = UINT64_MAX;
+    e->deadline = nullptr;
+    pool.give_back(e);
+}
@@ -0,0 +1,74 @@
+//
+// Pool of engines, for serving queries over one program from many threads.
+//
+#ifndef POOL_H
+#define POOL_H
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "prolog.h"
+
+//
+// EnginePool keeps engines with their heap and trail allocated ahead,
+// and hands them out one per query: a lease makes an engine current
+// on its thread, and gives it back, reset, when it ends.
+// All engines share the program: its clause templates are never modified,
+// and its index is built by the pool. The program must outlive the pool,
+// and must not belong to one of its engines.
+//
+class EnginePool {
+    Program *prog;
+    std::vector<std::unique_ptr<Engine>> engines;
+    std::vector<Engine *> idle;
+    std::mutex lock;
+    std::condition_variable released;
+
+    // Take an idle engine, waiting until one is given back.
+    Engine *take();
+
+    // Make the engine available again.
+    void give_back(Engine *e);
+
+public:
+    // Create the engines, each with a heap of the given size and room
+    // for the given number of trailed variables.
+    EnginePool(Program *p, unsigned size, size_t heap_bytes = Heap::block_size, size_t trail = 1 << 16);
+    EnginePool(const EnginePool &) = delete;
+    EnginePool &operator=(const EnginePool &) = delete;
+
+    // Return the program of the queries.
+    Program *program() const { return prog; }
+
+    // Return the number of engines.
+    unsigned size() const { return engines.size(); }
+
+    //
+    // Engine taken from the pool for a query. It is current on the calling
+    // thread while the lease is in scope; solvers and terms of the query
+    // must not outlive the lease, as the engine is reset when it ends.
+    //
+    class Lease {
+        EnginePool &pool;
+        Engine *e;
+        Engine::Scope scope;
+
+    public:
+        // Take an engine, waiting for one when all are in use.
+        // The queries stop when the deadline, if any, passes.
+        explicit Lease(EnginePool &p, const Deadline *deadline = nullptr);
+
+        // Reset the engine, and give it back to the pool.
+        ~Lease();
+
+        Lease(const Lease &) = delete;
+        Lease &operator=(const Lease &) = delete;
+
+        // Return the engine.
+        Engine &engine() const { return *e; }
+    };
+};
+
+#endif // POOL_H
@@ -0,0 +1,94 @@
+//
+// Profiler of predicates: time samples and the flat profile.
+//
+#include "profile.h"
+
+#include <iomanip>
+
+//
+// Start measuring the time after a call of the predicate.
+//
+void Profiler::start(Entry &e)
+{
+    timed = &e;
+    countdown = period;
+    since = Clock::now();
+}
+
+//
+// Give the time measured so far to its predicate, as if every call
+// in the sampling period took as long.
+//
+void Profiler::stop()
+{
+    timed->seconds += std::chrono::duration<double>(Clock::now() - since).count() * period;
+    timed->samples++;
+    timed = nullptr;
+}
+
+//
+// Return the counts of all predicates: by sampled time, then by calls, then by name.
+//
+std::vector<Profiler::Entry> Profiler::profile() const
+{
+    std::vector<Entry> list;
+    for (const auto &item : entries)
+        list.push_back(item.second);
+    std::sort(list.begin(), list.end(), [](const Entry &a, const Entry &b) {
+        if (a.seconds != b.seconds)
+            return a.seconds > b.seconds;
+        if (a.calls != b.calls)
+            return a.calls > b.calls;
+        if (a.functor != b.functor)
+            return a.functor->name() < b.functor->name();
+        return a.arity < b.arity;
+    });
+    return list;
+}
+
+//
+// Return the number of goals called: logical inferences.
+//
+uint64_t Profiler::inferences() const
+{
+    uint64_t total = 0;
+    for (const auto &item : entries)
+        total += item.second.calls;
+    return total;
+}
+
+//
+// Print a flat profile: one line per predicate, the most expensive first.
+// The time is an estimate from the samples, without the time of subgoals.
+//
+void Profiler::print(std::ostream &out) const
+{
+    out << std::left << std::setw(24) << "predicate" << std::right;
+    for (const char *title : { "calls", "redos", "exits", "fails", "tried", "nomatch" })
+        out << std::setw(11) << title;
+    out << std::setw(11) << "time ms" << std::setw(8) << "%" << "\n";
+
+    double total = 0;
+    for (const auto &item : entries)
+        total += item.second.seconds;
+
+    for (const Entry &e : profile()) {
+        out << std::left << std::setw(24) << (e.functor->name() + "/" + std::to_string(e.arity)) << std::right;
+        for (uint64_t n : { e.calls, e.redos, e.exits, e.fails, e.attempts, e.nomatches })
+            out << std::setw(11) << n;
+        out << std::fixed << std::setprecision(3) << std::setw(11) << e.seconds * 1e3 << std::setprecision(1)
+            << std::setw(8) << (total > 0 ? 100 * e.seconds / total : 0.0) << "\n";
+    }
+    out << std::defaultfloat << std::setprecision(6);
+    out << inferences() << " inferences\n";
+}
+
+//
+// Forget all counts.
+//
+void Profiler::clear()
+{
+    entries.clear();
+    timed = nullptr;
+    countdown = period;
+}
@@ -0,0 +1,117 @@
+//
+// Profiler of predicates: a tracer which counts the ports of goals.
+//
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <chrono>
+
+#include "prolog.h"
+
+//
+// Profiler counts, for every predicate, the ports of its goals after the box
+// model: calls, redos, exits and fails, and also the clauses tried, and the heads
+// which did not match. A goal exits once per solution. A redo is counted when
+// backtracking resumes a goal which has clauses left, and a fail when no clause
+// is left to try: a goal which has taken its last clause fails through its body.
+// Following the exits keeps the continuation of every clause body, so deep
+// recursion takes more memory while profiling.
+// The time is sampled: every so many calls, the time until the next call
+// is measured and given to the predicate just called, scaled by the period.
+// This estimates the time of a predicate without its subgoals.
+//
+class Profiler {
+public:
+    //
+    // Counts of one predicate.
+    //
+    struct Entry {
+        const Atom *functor{ nullptr };
+        int arity{ 0 };
+        uint64_t calls{ 0 };
+        uint64_t redos{ 0 };
+        uint64_t exits{ 0 };
+        uint64_t fails{ 0 };
+        uint64_t attempts{ 0 };
+        uint64_t nomatches{ 0 };
+        uint64_t samples{ 0 };
+        double seconds{ 0 };
+    };
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    std::unordered_map<uint64_t, Entry> entries;
+    unsigned period;
+    unsigned countdown;
+    Entry *timed{ nullptr };
+    Clock::time_point since;
+
+    // Return the entry of the predicate of the compound.
+    Entry &entry(const Compound *c)
+    {
+        auto [found, added] = entries.try_emplace(c->key());
+        if (added) {
+            found->second.functor = c->get_functor();
+            found->second.arity = c->get_arity();
+        }
+        return found->second;
+    }
+
+    // Start measuring the time after a call of the predicate.
+    void start(Entry &e);
+
+    // Give the time measured so far to its predicate.
+    void stop();
+
+public:
+    // Sample the time every given number of calls; never when it is zero.
+    explicit Profiler(unsigned sampling = 1000) : period(sampling), countdown(sampling) {}
+
+    // A goal is called.
+    void call(Compound *goal, int)
+    {
+        Entry &e = entry(goal);
+        e.calls++;
+        if (timed)
+            stop();
+        if (period && --countdown == 0)
+            start(e);
+    }
+
+    // A clause is tried for the goal.
+    void attempt(Clause *cl, int) { entry(cl->head).attempts++; }
+
+    // The head of the clause does not match the goal.
+    void nomatch(Clause *cl, int) { entry(cl->head).nomatches++; }
+
+    // The goal succeeds.
+    void exit(Compound *goal, int) { entry(goal).exits++; }
+
+    // The goal is tried again with its remaining clauses.
+    void redo(Compound *goal, int) { entry(goal).redos++; }
+
+    // No clause is left to try for the goal.
+    void fail(Compound *goal, int) { entry(goal).fails++; }
+
+    // Finish the time sample, if any: the solver stops here for a while.
+    void flush()
+    {
+        if (timed)
+            stop();
+    }
+
+    // Return the counts of all predicates, in the order of the profile.
+    std::vector<Entry> profile() const;
+
+    // Return the number of goals called: logical inferences.
+    uint64_t inferences() const;
+
+    // Print a flat profile: one line per predicate, the most expensive first.
+    void print(std::ostream &out) const;
+
+    // Forget all counts.
+    void clear();
+};
+
+#endif // PROFILE_H
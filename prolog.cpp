@@ -1,301 +1,423 @@
 //
-// A simple Prolog interpreter written in C++,
-// including an example test run as main().
+// A simple Prolog interpreter written in C++:
+// atoms, heap, clauses and index.
 //
 // Copyright (c) Alan Mycroft, University of Cambridge, 2000.
 //
 // Source: https://www.cl.cam.ac.uk/~am21/research/funnel/prolog.c
 //
-#include <iostream>
-#include <utility>
+#include "prolog.h"
+#include "writer.h"
 
-//
-// Atom is an entity, uniquely identified by a string.
-//
-class Atom {
-    std::string atomname;
-
-public:
-    explicit Atom(std::string s) : atomname(std::move(s)) {}
-
-    // Compare two atoms for equality.
-    bool equal(Atom *t) { return (atomname == t->atomname); }
+#include <charconv>
+#include <cstring>
 
-    void print() { std::cout << atomname; }
-};
+std::unordered_map<std::string, Atom *> Atom::table;
+std::vector<Atom *> Atom::atoms;
+std::mutex Atom::lock;
 
-class Compound;
+thread_local Engine Engine::standalone;
+thread_local Engine *Engine::active = &Engine::standalone;
 
 //
-// Abstract interface to a Term.
+// Create an engine, known to Epochs while it exists.
 //
-class Term {
-public:
-    // Return a copy of this term.
-    virtual Term *copy() = 0;
-
-    // Match this term to another one, and instantiate the variables.
-    virtual bool unify(Term *t) = 0;
-
-    // Match this term to the gived compound, and instantiate the variables.
-    virtual bool unify_compound(Compound *c) = 0;
+Engine::Engine(std::ostream &o) : out(&o)
+{
+    Epochs::attach(this);
+}
 
-    // Print this term to cout.
-    virtual void print() = 0;
-};
+Engine::~Engine()
+{
+    Epochs::detach(this);
+}
 
 //
-// A compound term consists of an atom called a "functor" and a number
-// of arguments, which are again terms.
+// Print the counters, one per line.
 //
-class Compound : public Term {
-    Atom *functor;
-    int arity;
-    Term **args;
-
-public:
-    // Create a compound of zero arity: f()
-    explicit Compound(Atom *f) : functor(f), arity(0), args(nullptr) {}
-
-    // Create a compound of arity one: f(a1)
-    Compound(Atom *f, Term *a1) : functor(f), arity(1), args(new Term *[1])
-    {
-        args[0] = a1;
-    };
+void Counters::print(std::ostream &out) const
+{
+    out << "calls        " << calls << "\n"
+        << "attempts     " << attempts << "\n"
+        << "nomatches    " << nomatches << "\n"
+        << "choicepoints " << choicepoints << "\n"
+        << "redos        " << redos << "\n"
+        << "cells        " << cells << "\n"
+        << "trailed      " << trailed << "\n"
+        << "collections  " << collections << "\n"
+        << "gc time ns   " << gc_time << "\n"
+        << "gc pause ns  " << gc_pause << "\n"
+        << "reclaimed    " << reclaimed << "\n"
+        << "overflows    " << overflows << "\n";
+}
 
-    // Create a compound of arity two: f(a1, a2)
-    Compound(Atom *f, Term *a1, Term *a2) : functor(f), arity(2), args(new Term *[2])
-    {
-        args[0] = a1, args[1] = a2;
+//
+// Switch to the next block, large enough for the given size.
+// Blocks are kept after release, and reused when the heap grows again.
+//
+void Heap::grow(size_t size)
+{
+    size_t next = top ? current + 1 : 0;
+    if (next < blocks.size() && blocks[next].size < size) {
+        // Too small: replace the block with a larger one.
+        delete[] blocks[next].base;
+        blocks[next] = { new char[size], size };
     }
-
-    // Create a compound of arity three: f(a1, a2, a3)
-    Compound(Atom *f, Term *a1, Term *a2, Term *a3) : functor(f), arity(3), args(new Term *[3])
-    {
-        args[0] = a1, args[1] = a2, args[2] = a3;
+    if (next == blocks.size()) {
+        size_t n = std::max(size, chunk);
+        blocks.push_back({ new char[n], n });
     }
+    current = next;
+    top = blocks[current].base;
+    limit = top + blocks[current].size;
+}
 
-    // Print this compound to cout.
-    void print() override
-    {
-        functor->print();
-        if (arity > 0) {
-            std::cout << "(";
-            for (int i = 0; i < arity;) {
-                args[i]->print();
-                if (++i < arity)
-                    std::cout << ",";
-            }
-            std::cout << ")";
-        }
+//
+// Allocate blocks ahead, and touch their memory.
+// New blocks go after the existing ones, which the heap uses first.
+//
+void Heap::reserve(size_t bytes)
+{
+    for (size_t total = reserved(); total < bytes; total += block_size) {
+        blocks.push_back({ new char[block_size], block_size });
+        std::memset(blocks.back().base, 0, block_size);
     }
+}
 
-    // Match this compound to the given term, and instantiate the variables.
-    bool unify(Term *t) override { return t->unify_compound(this); }
-
-    // Return a copy of this term.
-    Term *copy() override { return copy_compound(); }
-
-    // Return a copy of this compound.
-    Compound *copy_compound() { return new Compound(this); }
+std::atomic<unsigned> Clause::count = 0;
 
-private:
-    // Make a copy of another compound
-    explicit Compound(Compound *c)
-        : functor(c->functor), arity(c->arity), args(c->arity == 0 ? nullptr : new Term *[c->arity])
-    {
-        for (int i = 0; i < arity; i++)
-            args[i] = c->args[i]->copy();
-    }
-
-    // Match this compound to another one, and instantiate the variables.
-    bool unify_compound(Compound *c) override
-    {
-        if (!functor->equal(c->functor) || arity != c->arity)
-            return false;
+//
+// Bind this unbound variable to the term, and trail it when needed.
+//
+void Variable::bind(Term *t)
+{
+    Trace::Bind(this);
+    instance = t;
+}
 
-        for (int i = 0; i < arity; i++)
-            if (!args[i]->unify(c->args[i]))
+//
+// Match this term to another one, and instantiate the variables.
+// A pending compound is kept on the stack until its last argument is taken:
+// that one is unified in the loop, so a list spine needs no stack at all.
+// An unbound variable is bound to the other term.
+// Numbers of the same type are equal only with the same value.
+// Two different pooled terms are never equal.
+//
+bool Term::unify(Term *t)
+{
+    //
+    // Compounds whose arguments are being unified.
+    //
+    struct Pending {
+        Compound *left;
+        Compound *right;
+        int next;
+    };
+    static thread_local std::vector<Pending> work;
+    work.clear();
+
+    Term *a = this;
+    Term *b = t;
+    for (;;) {
+        a = a->deref();
+        b = b->deref();
+        if (a != b) {
+            Compound *x = a->as_compound();
+            Compound *y = b->as_compound();
+            if (!x || !y) {
+                // A variable, or a number.
+                if (Variable *v = a->as_variable()) {
+                    v->bind(b);
+                } else if (Variable *w = b->as_variable()) {
+                    w->bind(a);
+                } else {
+                    Number *n = a->as_number();
+                    Number *m = b->as_number();
+                    if (!n || !m || !n->same(m))
+                        return false;
+                }
+            } else if (x->is_pooled() && y->is_pooled()) {
                 return false;
+            } else if (!x->get_functor()->equal(y->get_functor()) || x->get_arity() != y->get_arity()) {
+                return false;
+            } else if (x->get_arity() == 1) {
+                a = x->arg(0);
+                b = y->arg(0);
+                continue;
+            } else if (x->get_arity() > 1) {
+                work.push_back({ x, y, 0 });
+            }
+        }
 
-        return true;
+        // Take the next pair of arguments.
+        if (work.empty())
+            return true;
+        Pending &p = work.back();
+        int i = p.next++;
+        a = p.left->arg(i);
+        b = p.right->arg(i);
+        if (p.next == p.left->get_arity())
+            work.pop_back();
     }
-};
+}
 
 //
-// Variables are placeholders for arbitrary terms.
-// A variable can become instantiated (bound to a term) via unification.
-// Variables are identified by a unique index, assigned sequentially starting from 1.
+// Return a copy of this term.
 //
-class Variable : public Term {
-    Term *instance;
-    unsigned index;
-    static unsigned timestamp;
-
-public:
-    Variable() : instance(this), index(++timestamp) {}
-
-    // Unbind this variable.
-    void reset() { instance = this; }
-
-    // Match this variable to the given term, and instantiate when appropriate.
-    bool unify(Term *t) override;
-
-    // Return a copy of this term.
-    Term *copy() override;
-
-    // Print this variable to cout.
-    void print() override
-    {
-        if (instance != this)
-            instance->print();
-        else
-            std::cout << "_" << index;
-    };
-
-private:
-    // Match this variable to the given compound, and instantiate when appropriate.
-    bool unify_compound(Compound *c) override { return this->unify(c); }
-};
+Term *Term::copy()
+{
+    if (Variable *v = as_variable())
+        return v->rename();
+    if (Number *n = as_number())
+        return Number::create(n->get_value());
+    return static_cast<Compound *>(this)->copy_compound();
+}
 
-unsigned Variable::timestamp = 0;
+//
+// Return a copy of this compound. Numbers are copied with their values,
+// and pooled terms are shared. The stack holds the argument slots of the copies
+// still to fill, and the terms to fill them from, leftmost on top: the copy
+// is made in the same order as by a recursive walk.
+//
+Compound *Compound::copy_compound()
+{
+    if (pooled)
+        return this;
+    auto *result = new (arity) Compound(functor, arity);
+    std::vector<std::pair<Term **, Term *>> work;
+    for (int i = arity; i > 0; i--)
+        work.emplace_back(&result->args()[i - 1], args()[i - 1]);
+
+    while (!work.empty()) {
+        auto [slot, source] = work.back();
+        work.pop_back();
+        if (Variable *v = source->as_variable()) {
+            *slot = v->rename();
+            continue;
+        }
+        if (Number *n = source->as_number()) {
+            *slot = Number::create(n->get_value());
+            continue;
+        }
+        auto *c = static_cast<Compound *>(source);
+        if (c->pooled) {
+            *slot = c;
+            continue;
+        }
+        auto *copy = new (c->arity) Compound(c->functor, c->arity);
+        *slot = copy;
+        for (int i = c->arity; i > 0; i--)
+            work.emplace_back(&copy->args()[i - 1], c->args()[i - 1]);
+    }
+    return result;
+}
 
-class Program;
-class VarMapping;
+//
+// Print this term to the stream, through a writer.
+//
+void Term::print(std::ostream &out)
+{
+    StreamSink sink(out);
+    Writer(sink).term(this);
+}
 
 //
-// Goal is a list of compounds:
-//      a(); b(); c()
+// Print the goals, separated by semicolons.
 //
-class Goal {
-    Compound *head;
-    Goal *tail;
+void Goal::print(std::ostream &out) const
+{
+    StreamSink sink(out);
+    Writer(sink).goals(this);
+}
 
-public:
-    // Create a goal with given head and tail.
-    Goal(Compound *h, Goal *t = nullptr) : head(h), tail(t) {}
+//
+// Print the clause.
+//
+void Clause::print(std::ostream &out) const
+{
+    StreamSink sink(out);
+    Writer(sink).clause(this);
+}
 
-    // Return a copy of this goal.
-    Goal *copy()
-    {
-        return new Goal(head->copy_compound(), tail ? tail->copy() : nullptr);
-    }
+//
+// Print variables and their instantiations to the output of the current engine.
+//
+void VarMapping::show_answer() const
+{
+    StreamSink sink(Engine::current().output());
+    Writer(sink).answer(*this);
+}
 
-    // Append a goal to this list.
-    Goal *append(Goal *l)
-    {
-        return new Goal(head, tail ? tail->append(l) : nullptr);
+//
+// Write the value: integers in decimal, and floats in the shortest form
+// which reads back to the same value, with at least one digit of fraction.
+//
+size_t Number::format(char *text) const
+{
+    char *limit = text + max_text;
+    if (!value.is_float())
+        return std::to_chars(text, limit, value.integer).ptr - text;
+
+    char *end = std::to_chars(text, limit, value.real).ptr;
+    std::string_view digits(text, end - text);
+    if (digits.find_first_of(".n") != std::string_view::npos) {
+        // With a fraction already, or inf, or nan.
+        return digits.size();
     }
+    size_t exponent = std::min(digits.find('e'), digits.size());
+    std::memmove(text + exponent + 2, text + exponent, digits.size() - exponent);
+    text[exponent] = '.';
+    text[exponent + 1] = '0';
+    return digits.size() + 2;
+}
 
-    // Solve the problem.
-    void solve(Program *prog, int level, VarMapping *vars);
+//
+// Make a clause template: copy the terms, and number the variables of the copy.
+//
+Clause::Clause(Compound *h, Goal *t) : number(++count)
+{
+    Trace::Mark tr = Trace::Note();
+    head = h->copy_compound();
+    body = t ? t->copy() : nullptr;
+
+    // Every original variable is now bound to its copy.
+    std::vector<Variable *> originals = Trace::Since(tr);
+    nvars = originals.size();
+    for (int i = 0; i < nvars; i++)
+        static_cast<Variable *>(originals[i]->deref())->set_slot(i);
+    Trace::Reset(tr);
+    share_ground();
+    compile_arithmetic();
+}
 
-    // Print this list.
-    void print()
-    {
-        head->print();
-        if (tail) {
-            std::cout << "; ", tail->print();
-        }
-    }
+//
+// Replace the ground subterms of the head and the body with pooled ones.
+//
+void Clause::share_ground()
+{
+    head = Constants::share(head);
+    for (Goal *g = body; g; g = g->get_tail())
+        g->share_ground();
+}
 
-    // Print n*4 spaces.
-    static void indent(int n)
-    {
-        for (int i = 0; i < n; i++)
-            std::cout << "    ";
-    }
-};
+std::mutex Constants::lock;
+std::unordered_set<Compound *, Constants::Hash, Constants::Equal> Constants::pool;
 
 //
-// Clause consists of a head (compound) and a goal (list of compounds):
-//      head() :- a(); b(); c().
+// Hash a pooled term by its functor, the addresses of its compound arguments,
+// and the values of its numbers.
 //
-class Clause {
-public:
-    Compound *head;
-    Goal *body;
-    Clause(Compound *h, Goal *t = nullptr) : head(h), body(t) {}
-
-    // Return a copy of this clause.
-    [[nodiscard]] Clause *copy() const
-    {
-        return new Clause(head->copy_compound(), body ? body->copy() : nullptr);
+size_t Constants::Hash::operator()(const Compound *c) const
+{
+    uint64_t h = c->key();
+    for (int i = 0; i < c->arity; i++) {
+        Number *n = c->args()[i]->as_number();
+        h = (h ^ (n ? n->hash() : reinterpret_cast<uintptr_t>(c->args()[i]))) * 0x9e3779b97f4a7c15;
     }
+    return h;
+}
 
-    // Print this clause.
-    void print() const
-    {
-        head->print();
-        std::cout << " :- ";
-        if (body)
-            body->print();
-        else
-            std::cout << "true";
-    }
-};
+//
+// Compare two ground terms, whose compound arguments are pooled: those are
+// the same objects, and the numbers have the same values.
+//
+bool Constants::Equal::operator()(const Compound *a, const Compound *b) const
+{
+    if (a->functor != b->functor || a->arity != b->arity)
+        return false;
+    return std::equal(a->args(), a->args() + a->arity, b->args(), [](Term *x, Term *y) {
+        Number *n = x->as_number();
+        return x == y || (n && y->as_number() && n->same(y->as_number()));
+    });
+}
 
 //
-// Program is a list of clauses.
+// Return the engine which holds the pooled terms.
 //
-class Program {
-public:
-    Clause *head;
-    Program *tail;
-    Program(Clause *h, Program *t = nullptr) : head(h), tail(t) {}
-};
+Engine &Constants::engine()
+{
+    static Engine constants;
+    return constants;
+}
 
 //
-// Trace records a sequence of variable instaitiations.
+// Return the pooled copy of a ground term, copying it into the pool on first use.
+// The lock is held by the caller.
 //
-class Trace {
-    Variable *head;
-    Trace *tail;
-    static Trace *history;
-    Trace(Variable *h, Trace *t) : head(h), tail(t) {}
+Compound *Constants::intern(Compound *c)
+{
+    auto found = pool.find(c);
+    if (found != pool.end())
+        return *found;
+
+    Engine::Scope scope(engine());
+    Compound *copy = Compound::create(c->functor, c->arity, c->args());
+    for (int i = 0; i < copy->arity; i++)
+        if (Number *n = copy->args()[i]->as_number())
+            copy->args()[i] = Number::create(n->get_value());
+    copy->pooled = true;
+    pool.insert(copy);
+    return copy;
+}
 
-public:
-    // Return a current position of the trace.
-    static Trace *Note() { return history; }
+//
+// Walk the template from the leaves up, with an explicit stack: a compound
+// whose arguments are all ground is replaced by its pooled copy.
+//
+Compound *Constants::share(Compound *c)
+{
+    //
+    // Compound whose arguments are being visited.
+    //
+    struct Visit {
+        Compound *c;
+        int next;
+        bool ground;
+    };
 
-    // Add a new variable to the trace.
-    static void Push(Variable *x)
-    {
-        history = new Trace(x, history);
-    }
+    if (c->pooled)
+        return c;
+    std::lock_guard<std::mutex> guard(lock);
+    std::vector<Visit> work{ { c, 0, true } };
+    for (;;) {
+        Visit &v = work.back();
+        if (v.next < v.c->arity) {
+            Term *t = v.c->args()[v.next];
+            Compound *arg = t->as_compound();
+            if (!arg || arg->pooled) {
+                // A variable, a number or a pooled term.
+                v.ground &= !t->as_variable();
+                v.next++;
+            } else {
+                work.push_back({ arg, 0, true });
+            }
+            continue;
+        }
 
-    // Reset all instantiations up to the given position.
-    static void Undo(Trace *whereto)
-    {
-        for (; history != whereto; history = history->tail)
-            history->head->reset();
+        Visit done = work.back();
+        work.pop_back();
+        Compound *result = done.ground ? intern(done.c) : done.c;
+        if (work.empty())
+            return result;
+        Visit &parent = work.back();
+        parent.c->args()[parent.next++] = result;
+        parent.ground &= done.ground;
     }
-};
-
-Trace *Trace::history = nullptr;
+}
 
 //
-// Bind this variable to the specified term.
+// Return the number of pooled terms.
 //
-bool Variable::unify(Term *t)
+size_t Constants::size()
 {
-    if (instance == this) {
-        // The variable is uninstantiated.
-        // Bind it to this term.
-        Trace::Push(this);
-        instance = t;
-        return true;
-    }
-
-    // This variable is already instantiated.
-    // Redirect the request to the instance.
-    return instance->unify(t);
+    std::lock_guard<std::mutex> guard(lock);
+    return pool.size();
 }
 
 //
-// Return a term this variable is bound to.
+// Return the term this variable is bound to, binding an unbound one to its copy.
 //
-Term *Variable::copy()
+Term *Variable::rename()
 {
     if (instance == this) {
         // The variable is unbound.
@@ -306,142 +428,249 @@ Term *Variable::copy()
     return instance;
 }
 
+const std::vector<Clause *> Index::none;
+
+//
+// Build the index for the list of clauses.
+//
+Index::Index(Program *prog)
+{
+    for (Program *iter = prog; iter; iter = iter->tail) {
+        Predicate &pred = predicates[iter->head->head->key()];
+        if (!pred.by_arg)
+            pred.by_arg = std::make_unique<std::atomic<ArgIndex *>[]>(iter->head->head->get_arity());
+        pred.clauses.push_back(iter->head);
+    }
+}
+
 //
-// Table of variables and their names.
+// Return true when the goal can be solved apart from the goals around it.
+// The predicates reachable from the goal through the clause bodies are
+// visited once: when none of them is impure, they are all known to be pure.
 //
-class VarMapping {
-private:
-    Variable **vars;
-    std::string *names;
-    int count;
+bool Index::pure(const Compound *goal)
+{
+    static Atom *const cut = Atom::intern("!");
+    if (goal->get_functor() == cut && goal->get_arity() == 0)
+        return false;
+
+    std::lock_guard<std::mutex> guard(lock);
+    std::vector<uint64_t> work;
+    std::unordered_set<uint64_t> seen;
+    bool impure = !reach(goal, work, seen);
+    while (!impure && !work.empty()) {
+        auto found = predicates.find(work.back());
+        work.pop_back();
+        for (const Clause *cl : found->second.clauses)
+            for (const Goal *g = cl->body; g && !impure; g = g->get_tail())
+                impure = !reach(g->get_head(), work, seen);
+    }
+    if (impure) {
+        if (!Builtins::find(goal))
+            purity[goal->key()] = false;
+        return false;
+    }
+    for (uint64_t key : seen)
+        purity[key] = true;
+    return true;
+}
 
-public:
-    VarMapping(Variable *vv[], std::string vt[], int vs) : vars(vv), names(vt), count(vs) {}
+//
+// Queue the predicates which the goal calls, unless they are known or seen;
+// return false when the goal is impure. A cut in a clause body is not:
+// it prunes only the choices of its clause. The goal of call/1, once/1
+// and findall/3 is looked at in the same way, and is impure when unbound,
+// as it is known only when it runs.
+//
+bool Index::reach(const Compound *goal, std::vector<uint64_t> &work, std::unordered_set<uint64_t> &seen)
+{
+    static Atom *const cut = Atom::intern("!");
+    static Atom *const comma = Atom::intern(",");
+    static const std::unordered_map<uint64_t, int> meta = {
+        { Compound::make_key(Atom::intern("call"), 1), 0 },
+        { Compound::make_key(Atom::intern("once"), 1), 0 },
+        { Compound::make_key(Atom::intern("findall"), 3), 1 },
+    };
 
-    // Print variables and their instantiations.
-    void show_answer()
-    {
-        if (count == 0)
-            std::cout << "yes\n";
-        else {
-            for (int i = 0; i < count; i++) {
-                std::cout << names[i] << " = ";
-                vars[i]->print();
-                std::cout << "\n";
-            }
+    std::vector<Term *> goals{ const_cast<Compound *>(goal) };
+    while (!goals.empty()) {
+        Compound *c = goals.back()->deref()->as_compound();
+        goals.pop_back();
+        if (!c)
+            return false;
+        if ((c->get_functor() == cut && c->get_arity() == 0))
+            continue;
+        if (c->get_functor() == comma && c->get_arity() == 2) {
+            goals.push_back(c->arg(0));
+            goals.push_back(c->arg(1));
+            continue;
+        }
+        if (auto m = meta.find(c->key()); m != meta.end()) {
+            goals.push_back(c->arg(m->second));
+            continue;
         }
+        if (const Builtin *b = Builtins::find(c)) {
+            if (!b->pure)
+                return false;
+            continue;
+        }
+        if (!predicates.count(c->key()) || dynamic.changed(c->key()))
+            return false;
+        auto known = purity.find(c->key());
+        if (known != purity.end()) {
+            if (!known->second)
+                return false;
+            continue;
+        }
+        if (seen.insert(c->key()).second)
+            work.push_back(c->key());
     }
-};
+    return true;
+}
 
 //
-// Solve the problem.
+// Forget what is known of the purity of predicates: a predicate
+// taken into the database makes those which call it impure.
 //
-void Goal::solve(Program *prog, int level, VarMapping *vars)
+void Index::changed()
 {
-    indent(level);
-    std::cout << "solve@" << level << ": ";
-    this->print();
-    std::cout << "\n";
+    std::lock_guard<std::mutex> guard(lock);
+    purity.clear();
+    changes.fetch_add(1, std::memory_order_release);
+}
 
-    //
-    // Iterate over the clauses of the program.
-    //
-    for (Program *iter = prog; iter; iter = iter->tail) {
-        Trace *tr = Trace::Note();
-        Clause *cl = iter->head->copy();
-        Trace::Undo(tr);
-
-        indent(level);
-        std::cout << "  try:";
-        cl->print();
-        std::cout << "\n";
-
-        // Match the goal to the clause head.
-        if (head->unify(cl->head)) {
-
-            // Matched: extend the goal with the clause body and solve it,
-            // with the level incremented.
-            Goal *gdash = cl->body ? cl->body->append(tail) : tail;
-            if (gdash)
-                gdash->solve(prog, level + 1, vars);
-            else
-                vars->show_answer();
+//
+// Distribute the clauses by their argument at the given position.
+//
+Index::ArgIndex::ArgIndex(const std::vector<Clause *> &clauses, int position)
+{
+    // First create a bucket for every principal functor.
+    for (Clause *cl : clauses) {
+        Term *t = cl->head->arg(position);
+        if (!t->as_variable())
+            buckets[arg_key(t)];
+    }
+
+    // Then fill the buckets, keeping the program order.
+    for (Clause *cl : clauses) {
+        Term *t = cl->head->arg(position);
+        if (!t->as_variable()) {
+            buckets[arg_key(t)].push_back(cl);
         } else {
-            indent(level);
-            std::cout << "  nomatch.\n";
+            unbound.push_back(cl);
+            for (auto &bucket : buckets)
+                bucket.second.push_back(cl);
         }
-
-        // Reset the variables bound at this iteration.
-        Trace::Undo(tr);
     }
 }
 
 //
-// A sample test program
+// Build the index of the predicate on the argument at the given position,
+// unless another thread has already done it.
 //
-int main()
+Index::ArgIndex *Index::build(Predicate &pred, int position)
 {
-    auto *atom_app = new Atom("app");
-    auto *atom_cons = new Atom("cons");
-    auto *nil = new Compound(new Atom("nil"));
-    auto *i_1 = new Compound(new Atom("1"));
-    auto *i_2 = new Compound(new Atom("2"));
-    auto *i_3 = new Compound(new Atom("3"));
+    std::lock_guard<std::mutex> guard(lock);
+    ArgIndex *ai = pred.by_arg[position].load(std::memory_order_relaxed);
+    if (!ai) {
+        ai = new ArgIndex(pred.clauses, position);
+        pred.by_arg[position].store(ai, std::memory_order_release);
+    }
+    return ai;
+}
 
-    //
-    // Clause 1:
-    //      app(nil, x, x)
-    //
-    auto *var_x = new Variable();
-    auto *app_nil_x_x = new Compound(atom_app, nil, var_x, var_x);
-    auto *clause_1 = new Clause(app_nil_x_x);
+//
+// Return the clauses which can possibly match the given goal, in program order.
+// A predicate changed by assert or retract is looked up in the database.
+//
+Candidates Index::lookup(Compound *goal)
+{
+    Candidates result;
+    if (!dynamic.empty() && dynamic.lookup(goal, result))
+        return result;
+
+    auto found = predicates.find(goal->key());
+    if (found == predicates.end())
+        return { none.data(), 0 };
+
+    Predicate &pred = found->second;
+    if (pred.clauses.size() == 1)
+        return { pred.clauses.data(), 1 };
+
+    // Use the first argument which is bound in the call, and which
+    // is not a variable in all clauses.
+    for (int i = 0; i < goal->get_arity(); i++) {
+        Term *t = goal->arg(i)->deref();
+        if (t->as_variable())
+            continue;
+
+        ArgIndex *ai = pred.by_arg[i].load(std::memory_order_acquire);
+        if (!ai)
+            ai = build(pred, i);
+        if (!ai->selective())
+            continue;
+
+        auto bucket = ai->buckets.find(arg_key(t));
+        const std::vector<Clause *> &clauses = (bucket == ai->buckets.end()) ? ai->unbound : bucket->second;
+        return { clauses.data(), clauses.size() };
+    }
+    return { pred.clauses.data(), pred.clauses.size() };
+}
 
-    //
-    // Clause 2:
-    //      app([x|l], m, [x|n]); app(l, m, n)
-    //
-    auto *var_l = new Variable();
-    auto *var_m = new Variable();
-    auto *var_n = new Variable();
-    auto *app_l_m_n = new Compound(atom_app, var_l, var_m, var_n);
-    auto *app_xl_m_xn = new Compound(atom_app, new Compound(atom_cons, var_x, var_l),
-                                     var_m, new Compound(atom_cons, var_x, var_n));
-    auto *clause_2 = new Clause(app_xl_m_xn, new Goal(app_l_m_n));
+//
+// Return the clauses which can possibly match the given goal, in program order.
+// The index is built on first use.
+//
+Candidates Program::lookup(Compound *goal)
+{
+    std::call_once(indexed, [this] { index = new Index(this); });
+    return index->lookup(goal);
+}
 
-    //
-    // Goal:
-    //      app(i, j, [1, 2, 3])
-    auto *var_i = new Variable();
-    auto *var_j = new Variable();
-    auto *app_i_j_123 = new Compound(atom_app, var_i, var_j,
-                                     new Compound(atom_cons, i_1,
-                                           new Compound(atom_cons, i_2,
-                                                        new Compound(atom_cons, i_3, nil))));
-    auto *goal = new Goal(app_i_j_123);
+//
+// Return the dynamic database of the program, building the index first.
+//
+Database &Program::database()
+{
+    std::call_once(indexed, [this] { index = new Index(this); });
+    return index->database();
+}
 
-    //
-    // Two test programs.
-    //
-    auto *prog_1 = new Program(clause_1, new Program(clause_2));
-    auto *prog_2 = new Program(clause_2, new Program(clause_1));
+//
+// Return true when the goal can be solved apart from the goals around it.
+//
+bool Program::pure(const Compound *goal)
+{
+    std::call_once(indexed, [this] { index = new Index(this); });
+    return index->pure(goal);
+}
 
-    //
-    // Two variables in the goal: I and J.
-    //
-    Variable *vars[] = { var_i, var_j };
-    std::string names[] = { "I", "J" };
-    auto *var_name_map = new VarMapping(vars, names, 2);
+//
+// Return the number of changes which can make pure goals impure.
+//
+uint64_t Program::purity_changes()
+{
+    std::call_once(indexed, [this] { index = new Index(this); });
+    return index->purity_changes();
+}
 
-    //
-    // Run program 1.
-    //
-    std::cout << "=== Normal clause order:\n";
-    goal->solve(prog_1, 0, var_name_map);
+//
+// Return true when some goal of this list is a cut.
+//
+bool Goal::cuts() const
+{
+    static Atom *const cut = Atom::intern("!");
+    for (const Goal *g = this; g; g = g->tail)
+        if (g->head->get_functor() == cut && g->head->get_arity() == 0)
+            return true;
+    return false;
+}
 
-    //
-    // Run program 2.
-    //
-    std::cout << "\n=== Reversed clause order:\n";
-    goal->solve(prog_2, 0, var_name_map);
-    return 0;
+//
+// Solve the problem, without tracing.
+//
+void Goal::solve(Program *prog, int level, VarMapping *vars)
+{
+    NullTracer tracer;
+    solve(prog, level, vars, tracer);
 }
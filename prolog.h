@@ -0,0 +1,2457 @@
+//
+// A simple Prolog interpreter written in C++:
+// the data structures of the interpreter.
+//
+// Copyright (c) Alan Mycroft, University of Cambridge, 2000.
+//
+// Source: https://www.cl.cam.ac.uk/~am21/research/funnel/prolog.c
+//
+#ifndef PROLOG_H
+#define PROLOG_H
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+//
+// Atom is an entity, uniquely identified by a string.
+// Atoms are interned: there is exactly one Atom object per name,
+// and each one gets a dense integer ID, so equality is a single compare.
+// The table of atoms is shared by all engines, and is guarded by a lock.
+//
+class Atom {
+    std::string atomname;
+    unsigned id;
+    static std::unordered_map<std::string, Atom *> table;
+    static std::vector<Atom *> atoms;
+    static std::mutex lock;
+
+    Atom(std::string s, unsigned i) : atomname(std::move(s)), id(i) {}
+
+public:
+    // Return the unique atom with the given name, creating it on first use.
+    static Atom *intern(const std::string &s)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        auto found = table.find(s);
+        if (found != table.end())
+            return found->second;
+
+        auto *a = new Atom(s, atoms.size());
+        atoms.push_back(a);
+        table.emplace(s, a);
+        return a;
+    }
+
+    // Return the atom with the given ID.
+    static Atom *by_id(unsigned i)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        return atoms[i];
+    }
+
+    // Return the number of interned atoms.
+    static unsigned count()
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        return atoms.size();
+    }
+
+    // Compare two atoms for equality.
+    bool equal(const Atom *t) const { return id == t->id; }
+
+    // Return the dense integer ID of this atom.
+    unsigned get_id() const { return id; }
+
+    // Return the name of this atom.
+    const std::string &name() const { return atomname; }
+
+    // Print this atom to cout.
+    void print(std::ostream &out = std::cout) const { out << atomname; }
+};
+
+//
+// Heap is a bump-pointer region, from which terms, goals, clauses
+// and trace entries are allocated.
+// Objects are never freed one by one: instead the top of the heap
+// is reset to a previously taken mark, which releases in O(1)
+// everything allocated after it.
+//
+class Heap {
+    friend class Collector;
+
+public:
+    static constexpr size_t block_size = 1 << 20;
+
+private:
+    struct Block {
+        char *base;
+        size_t size;
+    };
+
+    std::vector<Block> blocks;
+    size_t current{ 0 };
+    char *top{ nullptr };
+    char *limit{ nullptr };
+    size_t chunk{ block_size }; // Smallest size of a new block
+
+    // Switch to the next block, large enough for the given size.
+    void grow(size_t size);
+
+public:
+    //
+    // Position in the heap.
+    //
+    struct Mark {
+        size_t block;
+        char *top;
+    };
+
+    Heap() = default;
+    Heap(const Heap &) = delete;
+    Heap &operator=(const Heap &) = delete;
+
+    // Make a heap of smaller blocks, for a few objects which are freed together.
+    explicit Heap(size_t min_block) : chunk(min_block) {}
+
+    // Free all blocks.
+    ~Heap()
+    {
+        for (Block &b : blocks)
+            delete[] b.base;
+    }
+
+    // Round the size up to the alignment of allocations.
+    static size_t align(size_t size) { return (size + alignof(void *) - 1) & ~(alignof(void *) - 1); }
+
+    // Allocate memory on the heap.
+    void *allocate(size_t size)
+    {
+        size = align(size);
+        if (size > (size_t)(limit - top))
+            grow(size);
+
+        void *ptr = top;
+        top += size;
+        return ptr;
+    }
+
+    // Return a current position of the heap.
+    Mark mark() const { return { current, top }; }
+
+    // Allocate blocks ahead, up to the given size in all, and touch their memory,
+    // so that the heap neither grows nor faults pages in until then.
+    void reserve(size_t bytes);
+
+    // Return the size of all blocks: blocks are kept after release, so this is the peak size.
+    size_t reserved() const
+    {
+        size_t total = 0;
+        for (const Block &b : blocks)
+            total += b.size;
+        return total;
+    }
+
+    // Release everything allocated after the given position.
+    void release(const Mark &m)
+    {
+        current = m.block;
+        top = m.top;
+        limit = top ? blocks[current].base + blocks[current].size : nullptr;
+    }
+
+    // Exchange the blocks and the position with another heap.
+    void swap(Heap &h)
+    {
+        std::swap(blocks, h.blocks);
+        std::swap(current, h.current);
+        std::swap(top, h.top);
+        std::swap(limit, h.limit);
+        std::swap(chunk, h.chunk);
+    }
+};
+
+class Variable;
+
+//
+// Counters of the work done by the solvers of an engine, on the hot paths.
+// They are updated only in a build with PROLOG_COUNTERS defined;
+// otherwise COUNT() compiles to nothing, and the counters stay zero.
+//
+struct Counters {
+    uint64_t calls{ 0 };        // Goals called
+    uint64_t attempts{ 0 };     // Clauses tried
+    uint64_t nomatches{ 0 };    // Clause heads which failed to match
+    uint64_t choicepoints{ 0 }; // Choice points created
+    uint64_t redos{ 0 };        // Choice points resumed with their remaining clauses
+    uint64_t cells{ 0 };        // Terms created by instances of clause templates
+    uint64_t trailed{ 0 };      // Variables pushed to the trace
+
+    // Garbage collections are rare, and counted in every build.
+    uint64_t collections{ 0 }; // Collections of the heap
+    uint64_t gc_time{ 0 };     // Total pause of the collections, in nanoseconds
+    uint64_t gc_pause{ 0 };    // Longest pause, in nanoseconds
+    uint64_t reclaimed{ 0 };   // Bytes of the heap freed by the collections
+
+    // So are integer overflows in arithmetic, which make a goal fail.
+    uint64_t overflows{ 0 };
+
+#ifdef PROLOG_COUNTERS
+    static constexpr bool enabled = true;
+#else
+    static constexpr bool enabled = false;
+#endif
+
+    // Print the counters, one per line.
+    void print(std::ostream &out) const;
+};
+
+#ifdef PROLOG_COUNTERS
+#define COUNT(name) (Engine::current().counters.name++)
+#else
+#define COUNT(name) ((void)0)
+#endif
+
+//
+// Deadline of a query, which another thread can also cancel at any time.
+// Solvers check it between slices of calls, not on every call,
+// so a query stops within a slice after the deadline passes.
+//
+class Deadline {
+    std::chrono::steady_clock::time_point until;
+    std::atomic<bool> cancelled{ false };
+
+public:
+    // Number of calls between checks of the deadline.
+    static constexpr size_t slice = 4096;
+
+    // A deadline which never passes, unless cancelled.
+    Deadline() : until(std::chrono::steady_clock::time_point::max()) {}
+
+    // A deadline after the given time from now.
+    explicit Deadline(std::chrono::steady_clock::duration timeout) : until(std::chrono::steady_clock::now() + timeout)
+    {
+    }
+
+    // Stop the query at the next check.
+    void cancel() { cancelled.store(true, std::memory_order_relaxed); }
+
+    // Return true when the query must stop.
+    bool expired() const
+    {
+        return cancelled.load(std::memory_order_relaxed) || std::chrono::steady_clock::now() >= until;
+    }
+};
+
+//
+// Engine is the context of a computation: it owns the heap, the trace
+// of instantiated variables, the counter of variables, and the stream
+// where answers are printed.
+// Every thread works in its current engine, which is a default one
+// unless another engine is made current with Engine::Scope.
+// Several engines can solve queries on different threads over one
+// shared Program: clause templates are never modified while solving,
+// and the clauses of dynamic predicates are read without locks (see Epochs).
+// Other terms belong to the engine which created them.
+//
+class Engine {
+    static thread_local Engine standalone;
+    static thread_local Engine *active;
+
+    std::ostream *out;
+
+public:
+    Heap heap;
+    std::vector<Variable *> history;     // Instantiated variables
+    uint64_t boundary{ UINT64_MAX };     // Latest variable which gets trailed
+    uint64_t timestamp{ 0 };             // Index of the latest variable
+    Counters counters;                   // Work done, when counting is enabled
+    size_t gc_threshold{ 64 << 20 };     // Least growth of the heap between collections, in bytes; 0 disables them
+    const Deadline *deadline{ nullptr }; // Limit of the queries solved in this engine, if any
+    std::atomic<uint64_t> reading{ 0 };  // Epoch when its readers started, or 0 when there are none
+    unsigned readers{ 0 };               // Solvers reading shared clauses in this engine
+
+    // Create an engine: it is known to Epochs while it exists.
+    explicit Engine(std::ostream &o = std::cout);
+    ~Engine();
+    Engine(const Engine &) = delete;
+    Engine &operator=(const Engine &) = delete;
+
+    // Return the current engine of the calling thread.
+    static Engine &current() { return *active; }
+
+    // Return the stream for answers.
+    std::ostream &output() const { return *out; }
+
+    //
+    // Make an engine current for the calling thread, while in scope.
+    //
+    class Scope {
+        Engine *saved;
+
+    public:
+        explicit Scope(Engine &e) : saved(active) { active = &e; }
+        ~Scope() { active = saved; }
+        Scope(const Scope &) = delete;
+        Scope &operator=(const Scope &) = delete;
+    };
+};
+
+//
+// Object removed from a structure which readers use without locks, such as
+// the clauses of a dynamic predicate: it is deleted by Epochs once no reader can see it.
+//
+class Retired {
+    friend class Epochs;
+
+    uint64_t stamp{ 0 }; // Epoch when it was retired
+
+public:
+    virtual ~Retired() = default;
+};
+
+//
+// Epochs tell when retired objects can be deleted, without making the readers lock:
+// a reader, such as a solver, shows in its engine the epoch when it started,
+// and an object is deleted when all readers still running started after
+// it was retired. Every engine is known to Epochs while it exists.
+// A reader which runs for long keeps the objects retired meanwhile.
+//
+class Epochs {
+    static std::atomic<uint64_t> clock; // Current epoch
+
+    // Delete the retired objects which no reader can see.
+    static void reclaim();
+
+public:
+    // Add the engine to the engines with readers.
+    static void attach(Engine *e);
+
+    // Remove the engine from the engines with readers.
+    static void detach(Engine *e);
+
+    // Start reading in the current engine. The fence makes the epoch visible
+    // to reclaim() before any shared list is read.
+    static void enter()
+    {
+        Engine &e = Engine::current();
+        if (e.readers++ == 0) {
+            e.reading.store(clock.load());
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+        }
+    }
+
+    // Stop reading in the current engine.
+    static void leave()
+    {
+        Engine &e = Engine::current();
+        if (--e.readers == 0)
+            e.reading.store(0);
+    }
+
+    // Delete the object once the readers which can see it have finished.
+    // It must be unreachable for readers which start from now on.
+    static void retire(Retired *r);
+
+    // Return the number of retired objects not deleted yet.
+    static size_t pending();
+
+    //
+    // Reading in the current engine, while in scope.
+    //
+    class Reader {
+    public:
+        Reader() { enter(); }
+        ~Reader() { leave(); }
+        Reader(const Reader &) = delete;
+        Reader &operator=(const Reader &) = delete;
+    };
+};
+
+//
+// Base class for objects allocated on the heap of the current engine.
+//
+class HeapObject {
+public:
+    static void *operator new(size_t size) { return Engine::current().heap.allocate(size); }
+    static void operator delete(void *) {}
+};
+
+class Compound;
+class Number;
+
+//
+// Abstract interface to a Term.
+// Copying, unification and printing walk the terms with an explicit stack,
+// and take the last argument of a compound in a loop: neither deep terms
+// nor long lists grow the native stack.
+//
+class Term : public HeapObject {
+public:
+    // Return a copy of this term: unbound variables are bound to their copies,
+    // and bound ones give their values.
+    Term *copy();
+
+    // Match this term to another one, and instantiate the variables.
+    bool unify(Term *t);
+
+    // Print this term to the stream.
+    void print(std::ostream &out = std::cout);
+
+    // Follow the bindings of variables, and return the term at the end of the chain.
+    virtual Term *deref() { return this; }
+
+    // Return this term as a compound, or nullptr when it is an unbound variable or a number.
+    virtual Compound *as_compound() { return nullptr; }
+
+    // Return this term as a variable, bound or not, or nullptr for a compound or a number.
+    virtual Variable *as_variable() { return nullptr; }
+
+    // Return this term as a number, or nullptr when it is not one.
+    virtual Number *as_number() { return nullptr; }
+
+    // Match this clause template to the given term, and instantiate the variables.
+    // Variables of the clause are bound in the frame, not in the template.
+    virtual bool match(Term *t, Term **frame) = 0;
+
+    // Return an instance of this clause template, with variables taken from the frame.
+    virtual Term *instantiate(Term **frame) = 0;
+};
+
+//
+// A compound term consists of an atom called a "functor" and a number
+// of arguments, which are again terms.
+//
+class Compound : public Term {
+    friend class Collector;
+    friend class Constants;
+
+    Atom *functor;
+    int arity;
+    bool pooled{ false }; // A ground term in the pool of constants
+
+    // Arguments follow the object, in the same allocation.
+    Term **args() { return reinterpret_cast<Term **>(this + 1); }
+    Term *const *args() const { return reinterpret_cast<Term *const *>(this + 1); }
+
+    // Allocate a compound together with room for its arguments.
+    static void *operator new(size_t size, int n)
+    {
+        return Engine::current().heap.allocate(size + n * sizeof(Term *));
+    }
+
+    // Create a compound with uninitialized arguments.
+    Compound(Atom *f, int n) : functor(f), arity(n) {}
+
+public:
+    // Create a compound with the given arguments: f(a1, ..., an)
+    static Compound *create(Atom *f, std::initializer_list<Term *> a = {})
+    {
+        return create(f, a.size(), a.begin());
+    }
+
+    // Create a compound with n arguments, taken from the array.
+    static Compound *create(Atom *f, int n, Term *const *a)
+    {
+        auto *c = new (n) Compound(f, n);
+        std::copy(a, a + n, c->args());
+        return c;
+    }
+
+    // Return the functor of this compound.
+    Atom *get_functor() const { return functor; }
+
+    // Return the number of arguments.
+    int get_arity() const { return arity; }
+
+    // Return the argument at the given position, counting from 0.
+    Term *arg(int i) const { return args()[i]; }
+
+    // Return true for a ground term of the pool of constants: it is shared, never copied,
+    // and equal to another pooled term only when it is the same object.
+    bool is_pooled() const { return pooled; }
+
+    // Return a key which identifies the principal functor: name and arity.
+    uint64_t key() const { return make_key(functor, arity); }
+
+    // Return a key which identifies a functor with the given name and arity.
+    static uint64_t make_key(const Atom *f, int n) { return (uint64_t)f->get_id() << 32 | (unsigned)n; }
+
+    // This term is a compound.
+    Compound *as_compound() override { return this; }
+
+    // Match this clause template to the given term, and instantiate the variables.
+    bool match(Term *t, Term **frame) override
+    {
+        Term *d = t->deref();
+        Compound *c = d->as_compound();
+        if (!c) {
+            // Unbound variable: bind it to an instance of this template.
+            return d->as_variable() && d->unify(instantiate(frame));
+        }
+        if (c == this)
+            return true;
+        if (pooled && c->pooled)
+            return false;
+        if (!functor->equal(c->functor) || arity != c->arity)
+            return false;
+
+        for (int i = 0; i < arity; i++)
+            if (!args()[i]->match(c->args()[i], frame))
+                return false;
+
+        return true;
+    }
+
+    // Return an instance of this clause template; a pooled term is its own instance.
+    Term *instantiate(Term **frame) override
+    {
+        if (pooled)
+            return this;
+        COUNT(cells);
+        return new (arity) Compound(this, frame);
+    }
+
+    // Return a copy of this compound.
+    Compound *copy_compound();
+
+private:
+    // Make an instance of a clause template
+    Compound(Compound *c, Term **frame) : functor(c->functor), arity(c->arity)
+    {
+        for (int i = 0; i < arity; i++)
+            args()[i] = c->args()[i]->instantiate(frame);
+    }
+};
+
+//
+// Value of a number, or of an arithmetic expression: an integer or a float.
+//
+struct Value {
+    enum Type : uint8_t { INTEGER, FLOAT };
+    Type type{ INTEGER };
+    union {
+        int64_t integer{ 0 };
+        double real;
+    };
+
+    // Return an integer value.
+    static Value from_integer(int64_t n)
+    {
+        Value v;
+        v.integer = n;
+        return v;
+    }
+
+    // Return a float value.
+    static Value from_float(double x)
+    {
+        Value v;
+        v.type = FLOAT;
+        v.real = x;
+        return v;
+    }
+
+    // Return true for a float.
+    bool is_float() const { return type == FLOAT; }
+
+    // Return the value as a float.
+    double as_float() const { return type == FLOAT ? real : (double)integer; }
+
+    // Return the bits of the value.
+    uint64_t bits() const { return type == FLOAT ? std::bit_cast<uint64_t>(real) : (uint64_t)integer; }
+};
+
+//
+// Number is a constant: an integer or a float. It is a term of its own kind,
+// neither a variable nor a compound, and equal only to a number of the same
+// type and value. A number in a clause template is shared by all instances
+// of the clause.
+//
+class Number : public Term {
+    Value value;
+
+public:
+    // Create a number with the given value.
+    explicit Number(Value v) : value(v) {}
+
+    // Create a number with the given value.
+    static Number *create(Value v) { return new Number(v); }
+
+    // Return the value of this number.
+    const Value &get_value() const { return value; }
+
+    // Return true when the other number has the same type and value.
+    // Floats are compared bit by bit, so a float is always equal to itself.
+    bool same(const Number *n) const
+    {
+        return value.type == n->value.type && value.bits() == n->value.bits();
+    }
+
+    // Return a key of the value, for indexing: equal numbers have the same key.
+    uint64_t hash() const { return (value.bits() * 0x9e3779b97f4a7c15) ^ value.type; }
+
+    // Room for the text of any value.
+    static constexpr size_t max_text = 32;
+
+    // Write the value to the text, which has room for max_text characters; return its length.
+    // A float always has a fraction or an exponent.
+    size_t format(char *text) const;
+
+    // Print the value, as format() writes it.
+    void print_value(std::ostream &out) const
+    {
+        char text[max_text];
+        out.write(text, format(text));
+    }
+
+    // This term is a number.
+    Number *as_number() override { return this; }
+
+    // Match this template number to the term: the same number, or an unbound variable.
+    bool match(Term *t, Term **) override
+    {
+        Term *d = t->deref();
+        if (d->as_variable())
+            return d->unify(this);
+        Number *n = d->as_number();
+        return n && same(n);
+    }
+
+    // A number is its own instance.
+    Term *instantiate(Term **) override { return this; }
+};
+
+//
+// Variables are placeholders for arbitrary terms.
+// A variable can become instantiated (bound to a term) via unification.
+// Variables are identified by a unique index, assigned sequentially starting from 1.
+// Variables of a clause template also have a slot number in the binding frame.
+//
+class Variable : public Term {
+    friend class Collector;
+
+    Term *instance;
+    uint64_t index; // Never wraps, so that trailing can compare it with a boundary
+    int slot{ -1 };
+
+public:
+    Variable() : instance(this), index(++Engine::current().timestamp) {}
+
+    // Make this variable a member of a clause template.
+    void set_slot(int s) { slot = s; }
+
+    // Return the slot of this template variable, or -1 for a plain variable.
+    int get_slot() const { return slot; }
+
+    // Return the index of this variable.
+    uint64_t get_index() const { return index; }
+
+    // Return the index of the most recently created variable.
+    static uint64_t latest() { return Engine::current().timestamp; }
+
+    // Unbind this variable.
+    void reset() { instance = this; }
+
+    // Return the term this variable is bound to, or the variable itself when unbound.
+    Term *binding() const { return instance; }
+
+    // Bind this variable again, after a temporary reset.
+    void rebind(Term *t) { instance = t; }
+
+    // Bind this unbound variable to the term, and trail it when needed.
+    void bind(Term *t);
+
+    // Return the term this variable is bound to; an unbound variable
+    // is bound to a fresh one first, which is its copy.
+    Term *rename();
+
+    // Return the term at the end of the chain of bindings.
+    Term *deref() override
+    {
+        Variable *v = this;
+        while (v->instance != v) {
+            Variable *next = v->instance->as_variable();
+            if (!next)
+                return v->instance;
+            v = next;
+        }
+        return v;
+    }
+
+    // Return the compound this variable is bound to.
+    Compound *as_compound() override
+    {
+        Term *t = deref();
+        return t->as_variable() ? nullptr : t->as_compound();
+    }
+
+    // Return the number this variable is bound to.
+    Number *as_number() override
+    {
+        Term *t = deref();
+        return t->as_variable() ? nullptr : t->as_number();
+    }
+
+    // This term is a variable.
+    Variable *as_variable() override { return this; }
+
+    // Bind the slot of this template variable, or match the existing binding.
+    // A variable which is not a part of a template behaves as a plain term.
+    bool match(Term *t, Term **frame) override
+    {
+        if (slot < 0)
+            return unify(t);
+        if (!frame[slot]) {
+            frame[slot] = t;
+            return true;
+        }
+        return frame[slot]->unify(t);
+    }
+
+    // Return the term bound to the slot of this template variable,
+    // or a fresh variable when the slot is still empty.
+    Term *instantiate(Term **frame) override
+    {
+        if (slot < 0)
+            return this;
+        if (!frame[slot]) {
+            COUNT(cells);
+            frame[slot] = new Variable();
+        }
+        return frame[slot];
+    }
+};
+
+//
+// Constants is the pool of the ground terms of clause templates.
+// Identical ground terms are kept once, so that instances of clauses
+// refer to them instead of copying them, and two pooled terms are equal
+// only when they are the same object. The pool has an engine of its own,
+// which is never released: pooled terms live as long as the process.
+//
+class Constants {
+    //
+    // Hash of a pooled term: its functor and the addresses of its arguments,
+    // which are pooled already, or the value of a number.
+    //
+    struct Hash {
+        size_t operator()(const Compound *c) const;
+    };
+
+    //
+    // Equality of pooled terms: the same functor and arguments, or the same number.
+    //
+    struct Equal {
+        bool operator()(const Compound *a, const Compound *b) const;
+    };
+
+    static std::mutex lock;
+    static std::unordered_set<Compound *, Hash, Equal> pool;
+
+    // Return the engine which holds the pooled terms.
+    static Engine &engine();
+
+    // Return the pooled copy of a ground term, whose arguments are pooled.
+    static Compound *intern(Compound *c);
+
+public:
+    // Replace the ground subterms of the template with their pooled copies.
+    // Return the template, or its pooled copy when it is ground itself.
+    static Compound *share(Compound *c);
+
+    // Return the number of pooled terms.
+    static size_t size();
+};
+
+class Program;
+class VarMapping;
+class Arithmetic;
+
+//
+// Goal is a list of compounds:
+//      a(); b(); c()
+// An arithmetic goal in the body of a clause also keeps its compiled code.
+//
+class Goal : public HeapObject {
+    friend class Collector;
+
+    Compound *head;
+    Goal *tail;
+    const Arithmetic *arithmetic{ nullptr };
+
+public:
+    // Create a goal with given head and tail.
+    Goal(Compound *h, Goal *t = nullptr) : head(h), tail(t) {}
+
+    // Return the first compound of this list.
+    Compound *get_head() const { return head; }
+
+    // Return the rest of this list.
+    Goal *get_tail() const { return tail; }
+
+    // Return the compiled code of this arithmetic goal, or nullptr.
+    const Arithmetic *get_arithmetic() const { return arithmetic; }
+
+    // Set the compiled code of this arithmetic goal.
+    void set_arithmetic(const Arithmetic *a) { arithmetic = a; }
+
+    // Replace the ground subterms of this template goal with pooled ones.
+    void share_ground() { head = Constants::share(head); }
+
+    // Return a copy of this goal.
+    Goal *copy()
+    {
+        return new Goal(head->copy_compound(), tail ? tail->copy() : nullptr);
+    }
+
+    // Append a goal to this list.
+    Goal *append(Goal *l)
+    {
+        return new Goal(head, tail ? tail->append(l) : nullptr);
+    }
+
+    // Return true when some goal of this list is a cut.
+    bool cuts() const;
+
+    // Solve the problem, without tracing.
+    void solve(Program *prog, int level, VarMapping *vars);
+
+    // Solve the problem, reporting the progress to the tracer.
+    template <class Tracer>
+    void solve(Program *prog, int level, VarMapping *vars, Tracer &tracer);
+
+    // Print this list.
+    void print(std::ostream &out = std::cout) const;
+
+    // Print n*4 spaces.
+    static void indent(int n, std::ostream &out = std::cout)
+    {
+        for (int i = 0; i < n; i++)
+            out << "    ";
+    }
+};
+
+//
+// Clause consists of a head (compound) and a goal (list of compounds):
+//      head() :- a(); b(); c().
+// The clause keeps a renamed copy of the terms it was given, as a template:
+// its variables are numbered, and are bound in a frame when the clause is used.
+// Clauses are numbered sequentially starting from 1.
+// A clause of a dynamic predicate is seen by the calls between the generations
+// when it was asserted and retracted (see Database).
+//
+class Clause : public HeapObject {
+    static std::atomic<unsigned> count;
+
+public:
+    Compound *head;
+    Goal *body;
+    int nvars;
+    unsigned number;
+    uint64_t born{ 0 };                          // Generation when the clause was asserted
+    std::atomic<uint64_t> erased{ UINT64_MAX }; // Generation when the clause was retracted
+    Clause(Compound *h, Goal *t = nullptr);
+
+    // Make a clause of terms which are a template already: their variables have slots below n.
+    // Unless shared, ground subterms stay in the clause rather than going to the pool of constants.
+    Clause(Compound *h, Goal *t, int n, bool shared = true) : head(h), body(t), nvars(n), number(++count)
+    {
+        if (shared)
+            share_ground();
+        compile_arithmetic();
+    }
+
+    // Return true when a call made at the given generation sees this clause.
+    bool visible(uint64_t generation) const
+    {
+        return born <= generation && generation < erased.load(std::memory_order_relaxed);
+    }
+
+    // Replace the ground subterms of the head and the body with pooled ones (see Constants).
+    void share_ground();
+
+    // Compile the arithmetic goals of the body.
+    void compile_arithmetic();
+
+    // Allocate a frame for the variables of this clause.
+    // The size of the frame is kept in the word before it, for the garbage collector.
+    [[nodiscard]] Term **new_frame() const
+    {
+        auto *words = static_cast<uintptr_t *>(Engine::current().heap.allocate((nvars + 1) * sizeof(Term *)));
+        words[0] = nvars;
+        auto **frame = reinterpret_cast<Term **>(words + 1);
+        std::fill(frame, frame + nvars, nullptr);
+        return frame;
+    }
+
+    // Return the number of variables in a frame made by new_frame().
+    static size_t frame_size(Term *const *frame) { return reinterpret_cast<const uintptr_t *>(frame)[-1]; }
+
+    // Return a copy of this clause.
+    [[nodiscard]] Clause *copy() const
+    {
+        return new Clause(head->copy_compound(), body ? body->copy() : nullptr);
+    }
+
+    // Print this clause.
+    void print(std::ostream &out = std::cout) const;
+};
+
+//
+// Freezer makes templates of terms which are being solved, for example
+// to move them to another engine, or to keep them after backtracking.
+// Bound variables are replaced by their values, and unbound ones
+// by template variables, numbered in the order of appearance.
+// The copy is allocated in the current engine; pooled terms are shared.
+//
+class Freezer {
+    std::unordered_map<Term *, Variable *> vars;
+
+public:
+    // Return a template copy of the term.
+    Term *copy(Term *t)
+    {
+        t = t->deref();
+        if (Number *n = t->as_number())
+            return Number::create(n->get_value());
+        Compound *c = t->as_compound();
+        if (!c) {
+            Variable *&v = vars[t];
+            if (!v) {
+                v = new Variable();
+                v->set_slot(vars.size() - 1);
+            }
+            return v;
+        }
+        if (c->is_pooled())
+            return c;
+        std::vector<Term *> args(c->get_arity());
+        for (int i = 0; i < c->get_arity(); i++)
+            args[i] = copy(c->arg(i));
+        return Compound::create(c->get_functor(), args.size(), args.data());
+    }
+
+    // Return a template copy of the compound.
+    Compound *copy_compound(Compound *c) { return static_cast<Compound *>(copy(c)); }
+
+    // Return a template copy of the list of goals.
+    Goal *copy_goals(const std::vector<Compound *> &goals)
+    {
+        Goal *list = nullptr;
+        for (size_t i = goals.size(); i > 0; i--)
+            list = new Goal(copy_compound(goals[i - 1]), list);
+        return list;
+    }
+
+    // Return the number of variables in the template.
+    int size() const { return vars.size(); }
+};
+
+class Index;
+class Database;
+
+//
+// Clauses which can possibly match a goal, as the call sees them.
+// For a dynamic predicate, some of them can be invisible at the generation of the call.
+//
+struct Candidates {
+    static constexpr uint64_t all = UINT64_MAX; // Generation of static clauses: all are visible
+
+    Clause *const *clauses;
+    size_t count;
+    uint64_t generation{ all };
+};
+
+//
+// Program is a list of clauses.
+// Its index is built once, on first lookup from any thread.
+// Clauses asserted and retracted later are kept in the database of the index.
+//
+class Program {
+    Index *index{ nullptr };
+    std::once_flag indexed;
+
+public:
+    Clause *head;
+    Program *tail;
+    Program(Clause *h, Program *t = nullptr) : head(h), tail(t) {}
+
+    // Return the clauses which can possibly match the given goal, in program order.
+    Candidates lookup(Compound *goal);
+
+    // Return the dynamic database of the program.
+    Database &database();
+
+    // Return true when the goal can be solved apart from the goals around it (see Index::pure).
+    bool pure(const Compound *goal);
+
+    // Return the number of changes which can make pure goals impure.
+    uint64_t purity_changes();
+};
+
+//
+// Database keeps the predicates changed by assert and retract while queries run,
+// with the logical update view: a call sees the clauses as they were when it was made.
+// Clauses are stamped with the generations when they were asserted and retracted,
+// and every change starts a new generation. The clauses of a predicate, and of its
+// buckets by an argument, are kept in lists which grow at both ends in place,
+// and are replaced when full; retracted clauses stay in the lists until most
+// clauses of the predicate are retracted, and then the lists are rebuilt.
+// Readers take the lists without locks: writers take a lock, publish with
+// release stores, and hand the lists and clauses they replace to Epochs.
+// An asserted clause is copied into a heap of its own, which is freed with it.
+// The first change of a static predicate takes its clauses into the database.
+// Calls of the abstract machine (see Machine) see only the static program.
+//
+class Database {
+    struct ClauseList;
+    struct ArgTable;
+    struct Predicate;
+    struct Predicates;
+    struct Record;
+    struct Dropped;
+
+    Index &index;
+    std::atomic<Predicates *> predicates{ nullptr };
+    std::atomic<uint64_t> generation{ 0 };
+    std::mutex lock;
+    Engine builder;                                         // Engine where clauses are copied
+    std::unordered_map<const Clause *, Record *> records;   // Asserted clauses, and their terms until retracted
+
+    // Return the predicate of the key, or nullptr when it is static; the lock is not needed.
+    Predicate *find(uint64_t key) const;
+
+    // Return the predicate of the key, taking the static clauses when it has any.
+    // The lock is held.
+    Predicate &take(uint64_t key, int arity);
+
+    // Build the index of the predicate on the argument at the given position.
+    ArgTable *build(Predicate &pred, int position);
+
+    // Add the clause to the lists of the predicate; the lock is held.
+    void insert(Predicate &pred, Clause *cl, bool at_end);
+
+    // Mark the clauses retracted, and rebuild the lists when most clauses are;
+    // return the number of clauses retracted. The lock is not held.
+    size_t erase(const std::vector<Clause *> &clauses);
+
+    // Drop the retracted clauses from the lists of the predicate; the lock is held.
+    void compact(Predicate &pred);
+
+public:
+    explicit Database(Index &i) : index(i) {}
+    Database(const Database &) = delete;
+    Database &operator=(const Database &) = delete;
+
+    // Return true when no predicate has been changed.
+    bool empty() const { return !predicates.load(std::memory_order_acquire); }
+
+    // Find the clauses of a changed predicate which can match the goal;
+    // return false when the predicate is static.
+    bool lookup(Compound *goal, Candidates &result);
+
+    // Add a clause, given as a term Head :- Body or Head, at the start or at the end of its predicate.
+    // Return false when the term is not a clause.
+    bool add(Term *clause, bool at_end);
+
+    // Remove the first clause which unifies with the term, Head :- Body or Head, and the bindings stay.
+    // The state, zero at first, keeps the generation of the first call, for calls on backtracking;
+    // the flag is set when no clause could match after this one.
+    // Return false when no clause unifies.
+    bool retract(Term *clause, uint64_t &state, bool &last);
+
+    // Remove all clauses whose head unifies with the term; return the number of them.
+    size_t retract_all(Term *head);
+
+    // Return the current generation.
+    uint64_t current() const { return generation.load(std::memory_order_acquire); }
+
+    // Return true when the predicate of the key has been changed.
+    bool changed(uint64_t key) const { return find(key) != nullptr; }
+};
+
+//
+// Index of the clauses of a program.
+// Clauses are grouped by predicate (functor and arity of the head),
+// and within a predicate by the principal functor of an argument,
+// or by the value of a number.
+// The first argument is indexed as usual; when it is unbound in the call,
+// an index on the first bound argument is built on demand.
+// Lookups from several threads are safe: an argument index is built
+// under a lock, and published atomically.
+//
+class Index {
+    //
+    // Clauses of one predicate, arranged by the key of one argument.
+    // A clause with a variable in this position appears in every bucket.
+    //
+    struct ArgIndex {
+        std::unordered_map<uint64_t, std::vector<Clause *>> buckets;
+        std::vector<Clause *> unbound;
+
+        // Distribute the clauses by their argument at the given position.
+        ArgIndex(const std::vector<Clause *> &clauses, int position);
+
+        // This index is useless when the argument is a variable in every clause.
+        [[nodiscard]] bool selective() const { return !buckets.empty(); }
+    };
+
+    //
+    // All clauses of one predicate, plus the argument indexes built so far.
+    //
+    struct Predicate {
+        std::vector<Clause *> clauses;
+        std::unique_ptr<std::atomic<ArgIndex *>[]> by_arg;
+    };
+
+    std::unordered_map<uint64_t, Predicate> predicates;
+    std::mutex lock;
+    std::unordered_map<uint64_t, bool> purity; // Predicates known to be pure or not, guarded by the lock
+    std::atomic<uint64_t> changes{ 0 };        // Predicates taken into the database
+    Database dynamic{ *this };
+    static const std::vector<Clause *> none;
+
+    // Build the index of the predicate on the argument at the given position.
+    ArgIndex *build(Predicate &pred, int position);
+
+    // Queue the predicates which the goal calls; return false when the goal is impure.
+    // The lock is held.
+    bool reach(const Compound *goal, std::vector<uint64_t> &work, std::unordered_set<uint64_t> &seen);
+
+public:
+    // Build the index for the list of clauses.
+    explicit Index(Program *prog);
+
+    // Return the clauses which can possibly match the given goal, in program order.
+    Candidates lookup(Compound *goal);
+
+    // Return the clauses of the predicate with the key as loaded, or nullptr when there are none.
+    const std::vector<Clause *> *loaded(uint64_t key) const
+    {
+        auto found = predicates.find(key);
+        return (found == predicates.end()) ? nullptr : &found->second.clauses;
+    }
+
+    // Return the dynamic database.
+    Database &database() { return dynamic; }
+
+    // Return true when the goal can be solved apart from the goals around it,
+    // at another time or twice, with the same outcome: it is not a cut,
+    // and neither it nor the clauses it reaches call an impure builtin,
+    // such as assert or retract, a goal known only when it runs,
+    // or a predicate which has been changed, or has no clauses in the program.
+    bool pure(const Compound *goal);
+
+    // Forget what is known of the purity of predicates, after a predicate is taken into the database.
+    void changed();
+
+    // Return the number of predicates taken into the database so far.
+    uint64_t purity_changes() const { return changes.load(std::memory_order_acquire); }
+
+    // Return the key of an argument which is not a variable: its principal functor,
+    // or the value of a number.
+    static uint64_t arg_key(Term *t)
+    {
+        Number *n = t->as_number();
+        return n ? n->hash() : static_cast<Compound *>(t)->key();
+    }
+};
+
+//
+// Trace records a sequence of variable instaitiations.
+// The trace is an array of variables; a position of the trace
+// also includes a position of the heap, and the index of the latest
+// variable created at that moment.
+// Only variables older than the latest choice point need trailing:
+// younger variables are released from the heap on backtracking anyway.
+// The trace lives in the current engine.
+//
+class Trace {
+public:
+    //
+    // Position of the trace and of the heap.
+    //
+    struct Mark {
+        size_t history;
+        uint64_t variables;
+        Heap::Mark heap;
+    };
+
+    // Return a current position of the trace.
+    static Mark Note()
+    {
+        Engine &e = Engine::current();
+        return { e.history.size(), e.timestamp, e.heap.mark() };
+    }
+
+    // Add a new variable to the trace.
+    static void Push(Variable *x)
+    {
+        COUNT(trailed);
+        Engine::current().history.push_back(x);
+    }
+
+    // Add a variable to the trace, when it is older than the latest choice point.
+    static void Bind(Variable *x)
+    {
+        Engine &e = Engine::current();
+        if (x->get_index() <= e.boundary) {
+            COUNT(trailed);
+            e.history.push_back(x);
+        }
+    }
+
+    // Set the index of the latest variable older than the latest choice point:
+    // such variables get trailed from now on.
+    static void Protect(uint64_t variables) { Engine::current().boundary = variables; }
+
+    // Return the index of the latest variable which gets trailed.
+    static uint64_t Boundary() { return Engine::current().boundary; }
+
+    // Return the variables instantiated after the given position, oldest first.
+    static std::vector<Variable *> Since(const Mark &whereto)
+    {
+        std::vector<Variable *> &history = Engine::current().history;
+        return { history.begin() + whereto.history, history.end() };
+    }
+
+    // Reset all instantiations up to the given position, but keep the heap.
+    static void Reset(const Mark &whereto)
+    {
+        std::vector<Variable *> &history = Engine::current().history;
+        while (history.size() > whereto.history) {
+            history.back()->reset();
+            history.pop_back();
+        }
+    }
+
+    // Reset all instantiations up to the given position,
+    // and release the heap allocated after it.
+    static void Undo(const Mark &whereto)
+    {
+        Reset(whereto);
+        Engine::current().heap.release(whereto.heap);
+    }
+
+    // Reset the instantiations made after the given position for a while:
+    // return them, oldest first, with the terms they were bound to.
+    static std::vector<std::pair<Variable *, Term *>> Suspend(const Mark &whereto)
+    {
+        std::vector<Variable *> &history = Engine::current().history;
+        std::vector<std::pair<Variable *, Term *>> bindings;
+        for (size_t i = whereto.history; i < history.size(); i++)
+            bindings.emplace_back(history[i], history[i]->binding());
+        Reset(whereto);
+        return bindings;
+    }
+
+    // Restore the suspended instantiations.
+    static void Restore(const std::vector<std::pair<Variable *, Term *>> &bindings)
+    {
+        std::vector<Variable *> &history = Engine::current().history;
+        for (auto [x, t] : bindings) {
+            x->rebind(t);
+            history.push_back(x);
+        }
+    }
+
+    // Drop the variables instantiated after the given position which are not
+    // older than the latest choice point: nothing resets them any more.
+    static void Forget(const Mark &whereto)
+    {
+        Engine &e = Engine::current();
+        auto first = e.history.begin() + whereto.history;
+        e.history.erase(std::remove_if(first, e.history.end(),
+                                       [&e](Variable *x) { return x->get_index() > e.boundary; }),
+                        e.history.end());
+    }
+};
+
+//
+// Table of variables and their names.
+//
+class VarMapping {
+private:
+    Variable **vars;
+    std::string *names;
+    int count;
+
+public:
+    VarMapping(Variable *vv[], std::string vt[], int vs) : vars(vv), names(vt), count(vs) {}
+
+    // Return the number of variables.
+    int size() const { return count; }
+
+    // Return the variable at the given position.
+    Variable *variable(int i) const { return vars[i]; }
+
+    // Return the name of the variable at the given position.
+    const std::string &name(int i) const { return names[i]; }
+
+    // Print variables and their instantiations to the output of the current engine.
+    void show_answer() const;
+};
+
+//
+// Tracing levels, which can be set per predicate.
+//
+enum TraceLevel {
+    TRACE_OFF,   // Nothing is reported
+    TRACE_CALLS, // Calls of goals
+    TRACE_ALL,   // Calls, and every clause tried
+};
+
+//
+// Tracer which reports nothing: all its methods compile away.
+// Other tracers provide the same methods. A tracer can also follow
+// the exit, redo and fail ports of goals, with methods exit(goal, level),
+// redo(goal, level) and fail(goal, level): the solver keeps track
+// of exits only for such tracers.
+//
+class NullTracer {
+public:
+    // A goal is called.
+    void call(Compound *, int) {}
+
+    // A clause is tried for the goal.
+    void attempt(Clause *, int) {}
+
+    // The head of the clause does not match the goal.
+    void nomatch(Clause *, int) {}
+
+    // Write out the buffered events.
+    void flush() {}
+};
+
+//
+// Continuation is what remains to be solved after a goal succeeds:
+// the rest of a clause body, the frame with the bindings of the clause
+// variables, the cut barrier of the clause, and the continuation of the clause itself.
+// Running a clause body creates one continuation, instead of a copy
+// of the body goals; a goal which is the last in its body needs none.
+//
+struct Continuation : public HeapObject {
+    Goal *body;
+    Term **frame;
+    Continuation *parent;
+    size_t barrier;
+
+    Continuation(Goal *b, Term **f, Continuation *p, size_t c) : body(b), frame(f), parent(p), barrier(c) {}
+};
+
+//
+// Collector frees the unreachable objects which a solver allocated: the part
+// of the heap above the position where the solver started. Objects reachable
+// from the roots given by the solver are marked, and then slid down, keeping
+// the order of allocation: a position of the heap taken before still
+// separates the same objects, and backtracking releases what it did before.
+// Objects are recognized by the type of the reference to them: terms, goals,
+// continuations, frames, clauses and arrays of clauses.
+// The roots are visited twice: first to mark, then, after compact(),
+// to update the references. Objects older than the collected part may refer
+// to it only from variables on the trail: their bindings are roots too.
+// Marks are bits, one per word of the collected part, and the place
+// of an object among the live ones is the number of marks below it:
+// neither marking nor forwarding needs a search.
+//
+class Collector {
+    //
+    // Kinds of objects.
+    //
+    enum Kind : unsigned char {
+        TERM,         // Compound or variable
+        GOAL,         // Element of a goal list
+        CONTINUATION, // Continuation of a clause body
+        FRAME,        // Frame of clause variables, after a word with its size
+        CLAUSE,       // Clause made while solving, such as a joined fact
+        CLAUSES,      // Array of clauses to try
+    };
+
+    //
+    // Reachable object: its position, and where it moves.
+    //
+    struct Object {
+        char *address;
+        size_t size;
+        size_t block;
+        Kind kind;
+        char *target;
+        size_t target_block;
+    };
+
+    //
+    // Part of a heap block which is being collected, with its marks.
+    //
+    struct Range {
+        char *base;
+        char *end;
+        size_t block;
+        std::vector<uint64_t> marks; // Bit per word: a live object starts there
+        std::vector<uint32_t> ranks; // Objects of the range below each word of marks
+        size_t first{ 0 };           // Objects in the ranges of lower blocks
+    };
+
+    Heap &heap;
+    Heap::Mark from;
+    Heap::Mark end;
+    bool forwarding{ false };
+    std::vector<Range> ranges; // In the order of addresses
+    Range *last{ nullptr };    // Range found last
+    std::vector<Object> live;
+    std::vector<size_t> pending;
+    std::unordered_map<Variable *, bool> older;
+    size_t used{ 0 };
+    size_t kept{ 0 };
+    std::chrono::steady_clock::time_point started;
+
+    // Return the range which holds the address, or nullptr when it is not collected.
+    Range *range(const void *p);
+
+    // Return true when the address is in the collected part of the heap.
+    bool inside(const void *p) { return range(p) != nullptr; }
+
+    // Return the place of the marked object at the address among the live objects.
+    static size_t rank(const Range &r, const char *address);
+
+    // Mark the object at the address of the range, once.
+    void mark(Range &r, char *address, Kind kind, size_t size);
+
+    // Return the address where the object at the given one of the range moves.
+    void *forward(const Range &r, void *p) const;
+
+    // Visit the references in the object, to mark or to update them.
+    void fields(const Object &o);
+
+    // Mark the object, or update the reference to it.
+    template <class T>
+    void reference(T *&p, Kind kind, size_t size)
+    {
+        Range *r = p ? range(p) : nullptr;
+        if (!r)
+            return;
+        if (forwarding)
+            p = static_cast<T *>(forward(*r, p));
+        else
+            mark(*r, reinterpret_cast<char *>(p), kind, size);
+    }
+
+public:
+    // Prepare to collect the heap above the given position.
+    Collector(Heap &h, const Heap::Mark &m);
+
+    // Mark the object, or update the reference to it.
+    void visit(Term *&t);
+    void visit(Compound *&c);
+    void visit(Variable *&v);
+    void visit(Goal *&g) { reference(g, GOAL, sizeof(Goal)); }
+    void visit(Continuation *&k) { reference(k, CONTINUATION, sizeof(Continuation)); }
+    void visit(Clause *&cl) { reference(cl, CLAUSE, sizeof(Clause)); }
+    void visit(Term **&frame);
+    void visit(Clause *const *&clauses, size_t count);
+
+    // Visit a variable on the trail, and its binding when the variable is older than the collected part.
+    void trailed(Variable *&v);
+
+    // Update a position of the heap: it moves with the objects above it.
+    void visit(Heap::Mark &m);
+
+    // Mark everything reachable from the roots, slide the objects down,
+    // and update the references between them. Then the roots must be visited again.
+    void compact();
+
+    // Add the statistics of this collection to the counters.
+    void finish(Counters &counters) const;
+
+    // Return the size of the live objects, after compact().
+    size_t live_size() const { return kept; }
+};
+
+//
+// Arithmetic solves the goals is/2 and the comparisons of numbers
+// (=:=, =\=, <, >, =< and >=). A goal in the body of a clause is compiled
+// when the clause is made: its expressions become straight-line code
+// of a stack machine, which takes the variables from the frame of the clause,
+// and allocates nothing but the number given by is/2. Other goals, such as
+// those of a query, are compiled from their instances on every call.
+// Integers have 64 bits, and an overflow is an error, as is an unbound
+// variable, or a term which is not an arithmetic expression:
+// the goal then fails. Overflows are also counted on the engine, so that
+// the caller can tell a wrong answer from an ordinary failure.
+//
+class Arithmetic {
+public:
+    //
+    // Relation of a goal.
+    //
+    enum Relation : uint8_t {
+        IS,            // X is E
+        EQUAL,         // E1 =:= E2
+        NOT_EQUAL,     // E1 =\= E2
+        LESS,          // E1 < E2
+        GREATER,       // E1 > E2
+        LESS_EQUAL,    // E1 =< E2
+        GREATER_EQUAL, // E1 >= E2
+    };
+
+    //
+    // Operations of the stack machine.
+    //
+    enum Op : uint8_t {
+        PUSH,     // Push a constant
+        LOAD,     // Push the value of a slot of the frame
+        EVAL,     // Push the value of a term
+        NEG,      // -X
+        PLUS,     // +X
+        ABS,      // abs(X)
+        SIGN,     // sign(X)
+        NOT,      // \X
+        ADD,      // X + Y
+        SUB,      // X - Y
+        MUL,      // X * Y
+        DIV,      // X / Y
+        IDIV,     // X // Y, truncating
+        FDIV,     // X div Y, flooring
+        MOD,      // X mod Y, with the sign of Y
+        REM,      // X rem Y, with the sign of X
+        MIN,      // min(X, Y)
+        MAX,      // max(X, Y)
+        SHL,      // X << Y
+        SHR,      // X >> Y
+        AND,      // X /\ Y
+        OR,       // X \/ Y
+        XOR,      // X xor Y
+        POWER,    // X ** Y, a float
+        IPOWER,   // X ^ Y, an integer for integers
+        FLOAT,    // float(X)
+        INTEGER,  // integer(X), rounded
+        TRUNCATE, // truncate(X)
+        ROUND,    // round(X)
+        CEILING,  // ceiling(X)
+        FLOOR,    // floor(X)
+        SQRT,     // sqrt(X)
+        EXP,      // exp(X)
+        LOG,      // log(X)
+        SIN,      // sin(X)
+        COS,      // cos(X)
+        ATAN,     // atan(X)
+    };
+
+    //
+    // Instruction: the operation, and its operand.
+    //
+    struct Instr {
+        Op op;
+        int slot;
+        Value value;
+        Term *term;
+    };
+
+private:
+    Relation relation;
+    Term *result; // Left side of is/2, matched in the frame
+    std::vector<Instr> code;
+
+    // Return the operation of an evaluable functor; false when there is none.
+    static bool operation(const Compound *c, Op &op);
+
+    // Append the code of the expression; return false when it is not one.
+    // Variables of a template are taken from the frame; other terms are followed.
+    static bool compile(Term *t, bool in_template, std::vector<Instr> &code);
+
+    // Run the code, pushing the results to the stack; return false on an error.
+    static bool run(const std::vector<Instr> &code, Term **frame, std::vector<Value> &stack);
+
+    // Apply the operation to the values on top of the stack; return false on an error.
+    static bool apply(Op op, std::vector<Value> &stack);
+
+    // Return true when two values are in the relation.
+    static bool compare(Relation r, const Value &a, const Value &b);
+
+    // Finish the goal with the values of its expressions.
+    static bool finish(Relation r, Term *left, Term **frame, const Value *values);
+
+    Arithmetic(Relation r, Term *t) : relation(r), result(t) {}
+
+public:
+    // Return true when the goal is arithmetic, and set its relation.
+    static bool relation_of(const Compound *goal, Relation &r);
+
+    // Compile an arithmetic goal of a clause template; return nullptr when it is not one.
+    static const Arithmetic *compile(Compound *goal);
+
+    // Solve the compiled goal, with the variables in the frame; return false when it fails.
+    bool solve(Term **frame) const;
+
+    // Solve an instance of an arithmetic goal; return false when it fails.
+    static bool solve(Compound *goal);
+
+    // Evaluate the expression; return false when it cannot be evaluated.
+    static bool evaluate(Term *t, Value &v);
+};
+
+//
+// Call of a foreign predicate: the program being solved, the goal,
+// and the state of a nondeterministic predicate.
+// A nondeterministic predicate is called with the state zero first.
+// It sets the state for its next attempt, and the flag last when
+// no attempt follows; an attempt which returns true is a solution.
+// The bindings of every attempt are undone before the next one.
+// The state must not refer to the heap, which is released on backtracking.
+// A deterministic predicate can give goals to solve in place of the call,
+// as the body: they get a cut barrier of their own.
+// A predicate which solves goals with a solver of its own gives it
+// the tables and the fork of the caller.
+//
+class Fork;
+class Tabling;
+
+struct ForeignCall {
+    Program *program;
+    Compound *goal;
+    uint64_t state;
+    bool last;
+    Goal *body{ nullptr };
+    Tabling *tabling{ nullptr }; // Tables of the caller, if any
+    Fork *fork{ nullptr };       // Fork of the caller, if any
+
+    // Return the argument at the given position, counting from 0, at the end of its bindings.
+    Term *arg(int i) const { return goal->arg(i)->deref(); }
+};
+
+//
+// Predicate implemented in C++: a function of the call, which returns true on success.
+//
+using Foreign = std::function<bool(ForeignCall &call)>;
+
+//
+// Builtin predicate, one arity of its name.
+//
+struct Builtin {
+    int arity;
+    bool deterministic;
+    bool pure;     // Changes nothing but its bindings, and calls no goals
+    Foreign function;
+    Builtin *next; // Another arity of the same name
+};
+
+//
+// Builtins is the registry of the predicates implemented in C++: the standard
+// ones, and those which the application adds. A builtin is found by the name
+// and arity of a goal, and takes precedence over the clauses of the program.
+// The solver calls a deterministic builtin in place, while a nondeterministic
+// one gets a choice point, which calls it again on backtracking.
+// The table is indexed by the atom ID, so a goal which is not a builtin
+// costs a single load. Registration is not synchronized with lookups:
+// add the foreign predicates before solving.
+//
+class Builtins {
+    // Return the table, with the standard builtins on first use.
+    static std::vector<Builtin *> &table();
+
+    // Add the standard builtins to the table.
+    static void standard(std::vector<Builtin *> &t);
+
+    // Add the predicate to the table, replacing one of the same arity.
+    static void add(std::vector<Builtin *> &t, Atom *name, int arity, Foreign f, bool deterministic, bool pure);
+
+public:
+    // Add a predicate, which succeeds at most once. A pure predicate changes
+    // nothing but the bindings of its arguments, and calls no goals:
+    // only such predicates are solved together with others by a fork.
+    static void add(Atom *name, int arity, Foreign f, bool pure = false)
+    {
+        add(table(), name, arity, std::move(f), true, pure);
+    }
+
+    // Add a predicate, which can have several solutions (see ForeignCall).
+    static void add_nondeterministic(Atom *name, int arity, Foreign f, bool pure = false)
+    {
+        add(table(), name, arity, std::move(f), false, pure);
+    }
+
+    // Return the builtin for the goal, or nullptr.
+    static const Builtin *find(const Compound *goal)
+    {
+        const std::vector<Builtin *> &t = table();
+        unsigned id = goal->get_functor()->get_id();
+        for (Builtin *b = (id < t.size()) ? t[id] : nullptr; b; b = b->next)
+            if (b->arity == goal->get_arity())
+                return b;
+        return nullptr;
+    }
+};
+
+//
+// Fork solves goals which share no unbound variables, possibly
+// at the same time (see AndParallel). The solutions are joined
+// into facts for a goal $join(g1, ..., gn), which has the goals
+// as arguments: one fact per combination of solutions, in the order
+// of the sequential solver. A fork can decline goals which have too many
+// solutions, or take too long: the solver then calls them one by one.
+// So the goals are solved again, and a fork is given only pure goals
+// (see Index::pure), whose solving changes nothing the solver can see.
+//
+class Fork {
+public:
+    virtual ~Fork() = default;
+
+    // Solve the goals, with the tables if any, and return the facts of their joined goal,
+    // or nullptr when the fork declines them.
+    // The facts, and the array of them, are allocated in the current engine.
+    virtual Clause *const *join(Program *prog, Tabling *tabling, Compound *const *goals, int n, size_t &count) = 0;
+};
+
+//
+// Tabling keeps the answers of calls of selected predicates (see Tables).
+// A tabled goal is resolved against facts, one per answer,
+// instead of the clauses of the program.
+//
+class Tabling {
+public:
+    virtual ~Tabling() = default;
+
+    // Return true when calls of the predicate of the goal are tabled.
+    virtual bool tabled(const Compound *goal) const = 0;
+
+    // Return the clauses to resolve the tabled goal with.
+    // The array stays valid while the heap of the current engine is not released.
+    virtual Clause *const *answers(Program *prog, Compound *goal, size_t &count) = 0;
+};
+
+//
+// Solver finds the solutions of a goal one by one, without recursion:
+// the alternatives which remain to be tried are kept
+// on an explicit stack of choice points.
+// A clause body remembers the height of the stack when its goal was called
+// (the cut barrier): a cut in the body removes the choice points above it.
+// The goals call(G) and once(G) are builtins, which give G as a body
+// of its own to solve in place of the call, followed by a cut for once(G).
+// Arithmetic goals are solved in place, without a choice point (see Arithmetic),
+// and so are deterministic builtins (see Builtins).
+// The progress is reported to a tracer, which is a template parameter,
+// so that disabled tracing costs nothing. For a tracer of exits, a clause body
+// is followed by a goal $exit(G), which reports the exit of its goal G.
+// When the heap grows by the threshold of the engine, or by more when much
+// data survived the last collection, the garbage made by the solver
+// is collected (see Collector).
+// The solver is a reader of the dynamic clauses (see Epochs) while it exists,
+// and a call of a dynamic predicate tries the clauses visible at its generation.
+//
+template <class Tracer = NullTracer>
+class Solver {
+    //
+    // Choice point records a called goal, its continuation, the clauses
+    // which can match it, and the position of the trace when the goal was called.
+    // For a nondeterministic builtin, it keeps the state of the builtin instead of clauses.
+    // For a dynamic predicate, it keeps the generation of the call.
+    //
+    struct ChoicePoint {
+        Compound *goal;
+        Goal *body;
+        Term **frame;
+        Continuation *parent;
+        size_t barrier;
+        int level;
+        Clause *const *candidates;
+        size_t count;
+        size_t next;
+        Trace::Mark mark;
+        const Builtin *builtin{ nullptr };
+        uint64_t state{ 0 };
+        uint64_t generation{ Candidates::all };
+    };
+
+    // The tracer follows the exit, redo and fail ports.
+    static constexpr bool ports = requires(Tracer &t, Compound *g) {
+        t.exit(g, 0);
+        t.redo(g, 0);
+        t.fail(g, 0);
+    };
+
+    // The tracer looks at no goals, so they need no instances.
+    static constexpr bool silent = std::is_same_v<Tracer, NullTracer>;
+
+    //
+    // Goals at the start of a clause body which a fork could solve together:
+    // the number of pure goals among them, and whether the fork
+    // has declined them once.
+    //
+    struct Conjunction {
+        size_t length;
+        bool declined{ false };
+        uint64_t changes{ 0 }; // Of the purity of predicates, when the length was found
+    };
+
+    Epochs::Reader reader;
+    Program *prog;
+    Tracer &tracer;
+
+    // Current goal list, frame of its variables (or nullptr for the query),
+    // continuation, and cut barrier.
+    Goal *body;
+    Term **frame;
+    Continuation *parent{ nullptr };
+    size_t barrier{ 0 };
+    int level;
+
+    bool solved{ false };
+    bool failed{ false };
+    size_t limit{ SIZE_MAX };       // Number of solutions to find at most
+    size_t found{ 0 };              // Number of solutions found so far
+    Fork *fork{ nullptr };
+    Tabling *tabling{ nullptr };
+    std::unordered_map<const Goal *, Conjunction> conjunctions; // Bodies seen by independent()
+    std::vector<ChoicePoint> choices;
+    Trace::Mark start;
+    uint64_t outer;
+    size_t collect_at;              // Heap block which triggers the next collection
+
+    // Resume the latest choice point with its next matching clause.
+    // Return false when no alternatives are left.
+    bool backtrack();
+
+    // Call the nondeterministic builtin of the latest choice point again, and continue
+    // with its solution; the choice point is removed after the last attempt.
+    // Return false when the attempt fails.
+    bool retry(ChoicePoint &cp, size_t depth, size_t &tried);
+
+    // Continue after a goal which is solved in place, such as arithmetic:
+    // with the rest of the body on success, or else with an alternative.
+    // Return false when no alternatives are left.
+    bool proceed(Compound *goal, Goal *rest, bool success);
+
+    // Return the goals at the start of the body which share no unbound variables,
+    // the first one given as an instance.
+    std::vector<Compound *> independent(Compound *first);
+
+    // Collect the unbound variables of the term; variables of a template
+    // are taken from the frame, so that the term needs no instance.
+    static void unbound(Term *t, Term **frame, std::vector<Term *> &vars);
+
+    // Return a continuation which reports the exit of the goal, and proceeds to the parent.
+    static Continuation *exit_marker(Compound *goal, Continuation *p, size_t b)
+    {
+        static Atom *const exit_atom = Atom::intern("$exit");
+        return new Continuation(new Goal(Compound::create(exit_atom, { goal })), nullptr, p, b);
+    }
+
+    // Pass over the candidates which the call does not see: clauses asserted
+    // after it, or retracted before it.
+    static void skip_invisible(ChoicePoint &cp)
+    {
+        if (cp.generation != Candidates::all)
+            while (cp.next < cp.count && !cp.candidates[cp.next]->visible(cp.generation))
+                cp.next++;
+    }
+
+    // Return true when a cut could remove the oldest choice point later:
+    // a cut in the clauses it is trying, or in its continuation, in a body
+    // whose barrier is below the choice point.
+    static bool cut_ahead(const ChoicePoint &cp)
+    {
+        for (size_t i = cp.next ? cp.next - 1 : 0; i < cp.count; i++)
+            if (cp.candidates[i]->body && cp.candidates[i]->body->cuts())
+                return true;
+        if (cp.barrier == 0 && cp.body && cp.body->cuts())
+            return true;
+        for (const Continuation *c = cp.parent; c; c = c->parent)
+            if (c->barrier == 0 && c->body && c->body->cuts())
+                return true;
+        return false;
+    }
+
+    // Heap growth between collections, in proportion to the data which survived the last one:
+    // the work of a collection is then paid for by as much new allocation.
+    static constexpr size_t growth_factor = 2;
+
+    // Return the heap block which triggers a collection, for the heap at the given block
+    // with the given size of live data: the heap grows by the threshold of the engine,
+    // or by growth_factor times the live data, when that is more.
+    static size_t collection_block(size_t block, size_t live = 0)
+    {
+        size_t threshold = Engine::current().gc_threshold;
+        if (!threshold)
+            return SIZE_MAX;
+        size_t growth = std::max(threshold, live * growth_factor);
+        return block + std::max<size_t>(growth / Heap::block_size, 1);
+    }
+
+    // Visit the references from the solver to the heap: the current state,
+    // the choice points, and the variables on the trail.
+    void roots(Collector &gc);
+
+    // Free the unreachable objects allocated by the solver.
+    void collect();
+
+    // Tell the trace where the latest choice point is.
+    void protect() const { Trace::Protect((choices.empty() ? start : choices.back().mark).variables); }
+
+    // Remove the choice points above the barrier.
+    void cut(size_t to)
+    {
+        if (choices.size() > to) {
+            choices.resize(to);
+            protect();
+        }
+    }
+
+    // Return a tracer for solvers created without one.
+    static Tracer &default_tracer()
+    {
+        static thread_local Tracer none;
+        return none;
+    }
+
+public:
+    //
+    // Outcome of running the solver for a limited number of calls.
+    //
+    enum Status {
+        SOLVED,    // A solution is found
+        SUSPENDED, // The limit is reached: the search can be resumed
+        FAILED,    // There are no more solutions
+    };
+
+    // Solve the goals of a template, with the variables in the frame.
+    // The frame must have all its slots set, as it is not collected.
+    Solver(Program *p, Goal *g, Term **f, Tracer &t, int l = 0)
+        : prog(p), tracer(t), body(g), frame(f), level(l),
+          start(Trace::Note()), outer(Trace::Boundary()), collect_at(collection_block(start.heap.block))
+    {
+    }
+    Solver(Program *p, Goal *g, Tracer &t, int l = 0) : Solver(p, g, nullptr, t, l) {}
+    explicit Solver(Program *p, Goal *g, int l = 0) : Solver(p, g, nullptr, default_tracer(), l) {}
+    Solver(Program *p, Goal *g, Term **f, int l = 0) : Solver(p, g, f, default_tracer(), l) {}
+    Solver(const Solver &) = delete;
+    Solver &operator=(const Solver &) = delete;
+
+    // Reset the variables bound by the solver, and restore trailing for the caller.
+    ~Solver()
+    {
+        Trace::Undo(start);
+        Trace::Protect(outer);
+    }
+
+    // Search until the next solution, or until the given number of goals is called.
+    Status run(size_t steps);
+
+    // Find the next solution; return false when there are no more.
+    // With a deadline in the engine, the search runs in slices, and stops when it passes.
+    bool next()
+    {
+        const Deadline *deadline = Engine::current().deadline;
+        if (!deadline)
+            return run(SIZE_MAX) == SOLVED;
+
+        Status status;
+        do {
+            if (deadline->expired())
+                return false;
+        } while ((status = run(Deadline::slice)) == SUSPENDED);
+        return status == SOLVED;
+    }
+
+    // Return true when no alternatives remain after the last solution.
+    bool determinate() const { return choices.empty(); }
+
+    // Stop the search for good after the given number of solutions.
+    void set_limit(size_t max_solutions) { limit = max_solutions; }
+
+    // Solve independent goals of a body with the fork, from now on.
+    void set_fork(Fork *f) { fork = f; }
+
+    // Take the answers of tabled predicates from the tables, from now on.
+    void set_tabling(Tabling *t) { tabling = t; }
+
+    // Give away the untried clauses of the oldest choice point: the solver
+    // will not try them. The visitor gets the goal, its continuation and
+    // the clauses, while the bindings made after the choice point are reset.
+    // Return false when there are no alternatives, when a cut could
+    // remove the choice point later (see cut_ahead), or when its predicate is dynamic.
+    template <class Visitor>
+    bool donate(Visitor &&visit);
+};
+
+//
+// Search until the next solution, or until the given number of goals is called.
+//
+template <class Tracer>
+typename Solver<Tracer>::Status Solver<Tracer>::run(size_t steps)
+{
+    if (failed)
+        return FAILED;
+    const Heap &heap = Engine::current().heap;
+    if (solved) {
+        // Continue the search after the previous solution.
+        solved = false;
+        if (!backtrack())
+            return FAILED;
+    }
+
+    for (;;) {
+        // Return from finished clause bodies.
+        while (!body && parent) {
+            body = parent->body;
+            frame = parent->frame;
+            barrier = parent->barrier;
+            parent = parent->parent;
+        }
+        if (!body) {
+            // A nested solver stopped by the deadline failed a goal
+            // which could have succeeded: this is no solution.
+            if (const Deadline *deadline = Engine::current().deadline; deadline && deadline->expired()) {
+                failed = true;
+                return FAILED;
+            }
+            // The last solution allowed needs no alternatives.
+            if (++found == limit)
+                cut(0);
+            solved = true;
+            return SOLVED;
+        }
+        if (steps-- == 0)
+            return SUSPENDED;
+        if (heap.mark().block >= collect_at)
+            collect();
+
+        // Run the compiled code of an arithmetic goal: the goal
+        // needs an instance only for a tracer.
+        if (const Arithmetic *code = body->get_arithmetic(); code && frame) {
+            Compound *goal = body->get_head();
+            if constexpr (!silent)
+                goal = static_cast<Compound *>(goal->instantiate(frame));
+            tracer.call(goal, level);
+            COUNT(calls);
+            if (!proceed(goal, body->get_tail(), code->solve(frame)))
+                return FAILED;
+            continue;
+        }
+
+        // Instantiate the next goal of the clause body.
+        Compound *goal = body->get_head();
+        if (frame)
+            goal = static_cast<Compound *>(goal->instantiate(frame));
+        Goal *rest = body->get_tail();
+
+        // Control constructs.
+        static Atom *const cut_atom = Atom::intern("!");
+        if constexpr (ports) {
+            static Atom *const exit_atom = Atom::intern("$exit");
+            if (goal->get_functor() == exit_atom) {
+                tracer.exit(goal->arg(0)->as_compound(), level);
+                body = rest;
+                continue;
+            }
+        }
+        if (goal->get_functor() == cut_atom && goal->get_arity() == 0) {
+            tracer.call(goal, level);
+            COUNT(calls);
+            cut(barrier);
+            if constexpr (ports)
+                tracer.exit(goal, level);
+            body = rest;
+            continue;
+        }
+        if (const Builtin *b = Builtins::find(goal)) {
+            tracer.call(goal, level);
+            COUNT(calls);
+            if (b->deterministic) {
+                ForeignCall call{ prog, goal, 0, true, nullptr, tabling, fork };
+                bool success = b->function(call);
+                if (success && call.body) {
+                    // Solve the goals of the builtin with a barrier of their own.
+                    Continuation *after = rest ? new Continuation(rest, frame, parent, barrier) : parent;
+                    if constexpr (ports)
+                        after = exit_marker(goal, after, barrier);
+                    parent = after;
+                    body = call.body;
+                    frame = nullptr;
+                    barrier = choices.size();
+                    continue;
+                }
+                if (!proceed(goal, rest, success))
+                    return FAILED;
+                continue;
+            }
+            COUNT(choicepoints);
+            choices.push_back({ goal, rest, frame, parent, barrier, level, nullptr, 0, 0, Trace::Note(), b });
+            protect();
+            if (!backtrack())
+                return FAILED;
+            continue;
+        }
+
+        Clause *const *candidates = nullptr;
+        size_t count;
+        uint64_t generation = Candidates::all;
+        if (fork && rest) {
+            std::vector<Compound *> group = independent(goal);
+            if (group.size() > 1) {
+                candidates = fork->join(prog, tabling, group.data(), group.size(), count);
+                if (candidates) {
+                    // Call the joined goal of the independent goals instead.
+                    static Atom *const join = Atom::intern("$join");
+                    std::vector<Term *> args(group.begin(), group.end());
+                    goal = Compound::create(join, args.size(), args.data());
+                    for (size_t i = 1; i < group.size(); i++)
+                        rest = rest->get_tail();
+                } else if (frame) {
+                    conjunctions[body].declined = true;
+                }
+            }
+        }
+        if (candidates) {
+            // Joined already.
+        } else if (tabling && tabling->tabled(goal)) {
+            candidates = tabling->answers(prog, goal, count);
+        } else {
+            Candidates found = prog->lookup(goal);
+            candidates = found.clauses;
+            count = found.count;
+            generation = found.generation;
+        }
+        tracer.call(goal, level);
+        COUNT(calls);
+        COUNT(choicepoints);
+
+        // Remember the clauses which can match this goal.
+        // A goal with a single candidate gets a choice point only briefly:
+        // it is dropped as soon as the clause is taken.
+        choices.push_back(
+            { goal, rest, frame, parent, barrier, level, candidates, count, 0, Trace::Note(), nullptr, 0, generation });
+        protect();
+        if (!backtrack())
+            return FAILED;
+    }
+}
+
+//
+// Return the goals at the start of the body which share no unbound variables.
+// Goals are taken while each one is independent of all the goals before it,
+// up to a goal which is not pure, such as a cut or an assert: it must run
+// in this solver, after the goals before it, and only once. The goals are
+// looked at through the frame, and only those taken get instances.
+// For a clause body, which outlives the solver, the number of goals before
+// a control construct is kept, and so is a refusal of the fork: such goals
+// are solved one by one from then on. Other goal lists are made while solving,
+// and their addresses can be reused.
+//
+template <class Tracer>
+std::vector<Compound *> Solver<Tracer>::independent(Compound *first)
+{
+    std::vector<Compound *> group{ first };
+    Conjunction computed{ 0 };
+    Conjunction *conjunction = &computed;
+    if (frame)
+        conjunction = &conjunctions.try_emplace(body, computed).first->second;
+    if (conjunction->length == 0 || conjunction->changes != prog->purity_changes()) {
+        conjunction->changes = prog->purity_changes();
+        conjunction->length = 1;
+        if (prog->pure(first))
+            for (Goal *g = body->get_tail(); g && prog->pure(g->get_head()); g = g->get_tail())
+                conjunction->length++;
+    }
+    if (conjunction->declined || conjunction->length < 2)
+        return group;
+
+    std::vector<Term *> seen;
+    unbound(first, nullptr, seen);
+    std::sort(seen.begin(), seen.end());
+
+    std::vector<Term *> vars, shared, all;
+    Goal *g = body->get_tail();
+    for (size_t i = 1; i < conjunction->length; i++, g = g->get_tail()) {
+        vars.clear();
+        unbound(g->get_head(), frame, vars);
+        std::sort(vars.begin(), vars.end());
+        shared.clear();
+        std::set_intersection(seen.begin(), seen.end(), vars.begin(), vars.end(), std::back_inserter(shared));
+        if (!shared.empty())
+            break;
+
+        group.push_back(frame ? static_cast<Compound *>(g->get_head()->instantiate(frame)) : g->get_head());
+        all.clear();
+        std::set_union(seen.begin(), seen.end(), vars.begin(), vars.end(), std::back_inserter(all));
+        seen.swap(all);
+    }
+    return group;
+}
+
+//
+// Collect the unbound variables of the term.
+// Variables of a template are taken from the frame.
+//
+template <class Tracer>
+void Solver<Tracer>::unbound(Term *t, Term **frame, std::vector<Term *> &vars)
+{
+    if (Variable *v = t->as_variable(); v && frame && v->get_slot() >= 0)
+        t = frame[v->get_slot()];
+    t = t->deref();
+    Compound *c = t->as_compound();
+    if (!c) {
+        if (t->as_variable())
+            vars.push_back(t);
+        return;
+    }
+    for (int i = 0; i < c->get_arity(); i++)
+        unbound(c->arg(i), frame, vars);
+}
+
+//
+// Visit the references from the solver to the heap.
+// Variables bound by the solver which are older than a choice point are
+// on the trail; among them are the variables older than the solver.
+//
+template <class Tracer>
+void Solver<Tracer>::roots(Collector &gc)
+{
+    gc.visit(body);
+    gc.visit(frame);
+    gc.visit(parent);
+    for (ChoicePoint &cp : choices) {
+        gc.visit(cp.goal);
+        gc.visit(cp.body);
+        gc.visit(cp.frame);
+        gc.visit(cp.parent);
+        gc.visit(cp.candidates, cp.count);
+        gc.visit(cp.mark.heap);
+    }
+    std::vector<Variable *> &history = Engine::current().history;
+    for (size_t i = start.history; i < history.size(); i++)
+        gc.trailed(history[i]);
+}
+
+//
+// Free the unreachable objects allocated by the solver,
+// and set when to collect again.
+//
+template <class Tracer>
+void Solver<Tracer>::collect()
+{
+    Engine &engine = Engine::current();
+    Collector gc(engine.heap, start.heap);
+    roots(gc);
+    gc.compact();
+    roots(gc);
+    gc.finish(engine.counters);
+    collect_at = collection_block(engine.heap.mark().block, gc.live_size());
+}
+
+//
+// Give away the untried clauses of the oldest choice point.
+// The bindings made after the choice point are suspended while the visitor runs,
+// and every variable is trailed, so that whatever the visitor binds or allocates
+// is released afterwards.
+//
+template <class Tracer>
+template <class Visitor>
+bool Solver<Tracer>::donate(Visitor &&visit)
+{
+    if (choices.empty() || choices.front().builtin || choices.front().generation != Candidates::all ||
+        cut_ahead(choices.front()))
+        return false;
+
+    ChoicePoint &cp = choices.front();
+    uint64_t boundary = Trace::Boundary();
+    auto bindings = Trace::Suspend(cp.mark);
+    Trace::Mark mark = Trace::Note();
+    Trace::Protect(UINT64_MAX);
+
+    visit(cp.goal, Continuation(cp.body, cp.frame, cp.parent, cp.barrier), cp.candidates + cp.next,
+          cp.candidates + cp.count);
+
+    Trace::Undo(mark);
+    Trace::Restore(bindings);
+    Trace::Protect(boundary);
+    cp.next = cp.count;
+    return true;
+}
+
+//
+// Call the nondeterministic builtin of the latest choice point again.
+//
+template <class Tracer>
+bool Solver<Tracer>::retry(ChoicePoint &cp, size_t depth, size_t &tried)
+{
+    if (cp.next > 0 && depth != tried) {
+        // Back into a builtin which has given a solution.
+        COUNT(redos);
+        if constexpr (ports)
+            tracer.redo(cp.goal, cp.level);
+    }
+    tried = depth;
+
+    ChoicePoint call = cp;
+    ForeignCall foreign{ prog, call.goal, call.state, false, nullptr, tabling, fork };
+    bool success = call.builtin->function(foreign);
+    if (foreign.last) {
+        // The bindings of the last solution are kept only for older choice points.
+        choices.pop_back();
+        protect();
+        Trace::Forget(call.mark);
+    } else {
+        cp.state = foreign.state;
+        if (success)
+            cp.next++;
+    }
+    if (!success) {
+        if constexpr (ports)
+            if (foreign.last)
+                tracer.fail(call.goal, call.level);
+        return false;
+    }
+
+    body = call.body;
+    frame = call.frame;
+    parent = call.parent;
+    barrier = call.barrier;
+    level = call.level;
+    if constexpr (ports)
+        tracer.exit(call.goal, call.level);
+    return true;
+}
+
+//
+// Continue after a goal which is solved in place.
+//
+template <class Tracer>
+bool Solver<Tracer>::proceed(Compound *goal, Goal *rest, bool success)
+{
+    if (!success) {
+        if constexpr (ports)
+            tracer.fail(goal, level);
+        return backtrack();
+    }
+    if constexpr (ports)
+        tracer.exit(goal, level);
+    body = rest;
+    return true;
+}
+
+//
+// Resume the latest choice point with its next matching clause.
+// When the last candidate is taken, the choice point is removed
+// before the clause is tried: the call is then deterministic,
+// and tail calls in the clause body run without growing the stack.
+// The cut barrier of the clause body is the position of the choice point.
+// Return false when no alternatives are left.
+//
+template <class Tracer>
+bool Solver<Tracer>::backtrack()
+{
+    size_t tried = SIZE_MAX;
+    while (!choices.empty()) {
+        size_t depth = choices.size() - 1;
+        ChoicePoint &cp = choices.back();
+
+        // Reset the variables bound since the choice point,
+        // and release the memory allocated for them.
+        Trace::Undo(cp.mark);
+        if (cp.builtin) {
+            if (!retry(cp, depth, tried))
+                continue;
+            return true;
+        }
+        skip_invisible(cp);
+        if (cp.next == cp.count) {
+            // No clauses at all.
+            if constexpr (ports)
+                tracer.fail(cp.goal, cp.level);
+            choices.pop_back();
+            protect();
+            continue;
+        }
+        if (cp.next > 0 && depth != tried) {
+            // Back into a goal which has alternatives.
+            COUNT(redos);
+            if constexpr (ports)
+                tracer.redo(cp.goal, cp.level);
+        }
+        tried = depth;
+        Clause *cl = cp.candidates[cp.next++];
+        skip_invisible(cp);
+        ChoicePoint call = cp;
+        if (cp.next == cp.count) {
+            // No alternatives remain: bindings made from now on are undone
+            // by an older choice point, if any.
+            choices.pop_back();
+            protect();
+        }
+        tracer.attempt(cl, call.level);
+        COUNT(attempts);
+
+        // Match the clause head to the goal, binding the clause variables in a new frame.
+        Term **clause_frame = cl->new_frame();
+        if (cl->head->match(call.goal, clause_frame)) {
+
+            // Matched: continue with the clause body, and then with the rest
+            // of the calling body, with the level incremented.
+            if (!cl->body) {
+                body = call.body;
+                frame = call.frame;
+                parent = call.parent;
+                barrier = call.barrier;
+                if constexpr (ports)
+                    tracer.exit(call.goal, call.level);
+            } else {
+                // Variables which occur only in the body are created now: the frame
+                // must not refer to memory released by backtracking into the body.
+                for (int i = 0; i < cl->nvars; i++)
+                    if (!clause_frame[i])
+                        clause_frame[i] = new Variable();
+
+                parent = call.body ? new Continuation(call.body, call.frame, call.parent, call.barrier) : call.parent;
+                if constexpr (ports)
+                    parent = exit_marker(call.goal, parent, call.barrier);
+                body = cl->body;
+                frame = clause_frame;
+                barrier = depth;
+            }
+            level = call.level + 1;
+            return true;
+        }
+        tracer.nomatch(cl, call.level);
+        COUNT(nomatches);
+        if constexpr (ports)
+            if (call.next == call.count)
+                tracer.fail(call.goal, call.level);
+    }
+
+    // Nothing left to try: reset the variables bound by the solver.
+    Trace::Undo(start);
+    Trace::Protect(outer);
+    failed = true;
+    return false;
+}
+
+//
+// Solve the problem, and print the answers.
+// The trace is written out before every answer, to keep them in order.
+//
+template <class Tracer>
+void Goal::solve(Program *prog, int level, VarMapping *vars, Tracer &tracer)
+{
+    Solver<Tracer> solver(prog, this, tracer, level);
+    while (solver.next()) {
+        tracer.flush();
+        vars->show_answer();
+    }
+    tracer.flush();
+}
+
+#endif // PROLOG_H
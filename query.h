@@ -0,0 +1,194 @@
+//
+// Streaming interface to the solver: a query returns a lazy generator
+// of solutions, implemented as a C++20 coroutine.
+//
+#ifndef QUERY_H
+#define QUERY_H
+
+#include <coroutine>
+#include <iterator>
+#include <string>
+
+#include "prolog.h"
+#include "writer.h"
+
+//
+// Generator is a range of values produced by a coroutine.
+// The coroutine runs only when the next value is requested, and a value
+// stays valid until then. Destroying the generator destroys the coroutine,
+// with all its local objects.
+//
+template <class T>
+class Generator {
+public:
+    struct promise_type;
+    using handle = std::coroutine_handle<promise_type>;
+
+private:
+    handle coroutine;
+
+public:
+    //
+    // State of the coroutine, as seen by the generator.
+    //
+    struct promise_type {
+        const T *current{ nullptr };
+
+        Generator get_return_object() { return Generator(handle::from_promise(*this)); }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_always final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { throw; }
+
+        // Keep the value, and give control back to the consumer.
+        std::suspend_always yield_value(const T &value) noexcept
+        {
+            current = std::addressof(value);
+            return {};
+        }
+    };
+
+    //
+    // Input iterator over the values; incrementing it resumes the coroutine.
+    //
+    class iterator {
+        handle coroutine;
+
+    public:
+        using value_type = T;
+        using difference_type = std::ptrdiff_t;
+
+        iterator() = default;
+        explicit iterator(handle h) : coroutine(h) {}
+
+        const T &operator*() const { return *coroutine.promise().current; }
+        const T *operator->() const { return coroutine.promise().current; }
+
+        iterator &operator++()
+        {
+            coroutine.resume();
+            return *this;
+        }
+        void operator++(int) { ++*this; }
+
+        bool operator==(std::default_sentinel_t) const { return !coroutine || coroutine.done(); }
+    };
+
+    explicit Generator(handle h) : coroutine(h) {}
+    Generator(Generator &&g) noexcept : coroutine(std::exchange(g.coroutine, nullptr)) {}
+    Generator &operator=(Generator &&g) noexcept
+    {
+        std::swap(coroutine, g.coroutine);
+        return *this;
+    }
+    Generator(const Generator &) = delete;
+    Generator &operator=(const Generator &) = delete;
+
+    // Destroy the coroutine, if any.
+    ~Generator()
+    {
+        if (coroutine)
+            coroutine.destroy();
+    }
+
+    // Compute the first value, and return an iterator at it.
+    iterator begin()
+    {
+        coroutine.resume();
+        return iterator(coroutine);
+    }
+
+    // Return the end of the values.
+    std::default_sentinel_t end() const { return {}; }
+
+    // Compute the next value; return false when there are no more.
+    // Past the end, the coroutine is not resumed again.
+    bool next()
+    {
+        if (!coroutine || coroutine.done())
+            return false;
+        coroutine.resume();
+        return !coroutine.done();
+    }
+
+    // Return the latest value.
+    const T &value() const { return *coroutine.promise().current; }
+};
+
+//
+// Solution of a query: the bindings of the variables of the query.
+// The terms are valid until the next solution is requested.
+//
+class Solution {
+    const VarMapping *vars;
+
+public:
+    explicit Solution(const VarMapping *v) : vars(v) {}
+
+    // Return the number of variables.
+    int size() const { return vars->size(); }
+
+    // Return the name of the variable at the given position.
+    const std::string &name(int i) const { return vars->name(i); }
+
+    // Return the value of the variable at the given position.
+    Term *value(int i) const { return vars->variable(i)->deref(); }
+
+    // Return the value of the variable with the given name, or nullptr when there is none.
+    Term *value(const std::string &name) const
+    {
+        for (int i = 0; i < vars->size(); i++)
+            if (vars->name(i) == name)
+                return value(i);
+        return nullptr;
+    }
+
+    // Print the variables and their values, as the interpreter does.
+    void print(std::ostream &out = std::cout) const
+    {
+        StreamSink sink(out);
+        Writer(sink).answer(*vars);
+    }
+
+    // Write the variables and their values, as the interpreter does.
+    void write(Writer &out) const { out.answer(*vars); }
+
+    // Write the variables and their values in the binary encoding.
+    void encode(TermEncoder &out) const { out.answer(*vars); }
+};
+
+//
+// Return the solutions of the goal, computed one by one on request, and
+// report the progress to the tracer. The trace is written out before
+// every solution. The search stops for good after max_solutions.
+// Destroying the generator resets the variables bound by the search.
+// The generator must be used in the engine where it was created.
+//
+template <class Tracer>
+Generator<Solution> query(Program *prog, Goal *goal, VarMapping *vars, Tracer &tracer,
+                          size_t max_solutions = SIZE_MAX)
+{
+    Solver<Tracer> solver(prog, goal, tracer);
+    solver.set_limit(max_solutions);
+    Solution solution(vars);
+    while (solver.next()) {
+        tracer.flush();
+        co_yield solution;
+    }
+    tracer.flush();
+}
+
+//
+// Return the solutions of the goal, computed one by one on request,
+// up to max_solutions.
+//
+inline Generator<Solution> query(Program *prog, Goal *goal, VarMapping *vars, size_t max_solutions = SIZE_MAX)
+{
+    Solver<> solver(prog, goal);
+    solver.set_limit(max_solutions);
+    Solution solution(vars);
+    while (solver.next())
+        co_yield solution;
+}
+
+#endif // QUERY_H
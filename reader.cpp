@@ -0,0 +1,613 @@
+//
+// Reader of Prolog text: tokenizer and operator precedence parser.
+//
+#include "reader.h"
+
+#include <cctype>
+#include <charconv>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+//
+// Standard operators.
+// The bar is an infix operator only at the top level, and means a disjunction.
+//
+const std::unordered_map<std::string_view, Reader::Operator> Reader::infix_ops = {
+    { ":-", { 1200, Operator::XFX } },  { "-->", { 1200, Operator::XFX } }, { ";", { 1100, Operator::XFY } },
+    { "|", { 1100, Operator::XFY } },   { "->", { 1050, Operator::XFY } },  { "*->", { 1050, Operator::XFY } },
+    { ",", { 1000, Operator::XFY } },   { "=", { 700, Operator::XFX } },    { "\\=", { 700, Operator::XFX } },
+    { "==", { 700, Operator::XFX } },   { "\\==", { 700, Operator::XFX } }, { "@<", { 700, Operator::XFX } },
+    { "@>", { 700, Operator::XFX } },   { "@=<", { 700, Operator::XFX } },  { "@>=", { 700, Operator::XFX } },
+    { "=..", { 700, Operator::XFX } },  { "is", { 700, Operator::XFX } },   { "=:=", { 700, Operator::XFX } },
+    { "=\\=", { 700, Operator::XFX } }, { "<", { 700, Operator::XFX } },    { ">", { 700, Operator::XFX } },
+    { "=<", { 700, Operator::XFX } },   { ">=", { 700, Operator::XFX } },   { ":", { 200, Operator::XFY } },
+    { "+", { 500, Operator::YFX } },    { "-", { 500, Operator::YFX } },    { "/\\", { 500, Operator::YFX } },
+    { "\\/", { 500, Operator::YFX } },  { "xor", { 500, Operator::YFX } },  { "*", { 400, Operator::YFX } },
+    { "/", { 400, Operator::YFX } },    { "//", { 400, Operator::YFX } },   { "rem", { 400, Operator::YFX } },
+    { "mod", { 400, Operator::YFX } },  { "div", { 400, Operator::YFX } },  { "<<", { 400, Operator::YFX } },
+    { ">>", { 400, Operator::YFX } },   { "**", { 200, Operator::XFX } },   { "^", { 200, Operator::XFY } },
+};
+
+const std::unordered_map<std::string_view, Reader::Operator> Reader::prefix_ops = {
+    { ":-", { 1200, Operator::FX } },    { "?-", { 1200, Operator::FX } },
+    { "dynamic", { 1150, Operator::FX } }, { "discontiguous", { 1150, Operator::FX } },
+    { "table", { 1150, Operator::FX } }, { "\\+", { 900, Operator::FY } },
+    { "-", { 200, Operator::FY } },      { "+", { 200, Operator::FY } },
+    { "\\", { 200, Operator::FY } },
+};
+
+//
+// Return true for characters of symbolic atoms.
+//
+static bool is_symbol(char c)
+{
+    return c && std::strchr("+-*/\\^<>=~:.?@#&$", c);
+}
+
+//
+// Return true for characters of alphanumeric atoms and variables.
+//
+static bool is_alnum(char c)
+{
+    return std::isalnum((unsigned char)c) || c == '_';
+}
+
+//
+// Skip spaces and comments.
+//
+void Reader::skip_layout()
+{
+    while (pos < end) {
+        if (*pos == '\n') {
+            line++;
+            pos++;
+        } else if (std::isspace((unsigned char)*pos)) {
+            pos++;
+        } else if (*pos == '%') {
+            while (pos < end && *pos != '\n')
+                pos++;
+        } else if (*pos == '/' && pos + 1 < end && pos[1] == '*') {
+            for (pos += 2; pos < end && !(*pos == '*' && pos + 1 < end && pos[1] == '/'); pos++)
+                if (*pos == '\n')
+                    line++;
+            pos = std::min(pos + 2, end);
+        } else {
+            break;
+        }
+    }
+}
+
+//
+// Read the next token.
+//
+void Reader::advance()
+{
+    skip_layout();
+    token = Token();
+    if (pos >= end)
+        return;
+
+    const char *begin = pos;
+    char c = *pos;
+    if (std::isdigit((unsigned char)c)) {
+        token.kind = NUMBER;
+        if (c == '0' && pos + 2 < end && pos[1] == '\'') {
+            // Character code.
+            token.text = std::to_string((unsigned char)pos[2]);
+            pos += 3;
+            return;
+        }
+        while (pos < end && std::isdigit((unsigned char)*pos))
+            pos++;
+        if (pos + 1 < end && *pos == '.' && std::isdigit((unsigned char)pos[1])) {
+            for (pos++; pos < end && std::isdigit((unsigned char)*pos);)
+                pos++;
+            if (pos + 1 < end && (*pos == 'e' || *pos == 'E')) {
+                const char *digits = pos + 1;
+                if (digits < end && (*digits == '+' || *digits == '-'))
+                    digits++;
+                if (digits < end && std::isdigit((unsigned char)*digits))
+                    for (pos = digits; pos < end && std::isdigit((unsigned char)*pos);)
+                        pos++;
+            }
+        }
+    } else if (c == '_' || std::isupper((unsigned char)c)) {
+        token.kind = VARIABLE;
+        while (pos < end && is_alnum(*pos))
+            pos++;
+    } else if (std::islower((unsigned char)c)) {
+        token.kind = NAME;
+        while (pos < end && is_alnum(*pos))
+            pos++;
+    } else if (c == '\'') {
+        token.kind = NAME;
+        token.quoted = true;
+        if (!quoted_name(c, token.text)) {
+            token.kind = INVALID;
+            fail("malformed quoted atom");
+            return;
+        }
+        token.functional = (pos < end && *pos == '(');
+        return;
+    } else if (c == '!' || c == ';') {
+        token.kind = NAME;
+        pos++;
+    } else if (std::strchr("()[]{},|", c)) {
+        token.kind = PUNCTUATION;
+        pos++;
+    } else if (is_symbol(c)) {
+        while (pos < end && is_symbol(*pos))
+            pos++;
+        bool stop = (pos == end || std::isspace((unsigned char)*pos) || *pos == '%');
+        token.kind = (pos - begin == 1 && c == '.' && stop) ? END : NAME;
+    } else {
+        token.kind = INVALID;
+        fail(c == '"' || c == '`' ? "strings are not supported" : "unexpected character");
+        return;
+    }
+    token.text.assign(begin, pos);
+    token.functional = (token.kind == NAME && pos < end && *pos == '(');
+}
+
+//
+// Read a quoted name, with escape sequences; a doubled quote stands for itself.
+// Return false when the name is not terminated, or has an unknown escape.
+//
+bool Reader::quoted_name(char quote, std::string &text)
+{
+    for (pos++; pos < end;) {
+        char c = *pos++;
+        if (c == quote) {
+            if (pos < end && *pos == quote) {
+                text += quote;
+                pos++;
+                continue;
+            }
+            return true;
+        }
+        if (c == '\n')
+            line++;
+        if (c != '\\') {
+            text += c;
+            continue;
+        }
+        if (pos >= end)
+            return false;
+        switch (c = *pos++) {
+        case 'n':
+            text += '\n';
+            break;
+        case 't':
+            text += '\t';
+            break;
+        case 'r':
+            text += '\r';
+            break;
+        case '\n':
+            // Continuation of the name on the next line.
+            line++;
+            break;
+        case '\\':
+        case '\'':
+        case '"':
+        case '`':
+            text += c;
+            break;
+        default:
+            return false;
+        }
+    }
+    return false;
+}
+
+//
+// Set the error message, unless there is one already; return nullptr.
+//
+Term *Reader::fail(const std::string &text)
+{
+    if (message.empty())
+        message = "line " + std::to_string(line) + ": " + text;
+    return nullptr;
+}
+
+//
+// Return the number written as the text, with an optional minus sign:
+// an integer, or a float when there is a fraction. An integer
+// which does not fit in 64 bits is an error.
+//
+Term *Reader::number(const std::string &text)
+{
+    const char *first = text.data();
+    const char *last = first + text.size();
+    if (text.find_first_of(".eE") != std::string::npos) {
+        double x;
+        if (std::from_chars(first, last, x).ec != std::errc())
+            return fail("malformed number " + text);
+        return Number::create(Value::from_float(x));
+    }
+    int64_t n;
+    if (std::from_chars(first, last, n).ec != std::errc())
+        return fail("integer too large: " + text);
+    return Number::create(Value::from_integer(n));
+}
+
+//
+// Return a variable with the given name, creating it on first use.
+// Every anonymous variable is a new one. Variables of a template get
+// slots; variables of a query are listed with their names.
+//
+Term *Reader::variable(const std::string &name)
+{
+    Variable *&v = named[name];
+    if (v && name != "_")
+        return v;
+
+    v = new Variable();
+    if (templates) {
+        v->set_slot(nslots++);
+    } else if (name != "_") {
+        vars.push_back(v);
+        names.push_back(name);
+    }
+    return v;
+}
+
+//
+// Return true when the current token can start a term:
+// then a prefix operator before it is applied to it.
+//
+bool Reader::starts_term() const
+{
+    switch (token.kind) {
+    case VARIABLE:
+    case NUMBER:
+        return true;
+    case NAME:
+        return token.functional || token.quoted || infix_ops.find(token.text) == infix_ops.end() ||
+               prefix_ops.find(token.text) != prefix_ops.end();
+    case PUNCTUATION:
+        return token.text == "(" || token.text == "[" || token.text == "{";
+    default:
+        return false;
+    }
+}
+
+//
+// Parse a term with the priority at most max; set its priority.
+// Infix operators are applied while their priority fits: the left
+// argument of xfx and xfy takes a lower priority, and so does the right
+// argument of xfx and yfx.
+//
+Term *Reader::parse(int max, int &priority)
+{
+    Term *left = parse_primary(max, priority);
+    while (left && (token.kind == NAME || (token.kind == PUNCTUATION && (token.text == "," || token.text == "|")))) {
+        auto found = infix_ops.find(token.text);
+        if (found == infix_ops.end())
+            break;
+
+        const Operator &op = found->second;
+        int left_max = (op.type == Operator::YFX) ? op.priority : op.priority - 1;
+        int right_max = (op.type == Operator::XFY) ? op.priority : op.priority - 1;
+        if (op.priority > max || priority > left_max)
+            break;
+
+        Atom *functor = Atom::intern(token.text == "|" ? ";" : token.text);
+        advance();
+        int right_priority;
+        Term *right = parse(right_max, right_priority);
+        if (!right)
+            return nullptr;
+        left = Compound::create(functor, { left, right });
+        priority = op.priority;
+    }
+    return left;
+}
+
+//
+// Parse a term which is not an infix expression: a variable, a number,
+// an atom, a compound in functional notation, a prefix operator with
+// its argument, a list, or a term in parentheses or braces.
+//
+Term *Reader::parse_primary(int max, int &priority)
+{
+    priority = 0;
+    switch (token.kind) {
+    case FINISH:
+        return fail("unexpected end of text");
+    case END:
+        return fail("unexpected end of clause");
+    case INVALID:
+        return nullptr;
+    case VARIABLE: {
+        Term *v = variable(token.text);
+        advance();
+        return v;
+    }
+    case NUMBER: {
+        std::string text = token.text;
+        advance();
+        return number(text);
+    }
+    case PUNCTUATION: {
+        char c = token.text[0];
+        advance();
+        if (c == '[') {
+            if (token.kind == PUNCTUATION && token.text == "]") {
+                advance();
+                return Compound::create(Atom::intern("[]"));
+            }
+            return parse_list();
+        }
+        if (c == '(' || c == '{') {
+            const char *close = (c == '(') ? ")" : "}";
+            if (c == '{' && token.kind == PUNCTUATION && token.text == close) {
+                advance();
+                return Compound::create(Atom::intern("{}"));
+            }
+            int p;
+            Term *t = parse(1200, p);
+            if (!t)
+                return nullptr;
+            if (token.kind != PUNCTUATION || token.text != close)
+                return fail(std::string("expected ") + close);
+            advance();
+            return (c == '(') ? t : Compound::create(Atom::intern("{}"), { t });
+        }
+        return fail("unexpected " + std::string(1, c));
+    }
+    case NAME:
+        break;
+    }
+
+    std::string name = token.text;
+    bool quoted = token.quoted;
+    bool functional = token.functional;
+    if (name == "-" && !quoted && pos < end && std::isdigit((unsigned char)*pos)) {
+        // Negative number.
+        advance();
+        std::string text = "-" + token.text;
+        advance();
+        return number(text);
+    }
+    advance();
+    if (functional)
+        return parse_arguments(name);
+
+    auto found = quoted ? prefix_ops.end() : prefix_ops.find(name);
+    if (found != prefix_ops.end() && found->second.priority <= max && starts_term()) {
+        const Operator &op = found->second;
+        int arg_priority;
+        Term *arg = parse((op.type == Operator::FY) ? op.priority : op.priority - 1, arg_priority);
+        if (!arg)
+            return nullptr;
+        priority = op.priority;
+        return Compound::create(Atom::intern(name), { arg });
+    }
+    return Compound::create(Atom::intern(name));
+}
+
+//
+// Parse the arguments of a compound term in functional notation.
+//
+Term *Reader::parse_arguments(const std::string &name)
+{
+    std::vector<Term *> args;
+    for (advance();;) {
+        int p;
+        Term *arg = parse(999, p);
+        if (!arg)
+            return nullptr;
+        args.push_back(arg);
+        if (token.kind != PUNCTUATION || (token.text != "," && token.text != ")"))
+            return fail("expected , or ) in arguments of " + name);
+        bool last = (token.text == ")");
+        advance();
+        if (last)
+            break;
+    }
+    return Compound::create(Atom::intern(name), args.size(), args.data());
+}
+
+//
+// Parse the items of a list, after the opening bracket, and the tail after a bar.
+//
+Term *Reader::parse_list()
+{
+    static Atom *const dot = Atom::intern(".");
+    std::vector<Term *> items;
+    Term *tail = nullptr;
+    for (;;) {
+        int p;
+        Term *item = parse(999, p);
+        if (!item)
+            return nullptr;
+        items.push_back(item);
+        if (token.kind == PUNCTUATION && token.text == ",") {
+            advance();
+            continue;
+        }
+        if (token.kind == PUNCTUATION && token.text == "|") {
+            advance();
+            if (!(tail = parse(999, p)))
+                return nullptr;
+        }
+        if (token.kind != PUNCTUATION || token.text != "]")
+            return fail("expected , | or ] in list");
+        advance();
+        break;
+    }
+    if (!tail)
+        tail = Compound::create(Atom::intern("[]"));
+    for (size_t i = items.size(); i > 0; i--)
+        tail = Compound::create(dot, { items[i - 1], tail });
+    return tail;
+}
+
+//
+// Parse a term which ends with a dot.
+//
+Term *Reader::parse_clause_term()
+{
+    int p;
+    Term *t = parse(1200, p);
+    if (!t)
+        return nullptr;
+    if (token.kind != END)
+        return fail(token.kind == FINISH ? "missing dot at the end" : "operator expected");
+    advance();
+    return t;
+}
+
+//
+// Append the goals of a clause body to the list: a conjunction is flattened,
+// true is dropped, and a variable or a number is called with call/1.
+//
+void Reader::body_goals(Term *t, std::vector<Compound *> &goals)
+{
+    static Atom *const comma = Atom::intern(",");
+    static Atom *const truth = Atom::intern("true");
+    static Atom *const call = Atom::intern("call");
+
+    Compound *c = t->as_compound();
+    if (!c) {
+        goals.push_back(Compound::create(call, { t }));
+    } else if (c->get_functor() == comma && c->get_arity() == 2) {
+        body_goals(c->arg(0), goals);
+        body_goals(c->arg(1), goals);
+    } else if (c->get_functor() != truth || c->get_arity() != 0) {
+        goals.push_back(c);
+    }
+}
+
+//
+// Start reading a clause or query: forget the variables of the previous one.
+//
+void Reader::start(bool as_template)
+{
+    templates = as_template;
+    named.clear();
+    vars.clear();
+    names.clear();
+    nslots = 0;
+}
+
+//
+// Read the next clause; return nullptr at the end of the text, or on a syntax error.
+// Directives are kept aside.
+//
+Clause *Reader::read_clause()
+{
+    static Atom *const neck = Atom::intern(":-");
+    static Atom *const arrow = Atom::intern("-->");
+
+    while (token.kind != FINISH && !failed()) {
+        start(true);
+        Term *t = parse_clause_term();
+        if (!t)
+            return nullptr;
+
+        Compound *c = t->as_compound();
+        if (!c) {
+            fail(t->as_number() ? "a clause cannot be a number" : "a clause cannot be a variable");
+            return nullptr;
+        }
+        if (c->get_functor() == neck && c->get_arity() == 1) {
+            Compound *directive = c->arg(0)->as_compound();
+            if (!directive) {
+                fail(c->arg(0)->as_number() ? "a directive cannot be a number" : "a directive cannot be a variable");
+                return nullptr;
+            }
+            directive_list.push_back(directive);
+            continue;
+        }
+        if (c->get_functor() == arrow && c->get_arity() == 2) {
+            fail("grammar rules are not supported");
+            return nullptr;
+        }
+
+        Compound *head = c;
+        std::vector<Compound *> goals;
+        if (c->get_functor() == neck && c->get_arity() == 2) {
+            head = c->arg(0)->as_compound();
+            if (!head) {
+                fail(c->arg(0)->as_number() ? "a clause head cannot be a number" : "a clause head cannot be a variable");
+                return nullptr;
+            }
+            body_goals(c->arg(1), goals);
+        }
+        Goal *body = nullptr;
+        for (size_t i = goals.size(); i > 0; i--)
+            body = new Goal(goals[i - 1], body);
+        return new Clause(head, body, nslots);
+    }
+    return nullptr;
+}
+
+//
+// Read all clauses, and return them as a program, in the order of the text.
+//
+Program *Reader::read_program()
+{
+    Program *first = nullptr;
+    Program **last = &first;
+    while (Clause *cl = read_clause()) {
+        *last = new Program(cl);
+        last = &(*last)->tail;
+    }
+    return failed() ? nullptr : first;
+}
+
+//
+// Read a goal list ended with a dot; a leading ?- is optional.
+// Return nullptr at the end of the text, or on a syntax error.
+//
+Goal *Reader::read_query()
+{
+    static Atom *const query = Atom::intern("?-");
+
+    if (token.kind == FINISH || failed())
+        return nullptr;
+    start(false);
+    Term *t = parse_clause_term();
+    if (!t)
+        return nullptr;
+
+    Compound *c = t->as_compound();
+    if (c && c->get_functor() == query && c->get_arity() == 1)
+        t = c->arg(0);
+    std::vector<Compound *> goals;
+    body_goals(t, goals);
+    if (goals.empty()) {
+        fail("the query has no goals");
+        return nullptr;
+    }
+    Goal *list = nullptr;
+    for (size_t i = goals.size(); i > 0; i--)
+        list = new Goal(goals[i - 1], list);
+    return list;
+}
+
+//
+// Read the clauses of a file; return nullptr on error, and set the message.
+//
+Program *Reader::consult(const std::string &path, std::string &error)
+{
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        error = path + ": cannot open";
+        return nullptr;
+    }
+    std::ostringstream text;
+    text << in.rdbuf();
+    std::string source = text.str();
+
+    Reader reader(source);
+    Program *prog = reader.read_program();
+    if (reader.failed())
+        error = path + ": " + reader.error();
+    else if (!prog)
+        error = path + ": no clauses";
+    return prog;
+}
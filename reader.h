@@ -0,0 +1,145 @@
+//
+// Reader of Prolog text: clauses and queries in standard syntax.
+//
+#ifndef READER_H
+#define READER_H
+
+#include <string>
+#include <string_view>
+
+#include "prolog.h"
+
+//
+// Reader parses clauses from a text in memory, with the standard operators.
+// Supported are atoms (plain, symbolic and quoted), variables, numbers,
+// compounds in functional and operator notation, lists, and {}/1 terms.
+// Numbers are integers of 64 bits, and floats. Lists are built of '.'/2 and [].
+// A clause is made into a template right away, without a renamed copy:
+// every variable of the clause gets a slot. Goals 'true' are dropped
+// from clause bodies, and a variable goal G is called as call(G).
+// Directives (":- goal.") are not run, but kept for the caller.
+// On a syntax error, reading stops, and the error tells the line.
+//
+class Reader {
+    //
+    // Kinds of tokens.
+    //
+    enum Kind {
+        NAME,        // Atom name, plain or quoted
+        VARIABLE,    // Variable name
+        NUMBER,      // Integer or float
+        PUNCTUATION, // One of ( ) [ ] { } , |
+        END,         // End of a clause: a dot followed by a space
+        FINISH,      // End of the text
+        INVALID,     // Malformed token; the error is set
+    };
+
+    //
+    // Token: the kind, the text, and whether it is followed by an opening parenthesis
+    // without a space in between.
+    //
+    struct Token {
+        Kind kind{ FINISH };
+        std::string text;
+        bool quoted{ false };
+        bool functional{ false };
+    };
+
+    //
+    // Operator: priority, and position of the arguments.
+    //
+    struct Operator {
+        enum Type { XFX, XFY, YFX, FY, FX };
+        int priority;
+        Type type;
+    };
+
+    static const std::unordered_map<std::string_view, Operator> infix_ops;
+    static const std::unordered_map<std::string_view, Operator> prefix_ops;
+
+    const char *pos;
+    const char *end;
+    unsigned line{ 1 };
+    Token token;
+    std::string message;
+
+    // Variables of the clause or query being read.
+    bool templates{ true };
+    std::unordered_map<std::string, Variable *> named;
+    std::vector<Variable *> vars;
+    std::vector<std::string> names;
+    int nslots{ 0 };
+    std::vector<Compound *> directive_list;
+
+    // Skip spaces and comments.
+    void skip_layout();
+
+    // Read the next token.
+    void advance();
+
+    // Read a quoted name, with escape sequences.
+    bool quoted_name(char quote, std::string &text);
+
+    // Set the error message, unless there is one already; return nullptr.
+    Term *fail(const std::string &text);
+
+    // Return the number written as the text; set the error when it does not fit.
+    Term *number(const std::string &text);
+
+    // Return a variable with the given name, creating it on first use.
+    Term *variable(const std::string &name);
+
+    // Return true when the current token can start a term.
+    bool starts_term() const;
+
+    // Parse a term with the priority at most max; set its priority.
+    Term *parse(int max, int &priority);
+
+    // Parse a term which is not an infix or postfix expression.
+    Term *parse_primary(int max, int &priority);
+
+    // Parse the arguments of a compound term in functional notation.
+    Term *parse_arguments(const std::string &name);
+
+    // Parse the items of a list, after the opening bracket.
+    Term *parse_list();
+
+    // Parse a term which ends with a dot.
+    Term *parse_clause_term();
+
+    // Append the goals of a clause body to the list.
+    static void body_goals(Term *t, std::vector<Compound *> &goals);
+
+    // Start reading a clause or query.
+    void start(bool as_template);
+
+public:
+    // Read the text, which should outlive the reader.
+    explicit Reader(std::string_view text) : pos(text.data()), end(text.data() + text.size()) { advance(); }
+
+    // Read the next clause; return nullptr at the end of the text, or on a syntax error.
+    Clause *read_clause();
+
+    // Read all clauses, and return them as a program; nullptr when there are none, or on a syntax error.
+    Program *read_program();
+
+    // Read a goal list ended with a dot; return nullptr at the end of the text, or on a syntax error.
+    Goal *read_query();
+
+    // Return the named variables of the last query, valid until the next one is read.
+    VarMapping variables() { return VarMapping(vars.data(), names.data(), vars.size()); }
+
+    // Return the directives read so far.
+    const std::vector<Compound *> &directives() const { return directive_list; }
+
+    // Return true after a syntax error.
+    bool failed() const { return !message.empty(); }
+
+    // Return the message about the syntax error, with the line number.
+    const std::string &error() const { return message; }
+
+    // Read the clauses of a file; return nullptr on error, and set the message.
+    static Program *consult(const std::string &path, std::string &error);
+};
+
+#endif // READER_H
@@ -0,0 +1,154 @@
+//
+// Scheduler of many queries on a few threads, in slices of calls.
+//
+#include "scheduler.h"
+
+//
+// Build the index of the program, and start the threads.
+//
+Scheduler::Scheduler(Program *p, unsigned nthreads, size_t calls_per_slice) : prog(p), slice(calls_per_slice)
+{
+    if (prog)
+        prog->database();
+    for (unsigned i = 0; i < nthreads; i++)
+        threads.emplace_back([this] { work(); });
+}
+
+//
+// Stop the threads after their current slices, and cancel the queries left.
+//
+Scheduler::~Scheduler()
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    wakeup.notify_all();
+    for (std::thread &t : threads)
+        t.join();
+
+    while (!ready.empty()) {
+        std::shared_ptr<Task> t = ready.top().task;
+        ready.pop();
+        Engine::Scope scope(t->engine);
+        finish(*t, CANCELLED);
+    }
+}
+
+//
+// Read the query in its own engine, and queue it at the current virtual time.
+//
+std::shared_ptr<Scheduler::Task> Scheduler::submit(const std::string &text, Consumer consumer, unsigned weight,
+                                                   std::chrono::milliseconds timeout)
+{
+    auto t = std::make_shared<Task>(text, std::move(consumer), std::max(weight, 1u), timeout);
+    {
+        Engine::Scope scope(t->engine);
+        t->reader = std::make_unique<Reader>(t->text);
+        Goal *goal = t->reader->read_query();
+        if (!goal) {
+            t->message = t->reader->failed() ? t->reader->error() : "no query";
+            finish(*t, INVALID);
+            return t;
+        }
+        t->solver = std::make_unique<Solver<>>(prog, goal, t->tracer);
+    }
+
+    std::lock_guard<std::mutex> guard(lock);
+    if (stopping) {
+        Engine::Scope scope(t->engine);
+        finish(*t, CANCELLED);
+        return t;
+    }
+    ready.push({ clock, queued++, t });
+    in_flight++;
+    wakeup.notify_one();
+    return t;
+}
+
+//
+// Wait until all the queries submitted are finished.
+//
+void Scheduler::drain()
+{
+    std::unique_lock<std::mutex> guard(lock);
+    idle.wait(guard, [this] { return in_flight == 0; });
+}
+
+//
+// Take the query furthest behind, run a slice of it, and queue it again
+// after its stride, until the scheduler stops.
+//
+void Scheduler::work()
+{
+    std::unique_lock<std::mutex> guard(lock);
+    for (;;) {
+        wakeup.wait(guard, [this] { return stopping || !ready.empty(); });
+        if (stopping)
+            return;
+
+        Entry e = ready.top();
+        ready.pop();
+        clock = e.pass;
+        guard.unlock();
+        bool more = step(*e.task);
+        guard.lock();
+
+        if (more) {
+            e.pass += stride / e.task->weight;
+            e.order = queued++;
+            ready.push(std::move(e));
+            wakeup.notify_one();
+        } else if (--in_flight == 0) {
+            idle.notify_all();
+        }
+    }
+}
+
+//
+// Run a slice of the query in its engine, and pass a solution to the consumer.
+// A solution found once the deadline has passed can be wrong, as a nested
+// solver may have stopped early: it is neither counted nor passed on.
+//
+bool Scheduler::step(Task &t)
+{
+    Engine::Scope scope(t.engine);
+    if (t.deadline.expired()) {
+        finish(t, CANCELLED);
+        return false;
+    }
+    switch (t.solver->run(slice)) {
+    case Solver<>::SOLVED: {
+        if (t.deadline.expired())
+            break;
+        t.found++;
+        VarMapping vars = t.reader->variables();
+        if (t.consumer && !t.consumer(Solution(&vars))) {
+            finish(t, FINISHED);
+            return false;
+        }
+        return true;
+    }
+    case Solver<>::SUSPENDED:
+        return true;
+    case Solver<>::FAILED:
+        break;
+    }
+    finish(t, t.deadline.expired() ? CANCELLED : FINISHED);
+    return false;
+}
+
+//
+// Release the solver and the heap of the query, in its engine, which is current,
+// and report the outcome to those who wait for it.
+//
+void Scheduler::finish(Task &t, Outcome outcome)
+{
+    t.solver.reset();
+    Trace::Undo({ 0, 0, { 0, nullptr } });
+    {
+        std::lock_guard<std::mutex> guard(t.lock);
+        t.outcome = outcome;
+    }
+    t.done.notify_all();
+}
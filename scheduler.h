@@ -0,0 +1,159 @@
+//
+// Scheduler of many queries on a few threads, in slices of calls.
+//
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "prolog.h"
+#include "query.h"
+#include "reader.h"
+
+//
+// Scheduler interleaves many queries on a fixed set of threads.
+// A query runs for a slice of calls, is suspended, and is resumed later,
+// possibly on another thread: the state of its search is all in its solver,
+// and in an engine of its own. The query to run next is chosen by stride
+// scheduling: every slice advances the virtual time of a query by the stride
+// divided by its weight, and the query furthest behind runs next.
+// Queries of equal weight take turns, and a query of weight w gets w times
+// the slices of a query of weight 1, so that a runaway query cannot starve
+// the others. A new query starts at the current virtual time.
+// Solutions are passed to the consumer of the query, on the thread which
+// finds them.
+//
+class Scheduler {
+public:
+    //
+    // Outcome of a query.
+    //
+    enum Outcome {
+        PENDING,   // Still running
+        FINISHED,  // No more solutions, or the consumer had enough
+        CANCELLED, // Cancelled, or past its deadline
+        INVALID,   // The text of the query could not be read
+    };
+
+    // Consumer of solutions: return false to stop the query.
+    using Consumer = std::function<bool(const Solution &)>;
+
+    class Task;
+
+    // Virtual time of a slice of a query of weight 1.
+    static constexpr uint64_t stride = 1 << 20;
+
+private:
+    //
+    // Query ready to run, ordered by its virtual time, and then by the order it was queued in.
+    //
+    struct Entry {
+        uint64_t pass;
+        uint64_t order;
+        std::shared_ptr<Task> task;
+
+        bool operator>(const Entry &e) const { return pass > e.pass || (pass == e.pass && order > e.order); }
+    };
+
+    Program *prog;
+    size_t slice;
+    std::vector<std::thread> threads;
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<>> ready;
+    std::mutex lock;
+    std::condition_variable wakeup; // A query is ready, or the scheduler stops
+    std::condition_variable idle;   // No queries are in flight
+    uint64_t clock{ 0 };            // Virtual time of the latest slice
+    uint64_t queued{ 0 };           // Number of queries queued so far
+    size_t in_flight{ 0 };          // Queries submitted and not finished
+    bool stopping{ false };
+
+    // Run queries until the scheduler stops.
+    void work();
+
+    // Run a slice of the query in its engine; return false when it is finished.
+    bool step(Task &t);
+
+    // Release the solver of the query, and report the outcome.
+    static void finish(Task &t, Outcome outcome);
+
+public:
+    // Start the threads, which run the queries over the program in slices of the given number of calls.
+    Scheduler(Program *p, unsigned nthreads, size_t calls_per_slice = 1024);
+    Scheduler(const Scheduler &) = delete;
+    Scheduler &operator=(const Scheduler &) = delete;
+
+    // Stop the threads, and cancel the queries still in flight.
+    ~Scheduler();
+
+    // Read the query, and queue it; the task tells the outcome.
+    // With a timeout, the query is cancelled when it passes.
+    std::shared_ptr<Task> submit(const std::string &text, Consumer consumer, unsigned weight = 1,
+                                 std::chrono::milliseconds timeout = std::chrono::milliseconds::zero());
+
+    // Wait until all the queries submitted are finished.
+    void drain();
+};
+
+//
+// Query run by the scheduler, with its own engine and solver.
+// The reader keeps the goal and the names of its variables.
+//
+class Scheduler::Task {
+    friend class Scheduler;
+
+    Engine engine;
+    NullTracer tracer;
+    std::string text;
+    Deadline deadline;
+    std::unique_ptr<Reader> reader;
+    std::unique_ptr<Solver<>> solver;
+    Consumer consumer;
+    unsigned weight;
+    std::atomic<size_t> found{ 0 };
+    std::string message;
+
+    std::mutex lock;
+    std::condition_variable done;
+    Outcome outcome{ PENDING };
+
+public:
+    // Prepare a query; it is made by Scheduler::submit().
+    Task(const std::string &t, Consumer c, unsigned w, std::chrono::milliseconds timeout)
+        : text(t), deadline(timeout.count() ? Deadline(timeout) : Deadline()), consumer(std::move(c)), weight(w)
+    {
+        engine.deadline = &deadline;
+    }
+
+    // Stop the query at the end of its current slice.
+    void cancel() { deadline.cancel(); }
+
+    // Wait until the query is finished, and return the outcome.
+    Outcome wait()
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        done.wait(guard, [this] { return outcome != PENDING; });
+        return outcome;
+    }
+
+    // Return the outcome, or PENDING while the query runs.
+    Outcome status()
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        return outcome;
+    }
+
+    // Return the number of solutions found so far.
+    size_t solutions() const { return found; }
+
+    // Return the syntax error of an invalid query.
+    const std::string &error() const { return message; }
+};
+
+#endif // SCHEDULER_H
@@ -0,0 +1,156 @@
+//
+// Tabling: variant keys, evaluation and completion.
+//
+#include "table.h"
+
+//
+// Append the key of the term, with variables numbered in the order of appearance.
+// Compounds are written as atom IDs and arities, and numbers as their types and values,
+// so no two terms get the same key.
+//
+void Tables::variant(Term *t, std::string &key, std::unordered_map<Term *, unsigned> &vars)
+{
+    t = t->deref();
+    if (Number *n = t->as_number()) {
+        key += n->get_value().is_float() ? 'F' : 'I';
+        key += std::to_string(n->get_value().bits());
+        key += ' ';
+        return;
+    }
+    Compound *c = t->as_compound();
+    if (!c) {
+        auto found = vars.emplace(t, vars.size()).first;
+        key += 'V';
+        key += std::to_string(found->second);
+        key += ' ';
+        return;
+    }
+    key += std::to_string(c->get_functor()->get_id());
+    key += '/';
+    key += std::to_string(c->get_arity());
+    key += ' ';
+    for (int i = 0; i < c->get_arity(); i++)
+        variant(c->arg(i), key, vars);
+}
+
+//
+// Return the key of the call pattern.
+//
+std::string Tables::variant_key(Term *t)
+{
+    std::string key;
+    std::unordered_map<Term *, unsigned> vars;
+    variant(t, key, vars);
+    return key;
+}
+
+//
+// Return the clauses to resolve the tabled goal with.
+// A complete table gives its own array of answers; otherwise the answers
+// found so far are copied to the heap, as the table can grow meanwhile.
+// The lock is held for the whole evaluation, which calls this again.
+//
+Clause *const *Tables::answers(Program *prog, Compound *goal, size_t &count)
+{
+    std::lock_guard<std::recursive_mutex> guard(lock);
+    Table &t = tables[variant_key(goal)];
+    if (&t == bypass) {
+        // The pattern being evaluated: use the clauses of the program,
+        // only those visible now for a dynamic predicate.
+        bypass = nullptr;
+        Candidates found = prog->lookup(goal);
+        count = found.count;
+        if (found.generation == Candidates::all)
+            return found.clauses;
+        auto **visible = static_cast<Clause **>(Engine::current().heap.allocate(count * sizeof(Clause *)));
+        count = std::copy_if(found.clauses, found.clauses + count, visible,
+                             [&](const Clause *cl) { return cl->visible(found.generation); }) -
+                visible;
+        return visible;
+    }
+
+    switch (t.state) {
+    case Table::COMPLETE:
+        break;
+    case Table::EVALUATING:
+        // A recursive call: the current evaluation depends on this one.
+        stack.back()->low = std::min(stack.back()->low, t.depth);
+        break;
+    case Table::NEW:
+    case Table::INCOMPLETE:
+        evaluate(prog, goal, t);
+        break;
+    }
+
+    count = t.answers.size();
+    if (t.state == Table::COMPLETE)
+        return t.answers.data();
+
+    partial++;
+    auto **copy = static_cast<Clause **>(Engine::current().heap.allocate(count * sizeof(Clause *)));
+    std::copy(t.answers.begin(), t.answers.end(), copy);
+    return copy;
+}
+
+//
+// Find all answers of the goal, and complete the table when possible.
+// The evaluation is repeated while it gets new answers, and some
+// incomplete answers were used: they could have grown meanwhile.
+// A table which took no answers from older evaluations is a leader:
+// when it is done, so are all the tables evaluated after it.
+// When the deadline of the engine passes, the tables keep their answers,
+// but none is complete: they are evaluated again at the next call.
+//
+void Tables::evaluate(Program *prog, Compound *goal, Table &t)
+{
+    t.state = Table::EVALUATING;
+    t.depth = t.low = stack.size();
+    stack.push_back(&t);
+    size_t first = evaluated.size();
+    evaluated.push_back(&t);
+
+    const Deadline *deadline = Engine::current().deadline;
+    size_t before;
+    size_t used;
+    do {
+        before = total;
+        used = partial;
+        bypass = &t;
+
+        Solver<> solver(prog, new Goal(goal));
+        solver.set_tabling(this);
+        while (solver.next())
+            add(t, goal);
+    } while (total != before && partial != used && !(deadline && deadline->expired()));
+    stack.pop_back();
+
+    if (deadline && deadline->expired()) {
+        for (size_t i = first; i < evaluated.size(); i++)
+            evaluated[i]->state = Table::INCOMPLETE;
+        evaluated.resize(first);
+    } else if (t.low == t.depth) {
+        for (size_t i = first; i < evaluated.size(); i++)
+            evaluated[i]->state = Table::COMPLETE;
+        evaluated.resize(first);
+    } else {
+        t.state = Table::INCOMPLETE;
+        stack.back()->low = std::min(stack.back()->low, t.low);
+    }
+}
+
+//
+// Add an answer to the table, unless it has a variant already.
+// The answer becomes a fact in the engine of the tables: it is copied
+// once, and its ground subterms stay there rather than in the pool of constants.
+//
+void Tables::add(Table &t, Compound *answer)
+{
+    if (!t.variants.insert(variant_key(answer)).second)
+        return;
+
+    Engine::Scope scope(store);
+    Freezer f;
+    Compound *head = f.copy_compound(answer);
+    t.answers.push_back(new Clause(head, nullptr, f.size(), false));
+    total++;
+}
@@ -0,0 +1,78 @@
+//
+// Tabling: memoized answers of calls of selected predicates.
+//
+#ifndef TABLE_H
+#define TABLE_H
+
+#include <mutex>
+#include <string>
+#include <unordered_set>
+
+#include "prolog.h"
+
+//
+// Answer tables, keyed by call patterns up to renaming of variables (variants).
+// A call with a new pattern is evaluated with the clauses of the program,
+// by a nested solver, until no more answers appear; later calls with the
+// same pattern take the answers from the table.
+// A recursive call of a pattern which is still being evaluated gets
+// the answers found so far, and the evaluation is repeated until a fixpoint.
+// Patterns which depend on each other are completed together, when the
+// evaluation of the oldest of them (the leader) reaches its fixpoint.
+// Answers are kept in an engine of their own, as long as the tables live.
+// Goals inside of an evaluation are not traced.
+// Solvers on several threads can share the tables: one call at a time
+// is answered, under a lock.
+//
+class Tables : public Tabling {
+    //
+    // Answers of one call pattern.
+    //
+    struct Table {
+        enum State {
+            NEW,        // Never evaluated
+            EVALUATING, // Being evaluated now
+            INCOMPLETE, // Evaluated, but depends on a table which is being evaluated
+            COMPLETE,   // All answers are found
+        };
+        State state{ NEW };
+        std::vector<Clause *> answers;
+        std::unordered_set<std::string> variants;
+        size_t depth{ 0 }; // Position on the stack of evaluations
+        size_t low{ 0 };   // Lowest position of the evaluations it took answers from
+    };
+
+    std::unordered_set<uint64_t> predicates;
+    std::unordered_map<std::string, Table> tables;
+    std::vector<Table *> stack;     // Tables being evaluated, the oldest first
+    std::vector<Table *> evaluated; // Tables evaluated, but not complete yet
+    Table *bypass{ nullptr };       // Table whose pattern is resolved with the program next
+    size_t total{ 0 };              // Number of answers in all tables
+    size_t partial{ 0 };            // Number of times incomplete answers were taken
+    std::recursive_mutex lock;      // Held while a call is answered
+    Engine store;
+
+    // Append the key of the term, with variables numbered in the order of appearance.
+    static void variant(Term *t, std::string &key, std::unordered_map<Term *, unsigned> &vars);
+
+    // Return the key of the call pattern.
+    static std::string variant_key(Term *t);
+
+    // Find all answers of the goal, and complete the table when possible.
+    void evaluate(Program *prog, Compound *goal, Table &t);
+
+    // Add an answer to the table, unless it has a variant already.
+    void add(Table &t, Compound *answer);
+
+public:
+    // Keep tables for calls of the predicate.
+    void table(const Atom *functor, int arity) { predicates.insert(Compound::make_key(functor, arity)); }
+
+    // Return true when calls of the predicate of the goal are tabled.
+    bool tabled(const Compound *goal) const override { return predicates.count(goal->key()) != 0; }
+
+    // Return the clauses to resolve the tabled goal with.
+    Clause *const *answers(Program *prog, Compound *goal, size_t &count) override;
+};
+
+#endif // TABLE_H
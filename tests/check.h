@@ -0,0 +1,78 @@
+//
+// Helpers of the behaviour checks: failed checks are reported and counted,
+// and the answers of a query are collected as text, to compare the solvers.
+//
+#ifndef CHECK_H
+#define CHECK_H
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "libprolog.h"
+
+static int failures = 0;
+
+//
+// Report a failed check, with its place in the source.
+//
+static void check(bool ok, const char *text, const char *file, int line)
+{
+    if (!ok) {
+        std::cerr << file << ":" << line << ": check failed: " << text << "\n";
+        failures++;
+    }
+}
+
+#define CHECK(condition) check((condition), #condition, __FILE__, __LINE__)
+
+//
+// Read the program text; a syntax error fails the test at once.
+//
+static Program *program(const std::string &text)
+{
+    Reader reader(text);
+    Program *prog = reader.read_program();
+    if (reader.failed()) {
+        std::cerr << "program: " << reader.error() << "\n";
+        std::exit(1);
+    }
+    return prog;
+}
+
+//
+// Solve the query with the sequential solver, and return the answers,
+// each as the lines the interpreter prints for it.
+//
+static std::vector<std::string> answers(Program *prog, const std::string &text, size_t limit = SIZE_MAX)
+{
+    Reader reader(text);
+    Goal *goal = reader.read_query();
+    if (!goal) {
+        std::cerr << "query: " << (reader.failed() ? reader.error() : "empty") << "\n";
+        std::exit(1);
+    }
+    VarMapping vars = reader.variables();
+    std::vector<std::string> result;
+    for (const Solution &s : query(prog, goal, &vars, limit)) {
+        std::string text;
+        StringSink sink(text);
+        Writer out(sink);
+        s.write(out);
+        out.flush();
+        result.push_back(text);
+    }
+    return result;
+}
+
+//
+// Return the exit status of the test, after a summary of the failures.
+//
+static int report()
+{
+    if (failures)
+        std::cerr << failures << " check(s) failed\n";
+    return failures ? 1 : 0;
+}
+
+#endif // CHECK_H
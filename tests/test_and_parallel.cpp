@@ -0,0 +1,136 @@
+//
+// AND-parallel fork: independent goals give the answers of the sequential
+// solver, in its order; goals with too many solutions are declined rather
+// than run forever, and tabled goals of a group use the tables.
+// Goals with side effects are never forked: they run once, in order.
+//
+#include <algorithm>
+
+#include "check.h"
+#include "parallel.h"
+#include "table.h"
+
+//
+// Solve the query with the fork, and the tables if any; return the answers.
+//
+static std::vector<std::string> forked_answers(Program *prog, Fork &fork, const std::string &text,
+                                               size_t limit = SIZE_MAX, Tabling *tabling = nullptr)
+{
+    Reader reader(text);
+    Goal *goal = reader.read_query();
+    VarMapping vars = reader.variables();
+    std::vector<std::string> result;
+    Solver<> solver(prog, goal);
+    solver.set_fork(&fork);
+    solver.set_tabling(tabling);
+    solver.set_limit(limit);
+    while (solver.next()) {
+        std::string answer;
+        StringSink sink(answer);
+        Writer out(sink);
+        out.answer(vars);
+        out.flush();
+        result.push_back(answer);
+    }
+    return result;
+}
+
+//
+// Fork which counts the goals given to another one.
+//
+struct Counting : Fork {
+    Fork &inner;
+    size_t goals{ 0 };
+
+    explicit Counting(Fork &f) : inner(f) {}
+
+    Clause *const *join(Program *prog, Tabling *tabling, Compound *const *g, int n, size_t &count) override
+    {
+        goals += n;
+        return inner.join(prog, tabling, g, n, count);
+    }
+};
+
+int main()
+{
+    Program *prog = program("p(1). p(2). p(3).\n"
+                            "q(a). q(b).\n"
+                            "r(X, Y) :- p(X), q(Y).\n"
+                            "s(X, Y, Z) :- p(X), q(Y), p(Z), X < Z.\n"
+                            "nat(0).\n"
+                            "nat(N) :- nat(M), N is M + 1.\n"
+                            "m(X, [X|_]).\n"
+                            "m(X, [_|T]) :- m(X, T).\n"
+                            "spin(X) :- spin(X).\n"
+                            "v(f(_)).\n"
+                            "edge(a, b). edge(b, a). edge(b, c).\n"
+                            "path(X, Y) :- path(X, Z), edge(Z, Y).\n"
+                            "path(X, Y) :- edge(X, Y).\n"
+                            "pairs(L) :- findall(X-Y, r(X, Y), L).\n"
+                            "paths(L) :- findall(X-Y, (path(a, X), path(b, Y)), L).\n");
+    AndParallel fork(3);
+    for (const char *text : { "r(X, Y).", "s(X, Y, Z).", "p(X), q(Y), p(Z).", "p(X), q(c)." }) {
+        std::vector<std::string> expected = answers(prog, text);
+        CHECK(forked_answers(prog, fork, text) == expected);
+    }
+
+    // A goal with infinitely many solutions: the fork declines it.
+    const char *infinite = "nat(X), m(Y, [a]), X > 2.";
+    CHECK(forked_answers(prog, fork, infinite, 3) == answers(prog, infinite, 3));
+
+    // A goal which fails stops the others, which could run forever.
+    CHECK(forked_answers(prog, fork, "q(c), spin(Y).").empty());
+
+    // Solutions with variables of their own are kept apart in the joined facts.
+    CHECK(forked_answers(prog, fork, "v(X), v(Y), X = f(1), Y = f(2).").size() == 1);
+
+    // Tabled goals of a group take their answers from the tables.
+    Tables tables;
+    tables.table(Atom::intern("path"), 2);
+    std::vector<std::string> tabled = forked_answers(prog, fork, "path(a, X), path(c, Y).", SIZE_MAX, &tables);
+    CHECK(tabled.empty());
+    tabled = forked_answers(prog, fork, "path(a, X), path(b, Y).", SIZE_MAX, &tables);
+    CHECK(tabled.size() == 9);
+
+    // Side effects end a group: the goals before an assert do not see its clause,
+    // and goals which the fork declines after solving them change nothing.
+    // Each solver gets a program of its own, as the queries change it.
+    const std::string effects = "q0.\n"
+                                "g(0).\n"
+                                "slow(0).\n"
+                                "slow(N) :- N > 0, M is N - 1, slow(M).\n"
+                                "fx(X) :- slow(200000), g(X).\n"
+                                "t9(X) :- q0, fx(X), assertz(g(1)).\n"
+                                "len([], 0).\n"
+                                "len([_|T], N) :- len(T, M), N is M + 1.\n"
+                                "t10(N) :- q0, assertz(k(1)), between(1, 2000, _), !, findall(x, k(_), L), len(L, N).\n"
+                                "u(X) :- g(X), findall(Y, g(Y), L), len(L, 1).\n";
+    Counting counting(fork);
+    for (const char *text : { "t9(X).", "t10(N).", "t9(X), t9(Y).", "q0, u(X)." }) {
+        std::vector<std::string> expected = answers(program(effects), text);
+        CHECK(!expected.empty());
+        CHECK(forked_answers(program(effects), counting, text) == expected);
+    }
+    CHECK(answers(program(effects), "t9(X).") == std::vector<std::string>{ "X = 0\n" });
+    CHECK(answers(program(effects), "t10(N).") == std::vector<std::string>{ "N = 1\n" });
+
+    // Pure goals are still forked, also when they call findall/3 or once/1 of pure goals.
+    counting.goals = 0;
+    forked_answers(program(effects), counting, "t9(X).");
+    CHECK(counting.goals == 2);
+    counting.goals = 0;
+    forked_answers(program(effects), counting, "t10(N).");
+    CHECK(counting.goals == 0);
+    counting.goals = 0;
+    CHECK(forked_answers(prog, counting, "p(X), findall(Y, q(Y), L), once(p(Z)).").size() == 3);
+    CHECK(counting.goals == 3);
+
+    // The goal of findall/3 is forked too, and so is a tabled one, with the tables.
+    counting.goals = 0;
+    CHECK(forked_answers(prog, counting, "pairs(L).") == answers(prog, "pairs(L)."));
+    CHECK(counting.goals == 2);
+    counting.goals = 0;
+    CHECK(forked_answers(prog, counting, "paths(L).", SIZE_MAX, &tables).size() == 1);
+    CHECK(counting.goals == 2);
+    return report();
+}
@@ -0,0 +1,43 @@
+//
+// Assert and retract, with the logical update view: a call sees the clauses
+// as they were when it was made. The terms of a retracted clause are retired
+// at once, and freed when the calls which could see them have finished.
+//
+#include "check.h"
+
+int main()
+{
+    Program *prog = program("p(1). p(2). p(3).\n"
+                            "step(1) :- retract(p(3)).\n"
+                            "step(2).\n"
+                            "step(3).\n"
+                            "grow :- assert(q(1)), assert(q(2)).\n"
+                            "more(X) :- q(X), Y is X + 2, assert(q(Y)).\n");
+
+    // Clauses asserted before a call are seen by it.
+    CHECK(answers(prog, "grow, findall(X, q(X), L).").size() == 1);
+    CHECK(answers(prog, "findall(X, q(X), L), L = [1, 2].").size() == 1);
+
+    // Clauses asserted during a call are not.
+    CHECK(answers(prog, "more(X).").size() == 2);
+    CHECK(answers(prog, "findall(X, q(X), L), L = [1, 2, 3, 4].").size() == 1);
+
+    // Clauses retracted during a call are still seen by it, but not by later calls.
+    CHECK(answers(prog, "p(X), step(X).").size() == 3);
+    CHECK(answers(prog, "p(X).").size() == 2);
+    CHECK(answers(prog, "p(X), retract(p(2)).") == std::vector<std::string>{ "X = 1\n" });
+    CHECK(answers(prog, "p(X).") == std::vector<std::string>{ "X = 1\n" });
+    CHECK(answers(prog, "retract(p(2)).").empty());
+
+    // A retracted clause is retired at once, even when most clauses of its predicate stay.
+    CHECK(answers(prog, "assert(r(1)), assert(r(2)), assert(r(3)), assert(r(4)).").size() == 1);
+    size_t before = Epochs::pending();
+    CHECK(answers(prog, "retract(r(2)).").size() == 1);
+    CHECK(Epochs::pending() > before);
+    CHECK(answers(prog, "r(X), r(Y), X > Y.").size() == 3);
+
+    // Backtracking does not undo a retract.
+    CHECK(answers(prog, "retract(r(X)), X > 2.").size() == 2);
+    CHECK(answers(prog, "r(X).").empty());
+    return report();
+}
@@ -0,0 +1,171 @@
+//
+// Binary encoding of answers: the answers of the sequential solver,
+// encoded and decoded, print as the original ones, variables stay
+// shared between the values, and incomplete or malformed input is rejected,
+// leaving the decoder ready for the rest of a stream.
+//
+#include "check.h"
+
+//
+// Print the decoded variables and values, as Writer::answer() does.
+//
+static std::string text_of(const std::vector<std::pair<std::string, Term *>> &values)
+{
+    std::string text;
+    StringSink sink(text);
+    Writer out(sink);
+    if (values.empty())
+        out.put("yes\n");
+    for (const auto &[name, value] : values) {
+        out.put(name);
+        out.put(" = ");
+        out.term(value);
+        out.put('\n');
+    }
+    out.flush();
+    return text;
+}
+
+//
+// Encode all the answers of the query with one encoder, decode them with one
+// decoder, and return their bytes; check that they print as the originals.
+//
+static std::string round_trip(Program *prog, const std::string &text)
+{
+    std::vector<std::string> expected = answers(prog, text);
+    Reader reader(text);
+    Goal *goal = reader.read_query();
+    VarMapping vars = reader.variables();
+    std::string bytes;
+    {
+        StringSink sink(bytes);
+        Writer out(sink);
+        TermEncoder encoder(out);
+        for (const Solution &s : query(prog, goal, &vars))
+            s.encode(encoder);
+    }
+
+    TermDecoder decoder;
+    std::string_view in(bytes);
+    std::vector<std::string> decoded;
+    while (!in.empty()) {
+        std::vector<std::pair<std::string, Term *>> values;
+        if (!decoder.answer(in, values))
+            break;
+        decoded.push_back(text_of(values));
+    }
+    CHECK(in.empty());
+    CHECK(decoded == expected);
+    return bytes;
+}
+
+int main()
+{
+    Program *prog = program("q(1). q(2). q(3).\n"
+                            "p(X, Y) :- q(X), q(Y), X < Y.\n"
+                            "app([], L, L).\n"
+                            "app([H|T], L, [H|R]) :- app(T, L, R).\n"
+                            "mk(0, []).\n"
+                            "mk(N, [N|T]) :- N > 0, M is N - 1, mk(M, T).\n"
+                            "deep(0, z).\n"
+                            "deep(N, g(T, N)) :- N > 0, M is N - 1, deep(M, T).\n");
+
+    round_trip(prog, "p(X, Y).");
+    round_trip(prog, "app(X, Y, [a, 2.5, -3, 'hello world']).");
+    round_trip(prog, "X = f(9223372036854775807, -9223372036854775807 - 1, 0.1, -0.0).");
+    round_trip(prog, "q(1).");
+    round_trip(prog, "mk(100000, L).");
+    round_trip(prog, "deep(100000, T).");
+
+    // Every proper prefix of an answer is incomplete.
+    std::string bytes = round_trip(prog, "X = point(1, -2.5, name), Y = [X, X].");
+    for (size_t n = 0; n < bytes.size(); n++) {
+        TermDecoder decoder;
+        std::string_view in(bytes.data(), n);
+        std::vector<std::pair<std::string, Term *>> values;
+        CHECK(!decoder.answer(in, values));
+    }
+    std::string_view bad("\x01\x01X?");
+    std::vector<std::pair<std::string, Term *>> ignored;
+    CHECK(!TermDecoder().answer(bad, ignored));
+
+    // Malformed terms: an atom or a variable not defined yet, more arguments
+    // than bytes, a number longer than 64 bits, a name longer than the input.
+    using namespace std::string_view_literals;
+    for (std::string_view term : { "C\x00\x00"sv, "V\x01"sv, "A\x01\x66\x05I\x00"sv, "I\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff\x01"sv,
+                                   "A\x09\x66"sv }) {
+        std::string_view in = term;
+        CHECK(TermDecoder().decode(in) == nullptr);
+        CHECK(in.size() == term.size());
+    }
+
+    // A term which fails defines no atoms and no variables.
+    TermDecoder after;
+    std::string_view failing("A\x01\x66\x02V\x00?"sv);
+    CHECK(after.decode(failing) == nullptr);
+    std::string_view atom("C\x00\x00"sv), var("V\x01"sv);
+    CHECK(after.decode(atom) == nullptr);
+    CHECK(after.decode(var) == nullptr);
+
+    // A stream which arrives byte by byte: an answer is decoded once it is complete,
+    // and the attempts before leave the atoms numbered as by the encoder.
+    const char *stream = "app(X, Y, [f(a), f(b), g(a, f(b))]).";
+    std::vector<std::string> expected = answers(prog, stream);
+    std::string all;
+    {
+        Reader reader(stream);
+        Goal *goal = reader.read_query();
+        VarMapping vars = reader.variables();
+        StringSink sink(all);
+        Writer out(sink);
+        TermEncoder encoder(out);
+        for (const Solution &s : query(prog, goal, &vars))
+            s.encode(encoder);
+    }
+    TermDecoder incremental;
+    std::vector<std::string> decoded;
+    size_t start = 0;
+    for (size_t n = 1; n <= all.size(); n++) {
+        std::string_view in(all.data() + start, n - start);
+        std::vector<std::pair<std::string, Term *>> values;
+        if (incremental.answer(in, values)) {
+            CHECK(in.empty());
+            decoded.push_back(text_of(values));
+            start = n;
+        } else {
+            CHECK(values.empty());
+        }
+    }
+    CHECK(start == all.size());
+    CHECK(decoded == expected);
+
+    // Unbound variables of an answer are shared between its values.
+    Reader reader("X = f(A, B, A), Y = g(B).");
+    Goal *goal = reader.read_query();
+    VarMapping vars = reader.variables();
+    std::string shared;
+    {
+        StringSink sink(shared);
+        Writer out(sink);
+        TermEncoder encoder(out);
+        for (const Solution &s : query(prog, goal, &vars))
+            s.encode(encoder);
+    }
+    std::string_view in(shared);
+    std::vector<std::pair<std::string, Term *>> values;
+    CHECK(TermDecoder().answer(in, values));
+    CHECK(values.size() == 4);
+    if (values.size() == 4) {
+        Compound *x = values[0].second->as_compound();
+        Compound *y = values[3].second->as_compound();
+        CHECK(x && y && values[1].first == "A" && values[2].first == "B");
+        if (x && y) {
+            CHECK(x->arg(0)->deref() == values[1].second->deref());
+            CHECK(x->arg(2)->deref() == x->arg(0)->deref());
+            CHECK(x->arg(1)->deref() == y->arg(0)->deref());
+            CHECK(x->arg(0)->deref()->as_variable() != nullptr);
+            CHECK(x->arg(0)->deref() != x->arg(1)->deref());
+        }
+    }
+    return report();
+}
@@ -0,0 +1,62 @@
+//
+// Garbage collection: a query gives the same answers with collections
+// as without them, and collecting a heap of much live data costs
+// a bounded multiple of the work of the query itself.
+//
+#include <chrono>
+
+#include "check.h"
+
+//
+// Solve the query with collections every given growth of the heap, or none
+// for zero; return the answers, and add the time taken to the total.
+//
+static std::vector<std::string> collected(Program *prog, const std::string &text, size_t threshold, double &total)
+{
+    Engine &engine = Engine::current();
+    size_t saved = engine.gc_threshold;
+    engine.gc_threshold = threshold;
+    auto started = std::chrono::steady_clock::now();
+    std::vector<std::string> result = answers(prog, text);
+    total += std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    engine.gc_threshold = saved;
+    return result;
+}
+
+int main()
+{
+    Program *prog = program("mk(0, []).\n"
+                            "mk(N, [N|T]) :- N > 0, M is N - 1, mk(M, T).\n"
+                            "len([], 0).\n"
+                            "len([_|T], N) :- len(T, M), N is M + 1.\n"
+                            "sum([], 0).\n"
+                            "sum([X|T], S) :- sum(T, S0), S is S0 + X.\n"
+                            "big(N, S) :- mk(N, L), len(L, N), sum(L, S).\n"
+                            "mem(X, [X|_]).\n"
+                            "mem(X, [_|T]) :- mem(X, T).\n"
+                            "pick(N, X) :- mk(N, L), mem(X, L), X mod 50000 =:= 0, len(L, N).\n");
+    const char *queries[] = {
+        "big(200000, S).",
+        "pick(200000, X).",
+        "X = f(Y), big(100000, S), Y = S.",
+        "big(1000, S), pick(100000, X), big(2000, T).",
+    };
+
+    Counters &counters = Engine::current().counters;
+    double on = 0, off = 0;
+    for (const char *text : queries) {
+        std::vector<std::string> expected = collected(prog, text, 0, off);
+        CHECK(!expected.empty());
+        uint64_t before = counters.collections;
+        CHECK(collected(prog, text, 1 << 20, on) == expected);
+        CHECK(counters.collections > before);
+    }
+    CHECK(answers(prog, "pick(200000, X).").size() == 4);
+
+    // Collections as often as every block of the heap grow apart with the live data,
+    // so they cost a few times the query, not a multiple of its length.
+    CHECK(on < 10 * off + 0.5);
+    if (on >= 10 * off + 0.5)
+        std::cerr << "with collections " << on << " s, without " << off << " s\n";
+    return report();
+}
@@ -0,0 +1,60 @@
+//
+// Numbers are terms of their own kind: they unify only with variables
+// and with equal numbers of the same type, from either side, and are not
+// mistaken for atoms. An integer overflow in arithmetic fails the goal,
+// and is counted on the engine.
+//
+#include "check.h"
+
+int main()
+{
+    Program *prog = program("a.\n"
+                            "n(1, one). n(2, two). n(1.0, real). n('$integer', atom).\n"
+                            "t('$integer'). t('$float').\n"
+                            "big(X) :- X is 9223372036854775807 + 1.\n");
+
+    // No atom equals a number, in either order.
+    CHECK(answers(prog, "X = '$integer', X = 1.").empty());
+    CHECK(answers(prog, "X = 1, X = '$integer'.").empty());
+    CHECK(answers(prog, "'$float' = 1.5.").empty());
+    CHECK(answers(prog, "1.5 = '$float'.").empty());
+    CHECK(answers(prog, "t(1).").empty());
+    CHECK(answers(prog, "t(2.0).").empty());
+    CHECK(answers(prog, "1 = 1.").size() == 1);
+    CHECK(answers(prog, "1 = 1.0.").empty());
+    CHECK(answers(prog, "1 == 1.0.").empty());
+
+    // Type checks see numbers as atomic, but not as atoms or goals.
+    CHECK(answers(prog, "atomic(1).").size() == 1);
+    CHECK(answers(prog, "atomic(1.5).").size() == 1);
+    CHECK(answers(prog, "atom(1).").empty());
+    CHECK(answers(prog, "callable(1).").empty());
+    CHECK(answers(prog, "atom('$integer').").size() == 1);
+    CHECK(answers(prog, "functor(1, N, A).") == std::vector<std::string>{ "N = 1\nA = 0\n" });
+    CHECK(answers(prog, "functor(X, 2.5, 0).") == std::vector<std::string>{ "X = 2.5\n" });
+
+    // Indexing on a number argument finds only the equal number.
+    CHECK(answers(prog, "n(1, X).") == std::vector<std::string>{ "X = one\n" });
+    CHECK(answers(prog, "n(1.0, X).") == std::vector<std::string>{ "X = real\n" });
+    CHECK(answers(prog, "n('$integer', X).") == std::vector<std::string>{ "X = atom\n" });
+    CHECK(answers(prog, "n(3, X).").empty());
+    CHECK(answers(prog, "n(N, X).").size() == 4);
+
+    // Overflows fail, and are counted; other errors are not overflows.
+    Counters &counters = Engine::current().counters;
+    uint64_t before = counters.overflows;
+    CHECK(answers(prog, "X is 9223372036854775807 + 1.").empty());
+    CHECK(answers(prog, "big(X).").empty());
+    CHECK(answers(prog, "X is -9223372036854775807 - 2.").empty());
+    CHECK(answers(prog, "X is 4294967296 * 4294967296.").empty());
+    CHECK(answers(prog, "X is 2 ^ 63.").empty());
+    CHECK(answers(prog, "X is -(-9223372036854775807 - 1).").empty());
+    CHECK(counters.overflows == before + 6);
+    CHECK(answers(prog, "X is 1 // 0.").empty());
+    CHECK(answers(prog, "X is Y + 1.").empty());
+    CHECK(counters.overflows == before + 6);
+    CHECK(answers(prog, "X is 9223372036854775806 + 1.") ==
+          std::vector<std::string>{ "X = 9223372036854775807\n" });
+    CHECK(answers(prog, "X is 2 ^ 62.") == std::vector<std::string>{ "X = 4611686018427387904\n" });
+    return report();
+}
@@ -0,0 +1,96 @@
+//
+// OR-parallel search: all answers of the sequential solver, in its order
+// when asked, and as the same set otherwise, also for programs with cuts.
+//
+#include <algorithm>
+#include <sstream>
+
+#include "check.h"
+#include "parallel.h"
+
+//
+// Solve the query on the workers, and return the printed answers.
+//
+static std::string solve_parallel(Program *prog, const std::string &text, unsigned workers, bool ordered)
+{
+    std::ostringstream out;
+    Engine engine(out);
+    Engine::Scope scope(engine);
+    Reader reader(text);
+    Goal *goal = reader.read_query();
+    VarMapping vars = reader.variables();
+    OrParallel(prog, workers, ordered).solve(goal, &vars);
+    return out.str();
+}
+
+//
+// Split the printed answers of a query with one variable into lines, sorted.
+//
+static std::vector<std::string> sorted_lines(const std::string &text)
+{
+    std::vector<std::string> lines;
+    std::istringstream in(text);
+    for (std::string line; std::getline(in, line);)
+        lines.push_back(line);
+    std::sort(lines.begin(), lines.end());
+    return lines;
+}
+
+//
+// Return true when the sequential solver, at its first solution of the query,
+// can give away the alternatives of its oldest choice point.
+//
+static bool donates(Program *prog, const std::string &text)
+{
+    Reader reader(text);
+    Goal *goal = reader.read_query();
+    Solver<> solver(prog, goal);
+    if (!solver.next())
+        return false;
+    return solver.donate([](Compound *, const Continuation &, Clause *const *, Clause *const *) {});
+}
+
+int main()
+{
+    Program *prog = program("sel(X, [X|T], T).\n"
+                            "sel(X, [H|T], [H|R]) :- sel(X, T, R).\n"
+                            "perm([], []).\n"
+                            "perm(L, [X|P]) :- sel(X, L, R), perm(R, P).\n"
+                            "safe([]).\n"
+                            "safe([Q|Qs]) :- noattack(Q, Qs, 1), safe(Qs).\n"
+                            "noattack(_, [], _).\n"
+                            "noattack(Q, [Q1|Qs], D) :- Q =\\= Q1 + D, Q =\\= Q1 - D, D1 is D + 1,\n"
+                            "    noattack(Q, Qs, D1).\n"
+                            "queens(Qs) :- perm([1,2,3,4,5,6], Qs), safe(Qs).\n");
+    for (const char *text : { "perm([1,2,3,4,5], P).", "queens(Qs).", "sel(X, [a,b,c], R)." }) {
+        std::string expected;
+        for (const std::string &a : answers(prog, text))
+            expected += a;
+        CHECK(!expected.empty());
+        for (unsigned workers : { 1u, 2u, 4u }) {
+            CHECK(solve_parallel(prog, text, workers, true) == expected);
+            CHECK(sorted_lines(solve_parallel(prog, text, workers, false)) == sorted_lines(expected));
+        }
+    }
+
+    // Choice points which no cut can remove are given away in a program with cuts.
+    Program *cuts = program("sel(X, [X|T], T).\n"
+                            "sel(X, [H|T], [H|R]) :- sel(X, T, R).\n"
+                            "first([X|_], X) :- !.\n"
+                            "max(X, Y, X) :- X >= Y, !.\n"
+                            "max(_, Y, Y).\n");
+    CHECK(donates(cuts, "sel(X, [1,2,3], R), first(R, Y)."));
+    CHECK(donates(cuts, "sel(X, [1,2,3], _), sel(Y, [1,2,3], _), max(X, Y, Z)."));
+    CHECK(!donates(cuts, "sel(X, [1,2,3], R), !."));
+    CHECK(!donates(cuts, "once(sel(X, [1,2,3], R))."));
+    CHECK(!donates(cuts, "max(3, 1, Z)."));
+    for (const char *text : { "sel(X, [1,2,3], _), sel(Y, [1,2,3], _), max(X, Y, Z).", "sel(X, [1,2,3], R), !.",
+                              "sel(X, [1,2,3], R), once(sel(Y, R, _))." }) {
+        std::string expected;
+        for (const std::string &a : answers(cuts, text))
+            expected += a;
+        for (unsigned workers : { 1u, 2u, 4u })
+            CHECK(solve_parallel(cuts, text, workers, true) == expected);
+    }
+    return report();
+}
@@ -0,0 +1,104 @@
+//
+// Engine pool and deadlines: queries solved on leased engines from many
+// threads give the answers of the sequential solver, and a query stops
+// when its deadline passes or it is cancelled, leaving the engine
+// ready for the next lease. A deadline which passes in the goal of
+// findall/3 stops the whole query, rather than giving a shorter list.
+//
+#include <chrono>
+#include <thread>
+
+#include "check.h"
+
+int main()
+{
+    Program *prog = program("q(1). q(2). q(3).\n"
+                            "p(X, Y) :- q(X), q(Y), X < Y.\n"
+                            "app([], L, L).\n"
+                            "app([H|T], L, [H|R]) :- app(T, L, R).\n"
+                            "loop :- loop.\n"
+                            "nat(0).\n"
+                            "nat(N) :- nat(M), N is M + 1.\n"
+                            "all(L) :- findall(X, nat(X), L).\n"
+                            "all(none).\n");
+    const std::vector<std::string> queries = {
+        "p(X, Y).",
+        "app(X, Y, [1, 2, 3]).",
+        "q(X), X > 1.",
+        "q(4).",
+    };
+    std::vector<std::vector<std::string>> expected;
+    for (const std::string &text : queries)
+        expected.push_back(answers(prog, text));
+
+    // More threads than engines: every lease waits for an engine given back.
+    EnginePool pool(prog, 3);
+    CHECK(pool.size() == 3);
+    const unsigned nthreads = 8, rounds = 20;
+    std::vector<std::vector<std::vector<std::string>>> results(nthreads);
+    std::vector<std::thread> threads;
+    for (unsigned t = 0; t < nthreads; t++) {
+        threads.emplace_back([&, t] {
+            for (unsigned r = 0; r < rounds; r++) {
+                EnginePool::Lease lease(pool);
+                results[t].push_back(answers(prog, queries[(t + r) % queries.size()]));
+            }
+        });
+    }
+    for (std::thread &t : threads)
+        t.join();
+    for (unsigned t = 0; t < nthreads; t++)
+        for (unsigned r = 0; r < rounds; r++)
+            CHECK(results[t][r] == expected[(t + r) % queries.size()]);
+
+    // A query past its deadline stops, without answers.
+    EnginePool single(prog, 1);
+    auto started = std::chrono::steady_clock::now();
+    {
+        Deadline deadline(std::chrono::milliseconds(50));
+        EnginePool::Lease lease(single, &deadline);
+        CHECK(answers(prog, "loop.").empty());
+    }
+    CHECK(std::chrono::steady_clock::now() - started < std::chrono::seconds(10));
+
+    // Another thread can cancel the query.
+    {
+        Deadline deadline;
+        EnginePool::Lease lease(single, &deadline);
+        std::thread canceller([&] {
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            deadline.cancel();
+        });
+        CHECK(answers(prog, "loop.").empty());
+        canceller.join();
+    }
+
+    // Cancelled inside findall/3: neither the list found so far, nor the next
+    // clause of the caller, nor a findall/3 around it gives an answer.
+    for (const char *text : { "findall(X, nat(X), L).", "all(L).", "findall(L, findall(X, nat(X), L), M)." }) {
+        Deadline deadline;
+        EnginePool::Lease lease(single, &deadline);
+        std::thread canceller([&] {
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            deadline.cancel();
+        });
+        CHECK(answers(prog, text).empty());
+        canceller.join();
+    }
+
+    // The same with a timeout, also under once/1.
+    for (const char *text : { "all(L).", "once(all(L))." }) {
+        Deadline deadline(std::chrono::milliseconds(20));
+        EnginePool::Lease lease(single, &deadline);
+        CHECK(answers(prog, text).empty());
+    }
+
+    // The engine is reset for the next lease, which has no deadline.
+    {
+        EnginePool::Lease lease(single);
+        CHECK(lease.engine().deadline == nullptr);
+        for (size_t i = 0; i < queries.size(); i++)
+            CHECK(answers(prog, queries[i]) == expected[i]);
+    }
+    return report();
+}
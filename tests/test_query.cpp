@@ -0,0 +1,37 @@
+//
+// Generators of solutions: reading past the last solution keeps
+// returning false, without resuming the finished coroutine.
+//
+#include "check.h"
+
+int main()
+{
+    Program *prog = program("q(1). q(2).\n");
+
+    Reader reader("q(X).");
+    Goal *goal = reader.read_query();
+    VarMapping vars = reader.variables();
+    Generator<Solution> solutions = query(prog, goal, &vars);
+    CHECK(solutions.next());
+    CHECK(solutions.next());
+    CHECK(!solutions.next());
+    CHECK(!solutions.next());
+    CHECK(!solutions.next());
+
+    // A generator which has been moved from has no values.
+    Generator<Solution> taken = std::move(solutions);
+    CHECK(!solutions.next());
+    CHECK(!taken.next());
+
+    // The limit ends the search in the same way.
+    Reader limited("q(X).");
+    goal = limited.read_query();
+    VarMapping first = limited.variables();
+    Generator<Solution> one = query(prog, goal, &first, 1);
+    CHECK(one.next());
+    CHECK(one.value().value("X")->as_number() != nullptr);
+    CHECK(!one.next());
+    CHECK(!one.next());
+    CHECK(answers(prog, "q(X).").size() == 2);
+    return report();
+}
@@ -0,0 +1,39 @@
+//
+// Goals of clause bodies and queries: a variable goal is read
+// as a call of call/1, which solves its argument in place,
+// and once/1 solves a conjunction in the same way.
+//
+#include "check.h"
+
+int main()
+{
+    Program *prog = program("a. b(1). b(2). c(X) :- b(X), X > 1.\n"
+                            "p(G) :- G.\n"
+                            "first(X) :- call((b(X), !)).\n"
+                            "both(X) :- call(b(X)), call(b(X)).\n");
+
+    CHECK(answers(prog, "G = a, G.") == std::vector<std::string>{ "G = a\n" });
+    CHECK(answers(prog, "call(a).") == answers(prog, "a."));
+    CHECK(answers(prog, "call(b(X)).") == answers(prog, "b(X)."));
+    CHECK(answers(prog, "p(a).").size() == 1);
+    CHECK(answers(prog, "p(b(X)).") == answers(prog, "b(X)."));
+    CHECK(answers(prog, "call((b(X), c(X))).") == answers(prog, "b(X), c(X)."));
+    CHECK(answers(prog, "G = (b(X), X > 1), G.").size() == 1);
+    CHECK(answers(prog, "both(X).") == answers(prog, "b(X)."));
+
+    // A cut inside of the call prunes only the choices of its goal.
+    CHECK(answers(prog, "first(X).") == std::vector<std::string>{ "X = 1\n" });
+    CHECK(answers(prog, "call(b(X)), call(!).") == answers(prog, "b(X)."));
+
+    // once/1 takes the first solution of a conjunction too.
+    CHECK(answers(prog, "once((b(X), c(X))).") == std::vector<std::string>{ "X = 2\n" });
+    CHECK(answers(prog, "once((b(X), b(Y))), b(Z).").size() == 2);
+    CHECK(answers(prog, "G = (b(X), X > 1), once(G).").size() == 1);
+    CHECK(answers(prog, "once((b(X), X > 2)).").empty());
+
+    // Unbound and failing goals.
+    CHECK(answers(prog, "call(G).").empty());
+    CHECK(answers(prog, "call(fail).").empty());
+    CHECK(answers(prog, "G = b(3), G.").empty());
+    return report();
+}
@@ -0,0 +1,109 @@
+//
+// Scheduler: queries interleaved in short slices on a few threads give
+// the answers of the sequential solver, a runaway query does not starve
+// the others, and queries end when cancelled, past their timeout,
+// or when their consumer has had enough. A query stopped inside findall/3
+// passes no solution made of the partial list to its consumer.
+//
+#include <thread>
+
+#include "check.h"
+
+//
+// Return a consumer which appends every solution, printed as text, to the list.
+//
+static Scheduler::Consumer collect(std::vector<std::string> &list)
+{
+    return [&list](const Solution &s) {
+        std::string text;
+        StringSink sink(text);
+        Writer out(sink);
+        s.write(out);
+        out.flush();
+        list.push_back(text);
+        return true;
+    };
+}
+
+int main()
+{
+    Program *prog = program("q(1). q(2). q(3).\n"
+                            "p(X, Y) :- q(X), q(Y), X < Y.\n"
+                            "app([], L, L).\n"
+                            "app([H|T], L, [H|R]) :- app(T, L, R).\n"
+                            "nrev([], []).\n"
+                            "nrev([H|T], R) :- nrev(T, RT), app(RT, [H], R).\n"
+                            "loop :- loop.\n"
+                            "nat(0).\n"
+                            "nat(N) :- nat(M), N is M + 1.\n"
+                            "late(X) :- q(X).\n"
+                            "late(L) :- findall(Y, nat(Y), L).\n"
+                            "late(none).\n");
+    const std::vector<std::string> queries = {
+        "p(X, Y).",
+        "app(X, Y, [1, 2, 3, 4]).",
+        "nrev([1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16], R).",
+        "q(X), X > 1.",
+        "q(4).",
+    };
+    std::vector<std::vector<std::string>> expected;
+    for (const std::string &text : queries)
+        expected.push_back(answers(prog, text));
+
+    Scheduler scheduler(prog, 2, 16);
+
+    // A query which never ends keeps running while the others finish.
+    std::shared_ptr<Scheduler::Task> runaway = scheduler.submit("loop.", nullptr);
+
+    const unsigned copies = 10;
+    std::vector<std::vector<std::string>> results(copies * queries.size());
+    std::vector<std::shared_ptr<Scheduler::Task>> tasks;
+    for (size_t i = 0; i < results.size(); i++)
+        tasks.push_back(scheduler.submit(queries[i % queries.size()], collect(results[i]), 1 + i % 3));
+    for (size_t i = 0; i < tasks.size(); i++) {
+        CHECK(tasks[i]->wait() == Scheduler::FINISHED);
+        CHECK(results[i] == expected[i % queries.size()]);
+        CHECK(tasks[i]->solutions() == expected[i % queries.size()].size());
+    }
+    CHECK(runaway->status() == Scheduler::PENDING);
+    runaway->cancel();
+    CHECK(runaway->wait() == Scheduler::CANCELLED);
+
+    // A timeout stops a query in the same way.
+    std::shared_ptr<Scheduler::Task> timed = scheduler.submit("loop.", nullptr, 1, std::chrono::milliseconds(20));
+    CHECK(timed->wait() == Scheduler::CANCELLED);
+
+    // Timed out or cancelled inside findall/3: the solutions found before
+    // are passed on and counted, neither the list cut short nor the next clause is.
+    std::vector<std::string> partial;
+    timed = scheduler.submit("late(X).", collect(partial), 1, std::chrono::milliseconds(20));
+    CHECK(timed->wait() == Scheduler::CANCELLED);
+    CHECK(partial == answers(prog, "q(X)."));
+    CHECK(timed->solutions() == 3);
+    std::vector<std::string> none;
+    std::shared_ptr<Scheduler::Task> nested = scheduler.submit("findall(X, nat(X), L).", collect(none));
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    nested->cancel();
+    CHECK(nested->wait() == Scheduler::CANCELLED);
+    CHECK(none.empty());
+    CHECK(nested->solutions() == 0);
+
+    // The consumer can stop a query after the first solution.
+    std::vector<std::string> first;
+    Scheduler::Consumer keep = collect(first);
+    std::shared_ptr<Scheduler::Task> once = scheduler.submit("q(X).", [keep](const Solution &s) {
+        keep(s);
+        return false;
+    });
+    CHECK(once->wait() == Scheduler::FINISHED);
+    CHECK(once->solutions() == 1);
+    CHECK(first == std::vector<std::string>{ "X = 1\n" });
+
+    // A query which cannot be read is invalid, with the syntax error.
+    std::shared_ptr<Scheduler::Task> invalid = scheduler.submit("q(X", nullptr);
+    CHECK(invalid->wait() == Scheduler::INVALID);
+    CHECK(!invalid->error().empty());
+
+    scheduler.drain();
+    return report();
+}
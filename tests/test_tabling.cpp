@@ -0,0 +1,87 @@
+//
+// Tabling: a left-recursive predicate terminates on a cyclic graph, gives
+// the answers of the sequential solver on an acyclic one, and keeps its
+// answers out of the pool of constants. An evaluation stopped by the deadline
+// gives no answers, and leaves its table to be evaluated again.
+// The goal of findall/3 uses the tables of its caller.
+//
+#include <algorithm>
+#include <chrono>
+
+#include "check.h"
+#include "table.h"
+
+//
+// Solve the query with tabling, and return the answers, sorted.
+//
+static std::vector<std::string> tabled_answers(Program *prog, Tables &tables, const std::string &text)
+{
+    Reader reader(text);
+    Goal *goal = reader.read_query();
+    VarMapping vars = reader.variables();
+    std::vector<std::string> result;
+    Solver<> solver(prog, goal);
+    solver.set_tabling(&tables);
+    while (solver.next()) {
+        std::string answer;
+        StringSink sink(answer);
+        Writer out(sink);
+        out.answer(vars);
+        out.flush();
+        result.push_back(answer);
+    }
+    std::sort(result.begin(), result.end());
+    return result;
+}
+
+int main()
+{
+    Program *prog = program("edge(a, b). edge(b, c). edge(c, d). edge(d, e).\n"
+                            "loop(a, b). loop(b, c). loop(c, a).\n"
+                            "path(X, Y) :- path(X, Z), edge(Z, Y).\n"
+                            "path(X, Y) :- edge(X, Y).\n"
+                            "reach(X, Y) :- edge(X, Y).\n"
+                            "reach(X, Y) :- edge(X, Z), reach(Z, Y).\n"
+                            "cycle(X, Y) :- cycle(X, Z), loop(Z, Y).\n"
+                            "cycle(X, Y) :- loop(X, Y).\n"
+                            "slow(0).\n"
+                            "slow(N) :- N > 0, M is N - 1, slow(M).\n"
+                            "late(X) :- edge(X, _).\n"
+                            "late(z) :- slow(2000000).\n"
+                            "paths(L) :- findall(Y, path(a, Y), U), msort(U, L).\n"
+                            "reaches(L) :- findall(Y, reach(a, Y), U), msort(U, L).\n"
+                            "cycles(L) :- findall(Y, cycle(a, Y), U), msort(U, L).\n"
+                            "nested(L) :- findall(C, cycles(C), [L]).\n");
+    Tables tables;
+    tables.table(Atom::intern("path"), 2);
+    tables.table(Atom::intern("cycle"), 2);
+
+    std::vector<std::string> expected = answers(prog, "reach(a, Y).");
+    std::sort(expected.begin(), expected.end());
+    size_t pooled = Constants::size();
+    CHECK(tabled_answers(prog, tables, "path(a, Y).") == expected);
+    CHECK(tabled_answers(prog, tables, "path(a, Y).") == expected);
+    CHECK(tabled_answers(prog, tables, "cycle(a, Y).").size() == 3);
+    CHECK(tabled_answers(prog, tables, "cycle(X, Y).").size() == 9);
+    CHECK(Constants::size() == pooled);
+
+    // Left-recursive goals terminate under findall/3, also when nested, and on a cycle.
+    Tables fresh;
+    fresh.table(Atom::intern("path"), 2);
+    fresh.table(Atom::intern("cycle"), 2);
+    CHECK(tabled_answers(prog, fresh, "paths(L).") == answers(prog, "reaches(L)."));
+    CHECK(tabled_answers(prog, fresh, "nested(L).") == answers(prog, "msort([c, b, a], L)."));
+    CHECK(tabled_answers(prog, fresh, "cycles(L), path(b, X).").size() == 3);
+
+    Tables timed;
+    timed.table(Atom::intern("late"), 1);
+    {
+        Deadline deadline(std::chrono::milliseconds(20));
+        Engine::current().deadline = &deadline;
+        CHECK(tabled_answers(prog, timed, "late(X).").empty());
+        CHECK(tabled_answers(prog, timed, "findall(X, late(X), L).").empty());
+        Engine::current().deadline = nullptr;
+    }
+    CHECK(tabled_answers(prog, timed, "late(X).").size() == 5);
+    return report();
+}
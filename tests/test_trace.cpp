@@ -0,0 +1,39 @@
+//
+// Binary traces: the solver finds the same answers while tracing,
+// the trace decodes, and a corrupt trace is rejected.
+//
+#include <sstream>
+
+#include "check.h"
+#include "trace.h"
+
+int main()
+{
+    Program *prog = program("app(nil, X, X).\n"
+                            "app(cons(X, L), M, cons(X, N)) :- app(L, M, N).\n");
+    Reader reader("app(I, J, cons(1, cons(2, nil))).");
+    Goal *goal = reader.read_query();
+
+    std::ostringstream trace;
+    size_t count = 0;
+    {
+        BinaryTracer tracer(trace);
+        Solver<BinaryTracer> solver(prog, goal, tracer);
+        while (solver.next())
+            count++;
+    }
+    CHECK(count == answers(prog, "app(I, J, cons(1, cons(2, nil))).").size());
+
+    std::istringstream in(trace.str());
+    std::ostringstream text;
+    CHECK(BinaryTracer::decode(in, text));
+    CHECK(text.str().find("solve@0: app/3\n") == 0);
+
+    // A name longer than the limit, or than the data left.
+    for (std::string name_length : { std::string("\x80\x80\x80\x80\x10", 5), std::string("\x64") }) {
+        std::istringstream bad(std::string("PLT1A\x01", 6) + name_length + "abc");
+        std::ostringstream ignored;
+        CHECK(!BinaryTracer::decode(bad, ignored));
+    }
+    return report();
+}
@@ -0,0 +1,23 @@
+//
+// Conditional trailing: bindings of variables older than the latest
+// choice point are undone on backtracking, however many variables
+// a long query has created before.
+//
+#include "check.h"
+
+int main()
+{
+    Program *prog = program("q(1). q(2). q(3).\n"
+                            "p(X, Y) :- q(X), q(Y), X < Y.\n"
+                            "r(L) :- p(X, Y), L = [X, Y].\n");
+    std::vector<std::string> expected = answers(prog, "r(L).");
+    CHECK(expected.size() == 3);
+    CHECK(expected.front() == "L = .(1,.(2,[]))\n");
+
+    // Variables created from now on have indexes past 32 bits.
+    Engine::current().timestamp = UINT32_MAX - 1;
+    CHECK(answers(prog, "r(L).") == expected);
+    CHECK(Variable::latest() > UINT32_MAX);
+    CHECK(answers(prog, "r(L).") == expected);
+    return report();
+}
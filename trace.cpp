@@ -0,0 +1,140 @@
+//
+// Binary tracer: encoder and decoder.
+//
+#include "trace.h"
+
+//
+// Signature at the start of a binary trace.
+//
+static const char trace_magic[] = { 'P', 'L', 'T', '1' };
+
+BinaryTracer::BinaryTracer(std::ostream &o, TraceLevel l) : TraceLevels(l), out(o)
+{
+    buffer.append(trace_magic, sizeof(trace_magic));
+}
+
+//
+// Append a number in variable-length encoding:
+// seven bits per byte, the high bit set on all bytes but the last.
+//
+void BinaryTracer::put_number(uint64_t n)
+{
+    while (n >= 0x80) {
+        buffer.push_back((char)(n | 0x80));
+        n >>= 7;
+    }
+    buffer.push_back((char)n);
+}
+
+//
+// Append a reference to the atom, defining it first when needed.
+//
+void BinaryTracer::put_atom(const Atom *a)
+{
+    unsigned id = a->get_id();
+    if (id >= known_atoms.size())
+        known_atoms.resize(id + 1, false);
+    if (!known_atoms[id]) {
+        known_atoms[id] = true;
+        buffer.push_back(EVENT_ATOM);
+        put_number(id);
+        put_number(a->name().size());
+        buffer.append(a->name());
+    }
+}
+
+//
+// Append an event about a goal or a clause.
+//
+void BinaryTracer::event(char kind, int level, const Compound *c, unsigned clause)
+{
+    put_atom(c->get_functor());
+    buffer.push_back(kind);
+    put_number(level);
+    put_number(c->get_functor()->get_id());
+    put_number(c->get_arity());
+    if (kind != EVENT_CALL)
+        put_number(clause);
+    if (buffer.size() >= buffer_size)
+        flush();
+}
+
+//
+// Write out the buffered events.
+//
+void BinaryTracer::flush()
+{
+    out.write(buffer.data(), buffer.size());
+    buffer.clear();
+}
+
+//
+// Read a number in variable-length encoding.
+//
+static bool get_number(std::istream &in, uint64_t &n)
+{
+    n = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        int c = in.get();
+        if (c == EOF)
+            return false;
+        n |= (uint64_t)(c & 0x7f) << shift;
+        if (!(c & 0x80))
+            return true;
+    }
+    return false;
+}
+
+//
+// Decode a binary trace into text.
+// Return false when the input is malformed.
+//
+bool BinaryTracer::decode(std::istream &in, std::ostream &out)
+{
+    char magic[sizeof(trace_magic)];
+    if (!in.read(magic, sizeof(magic)) || !std::equal(magic, magic + sizeof(magic), trace_magic))
+        return false;
+
+    std::unordered_map<uint64_t, std::string> names;
+    for (int kind; (kind = in.get()) != EOF;) {
+        uint64_t level, atom, arity, clause = 0;
+        if (kind == EVENT_ATOM) {
+            uint64_t length;
+            if (!get_number(in, atom) || !get_number(in, length) || length > max_name)
+                return false;
+
+            // Read the name in pieces, so that a corrupt length allocates
+            // no more than the data which is actually there.
+            std::string name;
+            char piece[4096];
+            while (name.size() < length) {
+                size_t n = std::min<size_t>(sizeof(piece), length - name.size());
+                if (!in.read(piece, n))
+                    return false;
+                name.append(piece, n);
+            }
+            names[atom] = name;
+            continue;
+        }
+        if (kind != EVENT_CALL && kind != EVENT_TRY && kind != EVENT_NOMATCH)
+            return false;
+        if (!get_number(in, level) || !get_number(in, atom) || !get_number(in, arity))
+            return false;
+        if (kind != EVENT_CALL && !get_number(in, clause))
+            return false;
+
+        Goal::indent(level, out);
+        switch (kind) {
+        case EVENT_CALL:
+            out << "solve@" << level << ": " << names[atom] << "/" << arity << "\n";
+            break;
+        case EVENT_TRY:
+            out << "  try: " << names[atom] << "/" << arity << " clause " << clause << "\n";
+            break;
+        case EVENT_NOMATCH:
+            out << "  nomatch: " << names[atom] << "/" << arity << " clause " << clause << "\n";
+            break;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,149 @@
+//
+// Tracers for the solver: a buffered text tracer,
+// and a compact binary one, which can be decoded offline.
+//
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "prolog.h"
+#include "writer.h"
+
+//
+// Tracing levels per predicate, with a default for all other predicates.
+//
+class TraceLevels {
+    TraceLevel fallback;
+    std::unordered_map<uint64_t, TraceLevel> levels;
+
+public:
+    explicit TraceLevels(TraceLevel l = TRACE_ALL) : fallback(l) {}
+
+    // Set the level for predicates which have no level of their own.
+    void set_level(TraceLevel l) { fallback = l; }
+
+    // Set the level for one predicate.
+    void set_level(const Atom *functor, int arity, TraceLevel l) { levels[Compound::make_key(functor, arity)] = l; }
+
+    // Return the level for the predicate of the given compound.
+    TraceLevel level(const Compound *c) const
+    {
+        if (levels.empty())
+            return fallback;
+        auto found = levels.find(c->key());
+        return (found == levels.end()) ? fallback : found->second;
+    }
+};
+
+//
+// Tracer which prints the events as text, in the format of the original interpreter.
+// The text is collected in the buffer of a writer, and written out in large pieces.
+//
+class TextTracer : public TraceLevels {
+    StreamSink sink;
+    Writer writer;
+
+public:
+    explicit TextTracer(std::ostream &o, TraceLevel l = TRACE_ALL) : TraceLevels(l), sink(o), writer(sink) {}
+
+    // A goal is called.
+    void call(Compound *goal, int level)
+    {
+        if (this->level(goal) < TRACE_CALLS)
+            return;
+        writer.indent(level);
+        writer.put("solve@");
+        writer.put_integer(level);
+        writer.put(": ");
+        writer.term(goal);
+        writer.put('\n');
+    }
+
+    // A clause is tried for the goal.
+    void attempt(Clause *cl, int level)
+    {
+        if (this->level(cl->head) < TRACE_ALL)
+            return;
+        writer.indent(level);
+        writer.put("  try:");
+        writer.clause(cl);
+        writer.put('\n');
+    }
+
+    // The head of the clause does not match the goal.
+    void nomatch(Clause *cl, int level)
+    {
+        if (this->level(cl->head) < TRACE_ALL)
+            return;
+        writer.indent(level);
+        writer.put("  nomatch.\n");
+    }
+
+    // Write out the buffered text.
+    void flush() { writer.flush(); }
+};
+
+//
+// Tracer which writes the events in a compact binary form:
+// a byte of event kind, followed by numbers in variable-length encoding.
+// Names of atoms are written once, before their first use.
+//
+class BinaryTracer : public TraceLevels {
+    static constexpr size_t buffer_size = 64 * 1024;
+    static constexpr size_t max_name = 1 << 20; // Longest name of an atom accepted by decode()
+
+    std::ostream &out;
+    std::string buffer;
+    std::vector<bool> known_atoms;
+
+    // Append a number in variable-length encoding.
+    void put_number(uint64_t n);
+
+    // Append a reference to the atom, defining it first when needed.
+    void put_atom(const Atom *a);
+
+    // Append an event about a goal or a clause.
+    void event(char kind, int level, const Compound *c, unsigned clause);
+
+public:
+    //
+    // Kinds of records.
+    //
+    enum Event : char {
+        EVENT_ATOM = 'A',    // Definition of an atom: ID, length, name
+        EVENT_CALL = 'C',    // Call: level, atom ID, arity
+        EVENT_TRY = 'T',     // Clause tried: level, atom ID, arity, clause number
+        EVENT_NOMATCH = 'N', // Clause does not match: level, atom ID, arity, clause number
+    };
+
+    explicit BinaryTracer(std::ostream &o, TraceLevel l = TRACE_ALL);
+    ~BinaryTracer() { flush(); }
+
+    // A goal is called.
+    void call(Compound *goal, int level)
+    {
+        if (this->level(goal) >= TRACE_CALLS)
+            event(EVENT_CALL, level, goal, 0);
+    }
+
+    // A clause is tried for the goal.
+    void attempt(Clause *cl, int level)
+    {
+        if (this->level(cl->head) >= TRACE_ALL)
+            event(EVENT_TRY, level, cl->head, cl->number);
+    }
+
+    // The head of the clause does not match the goal.
+    void nomatch(Clause *cl, int level)
+    {
+        if (this->level(cl->head) >= TRACE_ALL)
+            event(EVENT_NOMATCH, level, cl->head, cl->number);
+    }
+
+    // Write out the buffered events.
+    void flush();
+
+    // Decode a binary trace into text; return false when the input is malformed.
+    static bool decode(std::istream &in, std::ostream &out);
+};
+
+#endif // TRACE_H
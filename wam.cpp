@@ -0,0 +1,689 @@
+//
+// Warren Abstract Machine: compiler and emulator.
+//
+#include "wam.h"
+
+//
+// Compiler of one clause, or of a query.
+// Variables which occur in more than one goal of the body (the head
+// counts together with the first goal) are permanent, and live
+// in the environment as Y registers. Other variables are temporary,
+// and live in X registers above the argument registers.
+// All variables are created on the heap, so there are no unsafe variables.
+// A cut right after the head removes the choice points made since the call
+// of the predicate (neck cut); a cut after some call needs the barrier saved
+// in the environment.
+//
+class Compiler {
+    //
+    // Allocation of one variable.
+    //
+    struct VarInfo {
+        int first_chunk;
+        int last_chunk;
+        bool permanent;
+        bool seen;
+        unsigned reg;
+    };
+
+    std::vector<Instr> &code;
+    std::unordered_map<Term *, VarInfo> vars;
+    std::vector<Term *> order;
+    unsigned next_temp{ 0 };
+    unsigned nperm{ 0 };
+
+    // Append an instruction.
+    void emit(Instr::Op op, unsigned reg = 0, unsigned arg = 0, Cell cell = Cell(), unsigned arity = 0)
+    {
+        code.push_back({ op, reg, arg, arity, cell, 0 });
+    }
+
+    // Record the variables of a term, occurring in the given chunk.
+    void scan(Term *t, int chunk)
+    {
+        t = t->deref();
+        if (!t->as_variable()) {
+            if (Compound *c = t->as_compound())
+                for (int i = 0; i < c->get_arity(); i++)
+                    scan(c->arg(i), chunk);
+            return;
+        }
+        auto found = vars.find(t);
+        if (found == vars.end()) {
+            vars[t] = { chunk, chunk, false, false, 0 };
+            order.push_back(t);
+        } else {
+            found->second.last_chunk = chunk;
+        }
+    }
+
+    // Assign registers: permanent variables get Y registers in order of appearance.
+    void allocate(unsigned max_arity, bool all_permanent)
+    {
+        next_temp = max_arity;
+        for (Term *t : order) {
+            VarInfo &v = vars[t];
+            v.permanent = all_permanent || v.first_chunk != v.last_chunk;
+            if (v.permanent)
+                v.reg = nperm++;
+        }
+    }
+
+    // Return the register of a variable, allocating a temporary one on first use.
+    VarInfo &variable(Term *t)
+    {
+        VarInfo &v = vars[t];
+        if (!v.permanent && !v.seen)
+            v.reg = next_temp++;
+        return v;
+    }
+
+    // Emit unify instructions for the arguments of a structure.
+    // Nested structures are postponed, and get their own registers.
+    void unify_args(Compound *c, std::vector<std::pair<Compound *, unsigned>> &queue)
+    {
+        for (int i = 0; i < c->get_arity(); i++) {
+            Term *a = c->arg(i)->deref();
+            Compound *sub = a->as_compound();
+            if (a->as_variable()) {
+                VarInfo &v = variable(a);
+                if (v.seen)
+                    emit(v.permanent ? Instr::UNIFY_VALUE_Y : Instr::UNIFY_VALUE_X, v.reg);
+                else
+                    emit(v.permanent ? Instr::UNIFY_VARIABLE_Y : Instr::UNIFY_VARIABLE_X, v.reg);
+                v.seen = true;
+            } else if (!sub || sub->get_arity() == 0) {
+                emit(Instr::UNIFY_CONSTANT, 0, 0, Cell::constant(a));
+            } else {
+                unsigned r = next_temp++;
+                emit(Instr::UNIFY_VARIABLE_X, r);
+                queue.emplace_back(sub, r);
+            }
+        }
+    }
+
+    // Emit get instructions for the head arguments.
+    void get_args(Compound *head)
+    {
+        std::vector<std::pair<Compound *, unsigned>> queue;
+        for (int i = 0; i < head->get_arity(); i++) {
+            Term *a = head->arg(i)->deref();
+            Compound *c = a->as_compound();
+            if (a->as_variable()) {
+                VarInfo &v = variable(a);
+                if (v.seen)
+                    emit(v.permanent ? Instr::GET_VALUE_Y : Instr::GET_VALUE_X, v.reg, i);
+                else
+                    emit(v.permanent ? Instr::GET_VARIABLE_Y : Instr::GET_VARIABLE_X, v.reg, i);
+                v.seen = true;
+            } else if (!c || c->get_arity() == 0) {
+                emit(Instr::GET_CONSTANT, i, 0, Cell::constant(a));
+            } else {
+                emit(Instr::GET_STRUCTURE, i, 0, Cell::fun(c->get_functor(), c->get_arity()));
+                unify_args(c, queue);
+            }
+        }
+        for (size_t k = 0; k < queue.size(); k++) {
+            auto [c, r] = queue[k];
+            emit(Instr::GET_STRUCTURE, r, 0, Cell::fun(c->get_functor(), c->get_arity()));
+            unify_args(c, queue);
+        }
+    }
+
+    // Emit instructions which build a structure in the given register, innermost first.
+    void build(Compound *c, unsigned target)
+    {
+        std::vector<unsigned> regs(c->get_arity());
+        for (int i = 0; i < c->get_arity(); i++) {
+            Compound *sub = c->arg(i)->as_compound();
+            if (sub && sub->get_arity() > 0) {
+                regs[i] = next_temp++;
+                build(sub, regs[i]);
+            }
+        }
+        emit(Instr::PUT_STRUCTURE, target, 0, Cell::fun(c->get_functor(), c->get_arity()));
+        for (int i = 0; i < c->get_arity(); i++) {
+            Term *a = c->arg(i)->deref();
+            Compound *sub = a->as_compound();
+            if (a->as_variable()) {
+                VarInfo &v = variable(a);
+                if (v.seen)
+                    emit(v.permanent ? Instr::UNIFY_VALUE_Y : Instr::UNIFY_VALUE_X, v.reg);
+                else
+                    emit(v.permanent ? Instr::UNIFY_VARIABLE_Y : Instr::UNIFY_VARIABLE_X, v.reg);
+                v.seen = true;
+            } else if (!sub || sub->get_arity() == 0) {
+                emit(Instr::UNIFY_CONSTANT, 0, 0, Cell::constant(a));
+            } else {
+                emit(Instr::UNIFY_VALUE_X, regs[i]);
+            }
+        }
+    }
+
+    // Emit put instructions for the arguments of a body goal.
+    void put_args(Compound *goal)
+    {
+        for (int i = 0; i < goal->get_arity(); i++) {
+            Term *a = goal->arg(i)->deref();
+            Compound *c = a->as_compound();
+            if (a->as_variable()) {
+                VarInfo &v = variable(a);
+                if (v.seen)
+                    emit(v.permanent ? Instr::PUT_VALUE_Y : Instr::PUT_VALUE_X, v.reg, i);
+                else
+                    emit(v.permanent ? Instr::PUT_VARIABLE_Y : Instr::PUT_VARIABLE_X, v.reg, i);
+                v.seen = true;
+            } else if (!c || c->get_arity() == 0) {
+                emit(Instr::PUT_CONSTANT, i, 0, Cell::constant(a));
+            } else {
+                build(c, i);
+            }
+        }
+    }
+
+    // Return true when the goal is a cut.
+    static bool is_cut(const Compound *goal)
+    {
+        static Atom *const cut = Atom::intern("!");
+        return goal->get_functor() == cut && goal->get_arity() == 0;
+    }
+
+    // Emit a call of the goal; the label is resolved later.
+    void call(Instr::Op op, Compound *goal)
+    {
+        emit(op, 0, 0, Cell::fun(goal->get_functor(), goal->get_arity()), goal->get_arity());
+        code.back().label = goal->key();
+    }
+
+public:
+    explicit Compiler(std::vector<Instr> &c) : code(c) {}
+
+    // Compile a clause.
+    void clause(Compound *head, Goal *body)
+    {
+        unsigned max_arity = head->get_arity();
+        scan(head, 0);
+        int chunk = 0;
+        bool deep_cut = false;
+        for (Goal *g = body; g; g = g->get_tail()) {
+            if (is_cut(g->get_head())) {
+                // A cut calls nothing, so it does not end a chunk.
+                deep_cut = deep_cut || chunk > 0;
+                continue;
+            }
+            scan(g->get_head(), chunk++);
+            max_arity = std::max(max_arity, (unsigned)g->get_head()->get_arity());
+        }
+        allocate(max_arity, false);
+        unsigned level = deep_cut ? nperm++ : 0;
+
+        bool environment = chunk > 1 || deep_cut;
+        if (environment)
+            emit(Instr::ALLOCATE, 0, 0, Cell(), nperm);
+        if (deep_cut)
+            emit(Instr::GET_LEVEL, level);
+        get_args(head);
+        if (!body) {
+            emit(Instr::PROCEED);
+            return;
+        }
+        bool called = false;
+        for (Goal *g = body; g; g = g->get_tail()) {
+            if (is_cut(g->get_head())) {
+                if (called)
+                    emit(Instr::CUT, level);
+                else
+                    emit(Instr::NECK_CUT);
+                if (!g->get_tail()) {
+                    if (environment)
+                        emit(Instr::DEALLOCATE);
+                    emit(Instr::PROCEED);
+                }
+                continue;
+            }
+            put_args(g->get_head());
+            if (g->get_tail()) {
+                call(Instr::CALL, g->get_head());
+                called = true;
+            } else {
+                if (environment)
+                    emit(Instr::DEALLOCATE);
+                call(Instr::EXECUTE, g->get_head());
+            }
+        }
+    }
+
+    // Compile a query: all its variables are permanent, so they survive until the answer.
+    // A cut in the query removes all choice points made before it.
+    void query(Goal *goal)
+    {
+        unsigned max_arity = 0;
+        bool cut = false;
+        for (Goal *g = goal; g; g = g->get_tail()) {
+            scan(g->get_head(), 0);
+            max_arity = std::max(max_arity, (unsigned)g->get_head()->get_arity());
+            cut = cut || is_cut(g->get_head());
+        }
+        allocate(max_arity, true);
+        unsigned level = cut ? nperm++ : 0;
+
+        emit(Instr::ALLOCATE, 0, 0, Cell(), nperm);
+        if (cut)
+            emit(Instr::GET_LEVEL, level);
+        for (Goal *g = goal; g; g = g->get_tail()) {
+            if (is_cut(g->get_head())) {
+                emit(Instr::CUT, level);
+                continue;
+            }
+            put_args(g->get_head());
+            call(Instr::CALL, g->get_head());
+        }
+        emit(Instr::ANSWER);
+    }
+
+    // Return the Y register of a query variable, or -1 when it does not appear in the query.
+    int permanent(Term *t)
+    {
+        auto found = vars.find(t->deref());
+        return (found == vars.end()) ? -1 : (int)found->second.reg;
+    }
+
+    // Return the number of X registers used.
+    unsigned temporaries() const { return next_temp; }
+};
+
+//
+// Compile the program.
+// Address 0 holds a FAIL instruction: calls to undefined predicates go there.
+//
+Machine::Machine(Program *prog)
+{
+    code.push_back({ Instr::FAIL, 0, 0, 0, Cell(), 0 });
+
+    // Group the clauses by predicate, keeping the program order.
+    std::vector<uint64_t> keys;
+    std::unordered_map<uint64_t, std::vector<Clause *>> predicates;
+    for (Program *iter = prog; iter; iter = iter->tail) {
+        uint64_t key = iter->head->head->key();
+        if (predicates.find(key) == predicates.end())
+            keys.push_back(key);
+        predicates[key].push_back(iter->head);
+    }
+    for (uint64_t key : keys) {
+        entries[key] = code.size();
+        compile_predicate(predicates[key]);
+    }
+    link(0);
+}
+
+//
+// Compile all clauses of one predicate.
+// Alternatives are chained by try_me_else, retry_me_else and trust_me.
+//
+void Machine::compile_predicate(const std::vector<Clause *> &clauses)
+{
+    unsigned arity = clauses[0]->head->get_arity();
+    size_t alternative = none;
+    for (size_t i = 0; i < clauses.size(); i++) {
+        if (alternative != none)
+            code[alternative].label = code.size();
+        if (clauses.size() > 1) {
+            alternative = code.size();
+            Instr::Op op = (i == 0) ? Instr::TRY_ME_ELSE
+                         : (i + 1 < clauses.size()) ? Instr::RETRY_ME_ELSE : Instr::TRUST_ME;
+            code.push_back({ op, 0, 0, arity, Cell(), 0 });
+        }
+        Compiler c(code);
+        c.clause(clauses[i]->head, clauses[i]->body);
+        xregs.resize(std::max<size_t>(xregs.size(), c.temporaries()));
+    }
+}
+
+//
+// Resolve the calls in the code starting from the given address:
+// replace the predicate key by the entry address.
+//
+void Machine::link(size_t from)
+{
+    for (size_t i = from; i < code.size(); i++) {
+        if (code[i].op == Instr::CALL || code[i].op == Instr::EXECUTE) {
+            auto found = entries.find(code[i].label);
+            code[i].label = (found == entries.end()) ? 0 : found->second;
+        }
+    }
+}
+
+//
+// Return the first free position on the stack, above both
+// the current environment and the latest choice point.
+// Make sure there is room for the given size.
+//
+size_t Machine::push_frame(size_t size)
+{
+    size_t top = 0;
+    if (E != none)
+        top = E + 3 + saved(E + 2);
+    if (B != none)
+        top = std::max(top, B + saved(B) + 8);
+    if (stack.size() < top + size)
+        stack.resize(2 * (top + size));
+    return top;
+}
+
+//
+// Run the code until the next answer.
+// Return false when there are no more answers.
+//
+bool Machine::run()
+{
+    for (;;) {
+        const Instr &i = code[P];
+        bool ok = true;
+
+        switch (i.op) {
+        case Instr::PUT_VARIABLE_X:
+            xregs[i.reg] = xregs[i.arg] = new_variable();
+            P++;
+            break;
+        case Instr::PUT_VARIABLE_Y:
+            yreg(i.reg) = xregs[i.arg] = new_variable();
+            P++;
+            break;
+        case Instr::PUT_VALUE_X:
+            xregs[i.arg] = xregs[i.reg];
+            P++;
+            break;
+        case Instr::PUT_VALUE_Y:
+            xregs[i.arg] = yreg(i.reg);
+            P++;
+            break;
+        case Instr::PUT_STRUCTURE:
+            xregs[i.reg] = Cell::str(heap.size());
+            heap.push_back(i.cell);
+            write_mode = true;
+            P++;
+            break;
+        case Instr::PUT_CONSTANT:
+            xregs[i.reg] = i.cell;
+            P++;
+            break;
+        case Instr::GET_VARIABLE_X:
+            xregs[i.reg] = xregs[i.arg];
+            P++;
+            break;
+        case Instr::GET_VARIABLE_Y:
+            yreg(i.reg) = xregs[i.arg];
+            P++;
+            break;
+        case Instr::GET_VALUE_X:
+            ok = unify(xregs[i.reg], xregs[i.arg]);
+            P++;
+            break;
+        case Instr::GET_VALUE_Y:
+            ok = unify(yreg(i.reg), xregs[i.arg]);
+            P++;
+            break;
+        case Instr::GET_STRUCTURE: {
+            Cell d = deref(xregs[i.reg]);
+            if (d.tag() == Cell::REF) {
+                size_t addr = heap.size();
+                heap.push_back(i.cell);
+                bind(d.addr(), Cell::str(addr));
+                write_mode = true;
+            } else if (d.tag() == Cell::STR && heap[d.addr()] == i.cell) {
+                S = d.addr() + 1;
+                write_mode = false;
+            } else {
+                ok = false;
+            }
+            P++;
+            break;
+        }
+        case Instr::GET_CONSTANT: {
+            Cell d = deref(xregs[i.reg]);
+            if (d.tag() == Cell::REF)
+                bind(d.addr(), i.cell);
+            else
+                ok = (d == i.cell);
+            P++;
+            break;
+        }
+        case Instr::UNIFY_VARIABLE_X:
+            xregs[i.reg] = write_mode ? new_variable() : heap[S++];
+            P++;
+            break;
+        case Instr::UNIFY_VARIABLE_Y:
+            yreg(i.reg) = write_mode ? new_variable() : heap[S++];
+            P++;
+            break;
+        case Instr::UNIFY_VALUE_X:
+            if (write_mode)
+                heap.push_back(xregs[i.reg]);
+            else
+                ok = unify(xregs[i.reg], heap[S++]);
+            P++;
+            break;
+        case Instr::UNIFY_VALUE_Y:
+            if (write_mode)
+                heap.push_back(yreg(i.reg));
+            else
+                ok = unify(yreg(i.reg), heap[S++]);
+            P++;
+            break;
+        case Instr::UNIFY_CONSTANT:
+            if (write_mode) {
+                heap.push_back(i.cell);
+            } else {
+                Cell d = deref(heap[S++]);
+                if (d.tag() == Cell::REF)
+                    bind(d.addr(), i.cell);
+                else
+                    ok = (d == i.cell);
+            }
+            P++;
+            break;
+        case Instr::ALLOCATE: {
+            size_t frame = push_frame(3 + i.arity);
+            stack[frame] = Cell::raw(E);
+            stack[frame + 1] = Cell::raw(CP);
+            stack[frame + 2] = Cell::raw(i.arity);
+            E = frame;
+            P++;
+            break;
+        }
+        case Instr::DEALLOCATE:
+            CP = saved(E + 1);
+            E = saved(E);
+            P++;
+            break;
+        case Instr::CALL:
+            CP = P + 1;
+            B0 = B;
+            P = i.label;
+            break;
+        case Instr::EXECUTE:
+            B0 = B;
+            P = i.label;
+            break;
+        case Instr::PROCEED:
+            P = CP;
+            break;
+        case Instr::TRY_ME_ELSE: {
+            unsigned n = i.arity;
+            size_t frame = push_frame(n + 8);
+            stack[frame] = Cell::raw(n);
+            for (unsigned k = 0; k < n; k++)
+                stack[frame + 1 + k] = xregs[k];
+            stack[frame + n + 1] = Cell::raw(E);
+            stack[frame + n + 2] = Cell::raw(CP);
+            stack[frame + n + 3] = Cell::raw(B);
+            stack[frame + n + 4] = Cell::raw(i.label);
+            stack[frame + n + 5] = Cell::raw(trail.size());
+            stack[frame + n + 6] = Cell::raw(heap.size());
+            stack[frame + n + 7] = Cell::raw(B0);
+            B = frame;
+            HB = heap.size();
+            P++;
+            break;
+        }
+        case Instr::RETRY_ME_ELSE:
+        case Instr::TRUST_ME: {
+            size_t n = saved(B);
+            for (size_t k = 0; k < n; k++)
+                xregs[k] = stack[B + 1 + k];
+            E = saved(B + n + 1);
+            CP = saved(B + n + 2);
+            B0 = saved(B + n + 7);
+            unwind_trail(saved(B + n + 5));
+            heap.resize(saved(B + n + 6));
+            if (i.op == Instr::RETRY_ME_ELSE) {
+                stack[B + n + 4] = Cell::raw(i.label);
+                HB = heap.size();
+            } else {
+                B = saved(B + n + 3);
+                HB = (B == none) ? 0 : saved(B + saved(B) + 6);
+            }
+            P++;
+            break;
+        }
+        case Instr::FAIL:
+            ok = false;
+            break;
+        case Instr::ANSWER:
+            return true;
+        case Instr::NECK_CUT:
+            cut(B0);
+            P++;
+            break;
+        case Instr::GET_LEVEL:
+            yreg(i.reg) = Cell::raw(B0);
+            P++;
+            break;
+        case Instr::CUT:
+            cut(yreg(i.reg).raw());
+            P++;
+            break;
+        }
+
+        if (!ok) {
+            // Backtrack to the next alternative of the latest choice point.
+            if (B == none)
+                return false;
+            P = saved(B + saved(B) + 4);
+        }
+    }
+}
+
+//
+// Remove the choice points above the given one.
+// The heap above the new latest choice point is no longer protected.
+//
+void Machine::cut(size_t b)
+{
+    B = b;
+    HB = (B == none) ? 0 : saved(B + saved(B) + 6);
+}
+
+//
+// Solve the goal, and print all the answers to the output of the current engine.
+//
+void Machine::solve(Goal *goal, VarMapping *vars)
+{
+    size_t start = code.size();
+    Compiler c(code);
+    c.query(goal);
+    link(start);
+    xregs.resize(std::max<size_t>(xregs.size(), c.temporaries()));
+
+    heap.clear();
+    trail.clear();
+    E = B = B0 = none;
+    HB = 0;
+    P = start;
+    std::ostream &out = Engine::current().output();
+    while (run()) {
+        if (vars->size() == 0)
+            out << "yes\n";
+        for (int i = 0; i < vars->size(); i++) {
+            out << vars->name(i) << " = ";
+            int reg = c.permanent(vars->variable(i));
+            if (reg < 0)
+                out << "_";
+            else
+                print(yreg(reg), out);
+            out << "\n";
+        }
+
+        // Ask for the next answer.
+        if (B == none)
+            break;
+        P = saved(B + saved(B) + 4);
+    }
+    code.resize(start);
+}
+
+//
+// Print the compiled code.
+//
+void Machine::print_code() const
+{
+    static const char *const names[] = {
+        "put_variable X", "put_variable Y", "put_value X",    "put_value Y",     "put_structure",
+        "put_constant",   "get_variable X", "get_variable Y", "get_value X",     "get_value Y",
+        "get_structure",  "get_constant",   "unify_variable X", "unify_variable Y", "unify_value X",
+        "unify_value Y",  "unify_constant", "allocate",       "deallocate",      "call",
+        "execute",        "proceed",        "try_me_else",    "retry_me_else",   "trust_me",
+        "fail",           "answer",         "neck_cut",       "get_level",       "cut",
+    };
+    for (size_t addr = 0; addr < code.size(); addr++) {
+        const Instr &i = code[addr];
+        std::cout << addr << ":\t" << names[i.op];
+        switch (i.op) {
+        case Instr::PUT_VARIABLE_X:
+        case Instr::PUT_VARIABLE_Y:
+        case Instr::PUT_VALUE_X:
+        case Instr::PUT_VALUE_Y:
+        case Instr::GET_VARIABLE_X:
+        case Instr::GET_VARIABLE_Y:
+        case Instr::GET_VALUE_X:
+        case Instr::GET_VALUE_Y:
+            std::cout << i.reg << ", A" << i.arg;
+            break;
+        case Instr::PUT_STRUCTURE:
+        case Instr::GET_STRUCTURE:
+            std::cout << " " << i.cell.atom()->name() << "/" << i.cell.arity() << ", X" << i.reg;
+            break;
+        case Instr::PUT_CONSTANT:
+        case Instr::GET_CONSTANT:
+            std::cout << " " << i.cell.atom()->name() << ", X" << i.reg;
+            break;
+        case Instr::UNIFY_VARIABLE_X:
+        case Instr::UNIFY_VARIABLE_Y:
+        case Instr::UNIFY_VALUE_X:
+        case Instr::UNIFY_VALUE_Y:
+            std::cout << i.reg;
+            break;
+        case Instr::UNIFY_CONSTANT:
+            std::cout << " " << i.cell.atom()->name();
+            break;
+        case Instr::ALLOCATE:
+            std::cout << " " << i.arity;
+            break;
+        case Instr::GET_LEVEL:
+        case Instr::CUT:
+            std::cout << " Y" << i.reg;
+            break;
+        case Instr::CALL:
+        case Instr::EXECUTE:
+            std::cout << " " << i.cell.atom()->name() << "/" << i.arity << " @" << i.label;
+            break;
+        case Instr::TRY_ME_ELSE:
+        case Instr::RETRY_ME_ELSE:
+            std::cout << " @" << i.label;
+            break;
+        default:
+            break;
+        }
+        std::cout << "\n";
+    }
+}
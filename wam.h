@@ -0,0 +1,113 @@
+//
+// Warren Abstract Machine: an alternative backend for the interpreter.
+// Clauses of a program are compiled into instructions for a register-based
+// virtual machine, which runs them over its own heap, stack and trail.
+// The tree-walking Goal::solve() stays as the reference engine.
+//
+#ifndef WAM_H
+#define WAM_H
+
+#include "cell.h"
+
+//
+// Instruction of the machine.
+//
+struct Instr {
+    enum Op : uint8_t {
+        PUT_VARIABLE_X,   // Create an unbound variable in Xn and Ai
+        PUT_VARIABLE_Y,   // Create an unbound variable in Yn and Ai
+        PUT_VALUE_X,      // Copy Xn into Ai
+        PUT_VALUE_Y,      // Copy Yn into Ai
+        PUT_STRUCTURE,    // Start a structure f/n in Xn, and switch to write mode
+        PUT_CONSTANT,     // Place a constant c into Xn
+        GET_VARIABLE_X,   // Copy Ai into Xn
+        GET_VARIABLE_Y,   // Copy Ai into Yn
+        GET_VALUE_X,      // Unify Ai with Xn
+        GET_VALUE_Y,      // Unify Ai with Yn
+        GET_STRUCTURE,    // Match or build a structure f/n in Xn
+        GET_CONSTANT,     // Match or bind a constant c in Xn
+        UNIFY_VARIABLE_X, // Read or create the next argument into Xn
+        UNIFY_VARIABLE_Y, // Read or create the next argument into Yn
+        UNIFY_VALUE_X,    // Unify or store the next argument with Xn
+        UNIFY_VALUE_Y,    // Unify or store the next argument with Yn
+        UNIFY_CONSTANT,   // Match or store constant c as the next argument
+        ALLOCATE,         // Push an environment with n permanent variables
+        DEALLOCATE,       // Pop the environment
+        CALL,             // Call a predicate, continue with the next instruction
+        EXECUTE,          // Jump to a predicate, keeping the continuation
+        PROCEED,          // Return to the continuation
+        TRY_ME_ELSE,      // Push a choice point, the next alternative is at the label
+        RETRY_ME_ELSE,    // Update a choice point, the next alternative is at the label
+        TRUST_ME,         // Pop a choice point before the last alternative
+        FAIL,             // Backtrack
+        ANSWER,           // The query succeeded: report the answer
+        NECK_CUT,         // Remove the choice points made since the predicate was called
+        GET_LEVEL,        // Save the cut barrier of the predicate in Yn
+        CUT,              // Remove the choice points made since the barrier saved in Yn
+    };
+    Op op;
+    unsigned reg;   // Number of X or Y register
+    unsigned arg;   // Number of argument register
+    unsigned arity; // Arity of a predicate, size of environment
+    Cell cell;      // Functor or constant
+    size_t label;   // Code address
+};
+
+//
+// Abstract machine with compiled program.
+// Terms live on the heap of the store, as tagged words.
+// Stack frames keep saved registers as plain numbers.
+//
+class Machine : public Store {
+    static constexpr size_t none = SIZE_MAX;
+
+    // Compiled code, and entry points of predicates.
+    std::vector<Instr> code;
+    std::unordered_map<uint64_t, size_t> entries;
+
+    // Data areas, besides the heap and the trail.
+    std::vector<Cell> stack;
+    std::vector<Cell> xregs;
+
+    // Registers.
+    size_t P{ 0 };     // Program counter
+    size_t CP{ 0 };    // Continuation
+    size_t S{ 0 };     // Next argument of a structure in read mode
+    size_t E{ none };  // Current environment
+    size_t B{ none };  // Latest choice point
+    size_t B0{ none }; // Latest choice point when the predicate was called
+    bool write_mode{ false };
+
+    // Compile all clauses of one predicate.
+    void compile_predicate(const std::vector<Clause *> &clauses);
+
+    // Resolve the calls in the code starting from the given address.
+    void link(size_t from);
+
+    // Return the first free position on the stack, and make room for the given size.
+    size_t push_frame(size_t size);
+
+    // Access a permanent variable in the current environment.
+    Cell &yreg(unsigned n) { return stack[E + 3 + n]; }
+
+    // Access a saved register in a stack frame.
+    size_t saved(size_t pos) const { return stack[pos].raw(); }
+
+    // Remove the choice points above the given one.
+    void cut(size_t b);
+
+    // Run the code until the next answer; return false when there are no more.
+    bool run();
+
+public:
+    // Compile the program.
+    explicit Machine(Program *prog);
+
+    // Solve the goal, and print all the answers.
+    void solve(Goal *goal, VarMapping *vars);
+
+    // Print the compiled code.
+    void print_code() const;
+};
+
+#endif // WAM_H
@@ -0,0 +1,371 @@
+//
+// Writer of terms into a buffer, which is emptied into a sink:
+// as text, or in a compact binary encoding.
+//
+#include "writer.h"
+
+#include <cerrno>
+#include <charconv>
+#include <unistd.h>
+
+//
+// Write the bytes, resuming after partial writes and interrupts.
+//
+bool FileSink::write(const char *data, size_t size)
+{
+    while (size > 0) {
+        ssize_t n = ::write(fd, data, size);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        data += n;
+        size -= n;
+    }
+    return true;
+}
+
+//
+// Append an integer in decimal.
+//
+void Writer::put_integer(int64_t n)
+{
+    char text[24];
+    put(std::string_view(text, std::to_chars(text, text + sizeof(text), n).ptr - text));
+}
+
+//
+// Append n*4 spaces.
+//
+void Writer::indent(int n)
+{
+    for (int i = 0; i < n; i++)
+        put("    ");
+}
+
+//
+// Write the term. The explicit stack holds the terms still to write,
+// and the punctuation between them.
+//
+void Writer::term(Term *t)
+{
+    work.push_back({ t, 0 });
+    while (!work.empty()) {
+        Item item = work.back();
+        work.pop_back();
+        if (item.text) {
+            put(item.text);
+            continue;
+        }
+
+        Term *d = item.term->deref();
+        if (Number *n = d->as_number()) {
+            char text[Number::max_text];
+            put(std::string_view(text, n->format(text)));
+            continue;
+        }
+        Compound *c = d->as_compound();
+        if (!c) {
+            put('_');
+            put_integer(static_cast<Variable *>(d)->get_index());
+            continue;
+        }
+        put(c->get_functor()->name());
+        if (c->get_arity() > 0) {
+            put('(');
+            work.push_back({ nullptr, ')' });
+            for (int i = c->get_arity(); i > 0; i--) {
+                work.push_back({ c->arg(i - 1), 0 });
+                if (i > 1)
+                    work.push_back({ nullptr, ',' });
+            }
+        }
+    }
+}
+
+//
+// Write the goals, separated by semicolons.
+//
+void Writer::goals(const Goal *g)
+{
+    for (; g; g = g->get_tail()) {
+        term(g->get_head());
+        if (g->get_tail())
+            put("; ");
+    }
+}
+
+//
+// Write the clause, with "true" for an empty body.
+//
+void Writer::clause(const Clause *cl)
+{
+    term(cl->head);
+    put(" :- ");
+    if (cl->body)
+        goals(cl->body);
+    else
+        put("true");
+}
+
+//
+// Write the variables and their values, one per line, or "yes" when there are none.
+//
+void Writer::answer(const VarMapping &vars)
+{
+    if (vars.size() == 0)
+        put("yes\n");
+    for (int i = 0; i < vars.size(); i++) {
+        put(vars.name(i));
+        put(" = ");
+        term(vars.variable(i));
+        put('\n');
+    }
+}
+
+//
+// Pass the buffered bytes to the sink, and keep the buffer for reuse.
+// After a failure, the bytes are dropped.
+//
+bool Writer::flush()
+{
+    if (!buffer.empty() && !failed)
+        failed = !sink.write(buffer.data(), buffer.size());
+    buffer.clear();
+    return !failed;
+}
+
+//
+// Write the term: the explicit stack holds the terms still to write.
+//
+void TermEncoder::encode(Term *t)
+{
+    work.push_back(t);
+    while (!work.empty()) {
+        Term *d = work.back()->deref();
+        work.pop_back();
+
+        if (Number *n = d->as_number()) {
+            const Value &v = n->get_value();
+            if (v.is_float()) {
+                out.put(TAG_FLOAT);
+                out.put_number(v.bits());
+            } else {
+                out.put(TAG_INTEGER);
+                out.put_number((uint64_t)v.integer << 1 ^ (uint64_t)(v.integer >> 63));
+            }
+            continue;
+        }
+        Compound *c = d->as_compound();
+        if (!c) {
+            auto found = vars.emplace(static_cast<Variable *>(d), vars.size());
+            out.put(TAG_VARIABLE);
+            out.put_number(found.first->second);
+            continue;
+        }
+
+        const Atom *a = c->get_functor();
+        unsigned id = a->get_id();
+        if (id >= atoms.size())
+            atoms.resize(id + 1, 0);
+        if (!atoms[id]) {
+            atoms[id] = ++natoms;
+            out.put(TAG_ATOM);
+            out.put_number(a->name().size());
+            out.put(a->name());
+        } else {
+            out.put(TAG_COMPOUND);
+            out.put_number(atoms[id] - 1);
+        }
+        out.put_number(c->get_arity());
+        for (int i = c->get_arity(); i > 0; i--)
+            work.push_back(c->arg(i - 1));
+    }
+}
+
+//
+// Write the number of variables, and then the name and the value of every variable.
+//
+void TermEncoder::answer(const VarMapping &mapping)
+{
+    out.put_number(mapping.size());
+    for (int i = 0; i < mapping.size(); i++) {
+        out.put_number(mapping.name(i).size());
+        out.put(mapping.name(i));
+        encode(mapping.variable(i));
+    }
+}
+
+//
+// Forget the atoms and the variables.
+//
+void TermEncoder::reset()
+{
+    std::fill(atoms.begin(), atoms.end(), 0);
+    natoms = 0;
+    vars.clear();
+}
+
+//
+// Read a number in variable-length encoding.
+//
+static bool get_number(const char *&p, const char *end, uint64_t &n)
+{
+    n = 0;
+    for (int shift = 0; shift < 64 && p < end; shift += 7) {
+        unsigned char c = *p++;
+        n |= (uint64_t)(c & 0x7f) << shift;
+        if (!(c & 0x80))
+            return true;
+    }
+    return false;
+}
+
+//
+// Read a string of the given length.
+//
+static bool get_text(const char *&p, const char *end, std::string_view &text)
+{
+    uint64_t length;
+    if (!get_number(p, end, length) || length > (uint64_t)(end - p))
+        return false;
+    text = std::string_view(p, length);
+    p += length;
+    return true;
+}
+
+//
+// Decode a term from the start of the input, and remove its bytes from the input.
+// Arguments are collected on a stack, and a compound is built when all of them
+// are there. Return nullptr when the input is malformed or incomplete:
+// the atoms and the variables read meanwhile are forgotten, so the input
+// can be decoded again when more of it has arrived.
+//
+Term *TermDecoder::decode(std::string_view &in)
+{
+    size_t natoms = atoms.size(), nvars = vars.size();
+    Term *t = parse(in);
+    if (!t) {
+        atoms.resize(natoms);
+        vars.resize(nvars);
+    }
+    return t;
+}
+
+//
+// Decode a term, leaving the atoms and the variables it defines on failure.
+//
+Term *TermDecoder::parse(std::string_view &in)
+{
+    const char *p = in.data();
+    const char *end = p + in.size();
+    pending.clear();
+    args.clear();
+
+    while (p < end) {
+        Term *t;
+        uint64_t n, arity;
+        std::string_view name;
+        char tag = *p++;
+        switch (tag) {
+        case TermEncoder::TAG_VARIABLE:
+            if (!get_number(p, end, n) || n > vars.size())
+                return nullptr;
+            if (n == vars.size())
+                vars.push_back(new Variable());
+            t = vars[n];
+            break;
+        case TermEncoder::TAG_INTEGER:
+            if (!get_number(p, end, n))
+                return nullptr;
+            t = Number::create(Value::from_integer((int64_t)(n >> 1) ^ -(int64_t)(n & 1)));
+            break;
+        case TermEncoder::TAG_FLOAT:
+            if (!get_number(p, end, n))
+                return nullptr;
+            t = Number::create(Value::from_float(std::bit_cast<double>(n)));
+            break;
+        case TermEncoder::TAG_ATOM:
+        case TermEncoder::TAG_COMPOUND:
+            if (tag == TermEncoder::TAG_ATOM) {
+                if (!get_text(p, end, name))
+                    return nullptr;
+                n = atoms.size();
+                atoms.push_back(Atom::intern(std::string(name)));
+            } else if (!get_number(p, end, n) || n >= atoms.size()) {
+                return nullptr;
+            }
+
+            // Every argument takes at least two bytes.
+            if (!get_number(p, end, arity) || arity > (uint64_t)(end - p) / 2)
+                return nullptr;
+            if (arity > 0) {
+                pending.push_back({ atoms[n], arity, args.size() });
+                continue;
+            }
+            t = Compound::create(atoms[n]);
+            break;
+        default:
+            return nullptr;
+        }
+
+        // Complete the compounds which have all their arguments.
+        for (;;) {
+            if (pending.empty()) {
+                in.remove_prefix(p - in.data());
+                return t;
+            }
+            args.push_back(t);
+            Pending &top = pending.back();
+            if (args.size() < top.base + top.arity)
+                break;
+            t = Compound::create(top.functor, top.arity, args.data() + top.base);
+            args.resize(top.base);
+            pending.pop_back();
+        }
+    }
+    return nullptr;
+}
+
+//
+// Decode an answer: the number of variables, and the name and the value of every variable.
+// On failure, the result and the decoder are left as they were.
+//
+bool TermDecoder::answer(std::string_view &in, std::vector<std::pair<std::string, Term *>> &result)
+{
+    const char *p = in.data();
+    const char *end = p + in.size();
+    uint64_t count;
+    if (!get_number(p, end, count) || count > (uint64_t)(end - p))
+        return false;
+    size_t natoms = atoms.size(), nvars = vars.size(), nvalues = result.size();
+    std::string_view rest(p, end - p);
+    for (uint64_t i = 0; i < count; i++) {
+        p = rest.data();
+        std::string_view name;
+        Term *value = nullptr;
+        if (get_text(p, rest.data() + rest.size(), name)) {
+            rest.remove_prefix(p - rest.data());
+            value = parse(rest);
+        }
+        if (!value) {
+            atoms.resize(natoms);
+            vars.resize(nvars);
+            result.resize(nvalues);
+            return false;
+        }
+        result.emplace_back(std::string(name), value);
+    }
+    in = rest;
+    return true;
+}
+
+//
+// Forget the atoms and the variables.
+//
+void TermDecoder::reset()
+{
+    atoms.clear();
+    vars.clear();
+}
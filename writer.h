@@ -0,0 +1,224 @@
+//
+// Writer of terms into a buffer, which is emptied into a sink:
+// as text, or in a compact binary encoding.
+//
+#ifndef WRITER_H
+#define WRITER_H
+
+#include <string>
+#include <string_view>
+
+#include "prolog.h"
+
+//
+// Destination of the bytes of a writer.
+//
+class Sink {
+public:
+    virtual ~Sink() = default;
+
+    // Write all the bytes; return false when they cannot be written.
+    virtual bool write(const char *data, size_t size) = 0;
+};
+
+//
+// Sink which appends to a string.
+//
+class StringSink : public Sink {
+    std::string &text;
+
+public:
+    explicit StringSink(std::string &t) : text(t) {}
+
+    // Append the bytes to the string.
+    bool write(const char *data, size_t size) override
+    {
+        text.append(data, size);
+        return true;
+    }
+};
+
+//
+// Sink which writes to a stream.
+//
+class StreamSink : public Sink {
+    std::ostream &out;
+
+public:
+    explicit StreamSink(std::ostream &o) : out(o) {}
+
+    // Write the bytes to the stream.
+    bool write(const char *data, size_t size) override { return bool(out.write(data, size)); }
+};
+
+//
+// Sink which writes to a file descriptor: a file, a pipe or a socket.
+// The descriptor is not closed by the sink.
+//
+class FileSink : public Sink {
+    int fd;
+
+public:
+    explicit FileSink(int d) : fd(d) {}
+
+    // Write the bytes, resuming after partial writes and interrupts.
+    bool write(const char *data, size_t size) override;
+};
+
+//
+// Writer collects text in its buffer, and passes it to the sink when
+// the buffer is full, when flushed, and when destroyed. The buffer and
+// the stack of terms are kept between terms, so that a writer which
+// is reused allocates nothing once they have grown.
+// Terms are written with an explicit stack, as Term::print() does:
+// neither deep terms nor long lists grow the native stack.
+//
+class Writer {
+    struct Item {
+        Term *term;
+        char text; // Punctuation to write instead of a term
+    };
+
+    Sink &sink;
+    size_t capacity;
+    std::string buffer;
+    std::vector<Item> work;
+    bool failed{ false };
+
+public:
+    // Write to the sink, in pieces of the given size.
+    explicit Writer(Sink &s, size_t buffer_size = 64 * 1024) : sink(s), capacity(buffer_size) {}
+    ~Writer() { flush(); }
+    Writer(const Writer &) = delete;
+    Writer &operator=(const Writer &) = delete;
+
+    // Append a byte.
+    void put(char c)
+    {
+        buffer.push_back(c);
+        if (buffer.size() >= capacity)
+            flush();
+    }
+
+    // Append bytes.
+    void put(std::string_view text)
+    {
+        buffer.append(text);
+        if (buffer.size() >= capacity)
+            flush();
+    }
+
+    // Append an integer in decimal.
+    void put_integer(int64_t n);
+
+    // Append a number in variable-length encoding:
+    // seven bits per byte, the high bit set on all bytes but the last.
+    void put_number(uint64_t n)
+    {
+        while (n >= 0x80) {
+            buffer.push_back((char)(n | 0x80));
+            n >>= 7;
+        }
+        put((char)n);
+    }
+
+    // Append n*4 spaces.
+    void indent(int n);
+
+    // Write the term, as Term::print() does.
+    void term(Term *t);
+
+    // Write the goals, separated by semicolons.
+    void goals(const Goal *g);
+
+    // Write the clause.
+    void clause(const Clause *cl);
+
+    // Write the variables and their values, one per line, or "yes" when there are none.
+    void answer(const VarMapping &vars);
+
+    // Pass the buffered bytes to the sink; return false when the sink has failed.
+    bool flush();
+
+    // Return false when the sink has failed to write.
+    bool good() const { return !failed; }
+};
+
+//
+// TermEncoder writes terms in a compact binary form, for passing them
+// between processes. A term is a tag byte followed by numbers in
+// variable-length encoding:
+//      'V' n                   variable number n, in the order of first appearance
+//      'I' n                   integer, zigzag encoded
+//      'F' bits                float, its bits as a number
+//      'A' length name arity   compound with the next atom number, and its name
+//      'C' atom arity          compound with an atom defined before
+// and the arguments of a compound follow it.
+// Atoms and variables are numbered over all the terms written by the
+// encoder, so that the terms of an answer share their variables,
+// until the encoder is reset.
+//
+class TermEncoder {
+    Writer &out;
+    std::vector<uint32_t> atoms; // Number of every atom in the encoding, plus one, by atom ID
+    uint32_t natoms{ 0 };
+    std::unordered_map<const Variable *, uint64_t> vars;
+    std::vector<Term *> work;
+
+public:
+    //
+    // Tags of terms.
+    //
+    enum Tag : char {
+        TAG_VARIABLE = 'V', // Unbound variable: number
+        TAG_INTEGER = 'I',  // Integer: zigzag value
+        TAG_FLOAT = 'F',    // Float: bits
+        TAG_ATOM = 'A',     // Compound with a new atom: length, name, arity
+        TAG_COMPOUND = 'C', // Compound with a known atom: atom number, arity
+    };
+
+    explicit TermEncoder(Writer &w) : out(w) {}
+
+    // Write the term.
+    void encode(Term *t);
+
+    // Write the number of variables, and then the name and the value of every variable.
+    void answer(const VarMapping &vars);
+
+    // Forget the atoms and the variables: the next term starts a new encoding.
+    void reset();
+};
+
+//
+// TermDecoder builds the terms written by a TermEncoder in the current engine.
+// Variables and atoms are numbered as by the encoder, until the decoder is reset.
+//
+class TermDecoder {
+    struct Pending {
+        Atom *functor;
+        uint64_t arity;
+        size_t base; // Position of the first argument on the stack
+    };
+
+    std::vector<Atom *> atoms;
+    std::vector<Variable *> vars;
+    std::vector<Pending> pending;
+    std::vector<Term *> args;
+
+public:
+    // Decode a term from the start of the input, and remove its bytes from the input.
+    // Return nullptr when the input is malformed or incomplete; the input and the decoder are left as they were.
+    Term *decode(std::string_view &in);
+
+    // Decode an answer from the start of the input, as written by TermEncoder::answer().
+    // Return false when the input is malformed or incomplete; the input and the decoder are left as they were.
+    bool answer(std::string_view &in, std::vector<std::pair<std::string, Term *>> &result);
+
+    // Forget the atoms and the variables: the next term starts a new encoding.
+    void reset();
+
+private:
+    Term *parse(std::string_view &in);
+};
+
+#endif // WRITER_H